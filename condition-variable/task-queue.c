@@ -1,29 +1,115 @@
+#include <stdlib.h>
+
 #include "task-queue.h"
 
 inline int size(task_queue_t *this) {
-    return (this->front < this->rear)
+    if (NULL != this->head) {
+        return this->count;
+    }
+
+    return (this->front <= this->rear)
         ? this->rear - this->front
         : (RING_QUEUE_CAPACITY + 1) - (this->front - this->rear);
 }
 
 inline bool is_full(task_queue_t *this) {
+    if (NULL != this->head) {
+        return 0 != this->limit && this->count >= this->limit;
+    }
+
     return this->front == (this->rear + 1) % (RING_QUEUE_CAPACITY + 1);
 }
 
 inline bool is_empty(task_queue_t *this) {
+    if (NULL != this->head) {
+        return 0 == this->count;
+    }
+
     return this->rear == this->front;
 }
 
 inline void task_queue_init(task_queue_t *this) {
+    this->head = NULL;
     this->rear = 0;
     this->front = 0;
 }
 
+int task_queue_init_segmented(task_queue_t *this, const size_t memory_cap) {
+    task_queue_init(this);
+
+    segment_t *segment = malloc(sizeof(segment_t));
+    if (NULL == segment) {
+        return -1;
+    }
+
+    segment->next = NULL;
+    segment->front = 0;
+    segment->rear = 0;
+
+    // The segment fields overlay the ring, set all of them.
+    this->head = segment;
+    this->tail = segment;
+    this->free_segments = NULL;
+    this->count = 0;
+    this->limit = 0;
+
+    if (0 != memory_cap) {
+        size_t segments = memory_cap / sizeof(segment_t);
+        this->limit = ((0 == segments) ? 1 : segments) * SEGMENT_CAPACITY;
+    }
+
+    return 0;
+}
+
+void task_queue_destroy(task_queue_t *this) {
+    if (NULL == this->head) {
+        return;
+    }
+
+    segment_t *lists[] = { this->head, this->free_segments };
+
+    for (int idx = 0; idx < 2; ++idx) {
+        segment_t *segment = lists[idx];
+
+        while (NULL != segment) {
+            segment_t *next = segment->next;
+            free(segment);
+            segment = next;
+        }
+    }
+
+    task_queue_init(this);
+}
+
 inline int task_queue_pop(task_queue_t *this, task_t *task_ptr) {
     if (is_empty(this)) {
         return -1;
     }
 
+    if (NULL != this->head) {
+        segment_t *head = this->head;
+
+        // is_empty() is false, so when the head is drained the task is in
+        // the next segment. The drained one goes to the free list.
+        if (head->front == SEGMENT_CAPACITY) {
+            this->head = head->next;
+            head->next = this->free_segments;
+            this->free_segments = head;
+            head = this->head;
+        }
+
+        *task_ptr = head->tasks[head->front++];
+        this->count -= 1;
+
+        // The last task is gone, start over at the beginning of the segment.
+        if (head->front == head->rear && head == this->tail) {
+            head->front = 0;
+            head->rear = 0;
+        }
+
+        return 0;
+    }
+
     *task_ptr = this->queue[this->front];
     this->front = (this->front + 1) % (RING_QUEUE_CAPACITY + 1);
 
@@ -35,6 +121,32 @@ inline int task_queue_push(task_queue_t *this, task_t *task_ptr) {
         return -1;
     }
 
+    if (NULL != this->head) {
+        segment_t *tail = this->tail;
+
+        if (tail->rear == SEGMENT_CAPACITY) {
+            segment_t *segment = this->free_segments;
+
+            if (NULL != segment) {
+                this->free_segments = segment->next;
+            } else if (NULL == (segment = malloc(sizeof(segment_t)))) {
+                return -1;
+            }
+
+            segment->next = NULL;
+            segment->front = 0;
+            segment->rear = 0;
+            tail->next = segment;
+            this->tail = segment;
+            tail = segment;
+        }
+
+        tail->tasks[tail->rear++] = *task_ptr;
+        this->count += 1;
+
+        return 0;
+    }
+
     this->queue[this->rear] = *task_ptr;
     this->rear = (this->rear + 1) % (RING_QUEUE_CAPACITY + 1);
 
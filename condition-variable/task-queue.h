@@ -2,7 +2,9 @@
 #define TASK_QUEUE_H_
 
 #define RING_QUEUE_CAPACITY 4096
+#define SEGMENT_CAPACITY    1024
 
+#include <stddef.h>
 #include <stdbool.h>
 
 typedef struct __TASK_TAG__ {
@@ -11,10 +13,55 @@ typedef struct __TASK_TAG__ {
 
 } task_t;
 
-typedef struct __TASK_QUEUE_TAG__ {
+// Description:
+//      A block of tasks in a segmented task queue. Tasks are appended at rear
+//      and taken at front.
+typedef struct __SEGMENT_TAG__ {
+    struct __SEGMENT_TAG__ *next;
     int front;
     int rear;
-    task_t queue[RING_QUEUE_CAPACITY + 1];
+    task_t tasks[SEGMENT_CAPACITY];
+
+} segment_t;
+
+
+// Description:
+//      Either a fixed ring of RING_QUEUE_CAPACITY tasks, or an unbounded list
+//      of segments set up by task_queue_init_segmented(). The two share their
+//      memory, head tells which one is in use.
+//
+// Attributes:
+//      head:
+//          First segment, NULL if the queue is a ring.
+//      front / rear / queue:
+//          The ring.
+//      tail:
+//          Last segment.
+//      free_segments:
+//          Drained segments kept for reuse, so a queue that has grown once
+//          does not allocate again.
+//      count:
+//          Number of tasks in the segments.
+//      limit:
+//          Soft cap: the queue reports full at this many tasks, zero if it
+//          never does.
+typedef struct __TASK_QUEUE_TAG__ {
+    segment_t *head;
+
+    union {
+        struct {
+            int front;
+            int rear;
+            task_t queue[RING_QUEUE_CAPACITY + 1];
+        };
+
+        struct {
+            segment_t *tail;
+            segment_t *free_segments;
+            int count;
+            int limit;
+        };
+    };
 
 } task_queue_t;
 
@@ -26,6 +73,13 @@ bool is_empty(task_queue_t *this);
 
 void task_queue_init(task_queue_t *this);
 
+// Turn the queue into a segmented one that buffers bursts instead of filling
+// up, until its segments take memory_cap bytes (zero for no cap). Return -1
+// if the first segment cannot be allocated.
+int task_queue_init_segmented(task_queue_t *this, const size_t memory_cap);
+
+void task_queue_destroy(task_queue_t *this);
+
 int task_queue_pop(task_queue_t *this, task_t *task_ptr);
 
 int task_queue_push(task_queue_t *this, task_t *task_ptr);
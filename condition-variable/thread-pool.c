@@ -1,21 +1,180 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <time.h>
 
 #include "thread-pool.h"
+#include "../thread-pool-lock.h"
+#include "../thread-pool-trace.h"
+#include "../thread-pool-options.h"
 
-#define exit_routine (void *)-1L    // 0xffffffffffffffff
+// Called with the mutex locked.
+static void unlink_idle_worker(thread_pool_t *this, worker_t *worker) {
+    if (NULL != worker->prev) {
+        worker->prev->next = worker->next;
+    } else {
+        this->idle_workers = worker->next;
+    }
 
-static void *start_routine(void *args) {
-    bool done = false;
+    if (NULL != worker->next) {
+        worker->next->prev = worker->prev;
+    } else {
+        this->idle_bottom = worker->prev;
+    }
+}
+
+// Take the most recently idle worker thread off the stack to hand it a task,
+// or the longest idle one with options.fifo_wakeup, unless enough have been
+// woken up for the pending tasks already. The caller signals its wakeup,
+// preferably after unlocking the mutex, so that the worker thread does not run
+// only to block on the mutex. Called with the mutex locked.
+static worker_t *pick_idle_worker(thread_pool_t *this) {
+    worker_t *worker = this->options.fifo_wakeup
+        ? this->idle_bottom
+        : this->idle_workers;
+
+    if (NULL == worker || this->waking >= size(&this->task_queue)) {
+        return NULL;
+    }
+
+    this->waking += 1;
+    unlink_idle_worker(this, worker);
+    worker->signaled = true;
+
+    return worker;
+}
+
+static void wake(worker_t *worker) {
+    if (NULL != worker) {
+        pthread_cond_signal(&worker->wakeup);
+    }
+}
+
+// Whether a spare worker is no longer needed. If so, take it out of service.
+// Called with the mutex locked.
+static bool retire(thread_pool_t *this) {
+    if (this->shutdown || this->spares_active <= this->blocking) {
+        return false;
+    }
+
+    this->spares_active -= 1;
+    stats_add(&this->stats->scaler.scale_downs, 1);
+    trace_instant(TRACE_SCALE_DOWN);
+
+    // The spare may have been woken for a task, hand it to another worker.
+    if (! is_empty(&this->task_queue)) {
+        wake(pick_idle_worker(this));
+    }
+
+    return true;
+}
+
+// Wait for a task. A worker beyond min_size waits at most idle_timeout, and
+// exits if it is still idle by then. Return false in that case. Called with
+// the mutex locked.
+static bool wait_for_task(thread_pool_t *this, worker_t *worker,
+                          const bool spare) {
+    int ret = 0;
+    unsigned long park_start = trace_begin();
+    unsigned long idle_start = stats_now_ns();
+
+    worker->signaled = false;
+    worker->prev = NULL;
+    worker->next = this->idle_workers;
+
+    if (NULL != worker->next) {
+        worker->next->prev = worker;
+    } else {
+        this->idle_bottom = worker;
+    }
+
+    this->idle_workers = worker;
+    this->idle += 1;
+
+    if (spare || 0 == this->idle_timeout ||
+        this->alive <= this->min_size) {
+        while (! worker->signaled) {
+            pool_cond_wait(&worker->wakeup, &this->mutex);
+        }
+    } else {
+        struct timespec abstime;
+        clock_gettime(CLOCK_MONOTONIC, &abstime);
+        abstime.tv_sec += this->idle_timeout / 1000;
+        abstime.tv_nsec += (this->idle_timeout % 1000) * 1000000L;
+
+        if (abstime.tv_nsec >= 1000000000L) {
+            abstime.tv_sec += 1;
+            abstime.tv_nsec -= 1000000000L;
+        }
+
+        while (! worker->signaled && ETIMEDOUT != ret) {
+            ret = pool_cond_timedwait(&worker->wakeup, &this->mutex,
+                &abstime);
+        }
+    }
+
+    // Not handed a task, the worker is still on the stack.
+    if (! worker->signaled) {
+        unlink_idle_worker(this, worker);
+    }
+
+    this->idle -= 1;
+    trace_end(TRACE_PARK, park_start, 0);
+
+    if (! worker->signaled && is_empty(&this->task_queue) &&
+        ! this->shutdown && this->alive > this->min_size) {
+        this->alive -= 1;
+        worker->alive = false;
+        stats_add(&this->stats->scaler.retires, 1);
+        trace_instant(TRACE_SCALE_DOWN);
+        return false;
+    }
+
+    if (worker->signaled) {
+        this->waking -= 1;
+        stats_add(&worker->stats->wakeups, 1);
+        stats_add(&worker->stats->wakeup_idle_ns, stats_now_ns() - idle_start);
+
+        if (is_empty(&this->task_queue)) {
+            stats_add(&worker->stats->spurious_wakeups, 1);
+        }
+    }
+
+    return true;
+}
+
+// Run tasks until the pool shuts down and the task queue is empty, or until
+// the worker is no longer needed: a spare worker once blocked tasks have
+// returned, any other worker after idle_timeout. Return true in the first
+// case.
+static bool serve(thread_pool_t *this, worker_t *worker, const bool spare) {
     task_t task = { 0 };
-    thread_pool_t *this = args;
+    worker_stats_t *stats = worker->stats;
+
+    while (1) {
+        pool_mutex_lock(&this->mutex, LOCK_MUTEX);
 
-    while (! done) {
-        pthread_mutex_lock(&this->mutex);
+        while (1) {
+            if (spare && retire(this)) {
+                pool_mutex_unlock(&this->mutex);
+                return false;
+            }
 
-        while (is_empty(&this->task_queue)) {
-            pthread_cond_wait(&this->task_available, &this->mutex);
+            if (! is_empty(&this->task_queue)) {
+                break;
+            }
+
+            if (this->shutdown) {
+                pool_mutex_unlock(&this->mutex);
+                return true;
+            }
+
+            if (! wait_for_task(this, worker, spare)) {
+                pool_mutex_unlock(&this->mutex);
+                return false;
+            }
         }
 
         if (is_full(&this->task_queue)) {
@@ -24,68 +183,393 @@ static void *start_routine(void *args) {
 
         if (-1 == task_queue_pop(&this->task_queue, &task)) {
             fprintf(stderr, "Empty queue exception.\n");
-            pthread_mutex_unlock(&this->mutex);
-            pthread_exit(NULL);
+            pool_mutex_unlock(&this->mutex);
+            return true;
         }
 
-        pthread_mutex_unlock(&this->mutex);
-        (task.run == exit_routine) ? done = true : task.run(task.arguments);
+        // Tasks are left, pass the wakeup on.
+        worker_t *next = pick_idle_worker(this);
+
+        pool_mutex_unlock(&this->mutex);
+        wake(next);
+        trace_instant(TRACE_DEQUEUE);
+
+        stats_set_state(stats, WORKER_RUNNING);
+        unsigned long run_start = trace_begin();
+        task.run(task.arguments);
+        trace_end(TRACE_RUN, run_start, 0);
+        stats_add(&stats->tasks_completed, 1);
+        stats_set_state(stats, WORKER_IDLE);
     }
-    
+}
+
+static void *start_routine(void *args) {
+    worker_t *worker = args;
+
+    trace_thread_name("worker");
+    pool_stack_prepare(&worker->pool->options);
+    stats_set_state(worker->stats, WORKER_IDLE);
+
+    serve(worker->pool, worker, false);
+
+    stats_set_state(worker->stats, WORKER_EXITED);
     pthread_exit(NULL);
 }
 
+// A spare worker starts in service. Once retired, it parks until it is
+// activated again or the pool shuts down.
+static void *spare_routine(void *args) {
+    worker_t *worker = args;
+    thread_pool_t *this = worker->pool;
+
+    trace_thread_name("spare worker");
+    pool_stack_prepare(&this->options);
+    stats_set_state(worker->stats, WORKER_IDLE);
+
+    while (! serve(this, worker, true)) {
+        stats_set_state(worker->stats, WORKER_PARKED);
+        unsigned long park_start = trace_begin();
+        pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+        while (0 == this->spare_tokens && ! this->shutdown) {
+            pool_cond_wait(&this->spare_wakeup, &this->mutex);
+        }
+
+        // On shutdown every spare worker returns to service, to find the task
+        // queue drained and exit.
+        if (0 != this->spare_tokens) {
+            this->spare_tokens -= 1;
+        }
+
+        pool_mutex_unlock(&this->mutex);
+        trace_end(TRACE_PARK, park_start, 0);
+        stats_set_state(worker->stats, WORKER_IDLE);
+    }
+
+    stats_set_state(worker->stats, WORKER_EXITED);
+    pthread_exit(NULL);
+}
+
+// Reserve a free slot for a new worker thread, counted as alive from now on,
+// or return NULL if there is none. Called with the mutex locked.
+static worker_t *claim_slot(thread_pool_t *this) {
+    for (int idx = 0; idx < this->size; ++idx) {
+        worker_t *worker = &this->workers[idx];
+
+        if (! worker->alive) {
+            worker->alive = true;
+            this->alive += 1;
+            this->spawning += 1;
+            return worker;
+        }
+    }
+
+    return NULL;
+}
+
+// Start a worker thread in a slot returned by claim_slot(), reaping the thread
+// that retired from it before. Both happen without the mutex, so submitting
+// tasks never waits for the kernel to create or join a thread. The slot is
+// ours until spawning drops, thread_pool_shutdown() waits for that before it
+// joins the worker threads.
+static int spawn(thread_pool_t *this, worker_t *worker, const bool on_demand) {
+    if (worker->joinable) {
+        pthread_join(worker->thread, NULL);
+        worker->joinable = false;
+    }
+
+    int ret = pthread_create(&worker->thread, &this->worker_attr,
+        &start_routine, worker);
+
+    if (0 != ret) {
+        errno = ret;
+        perror("pthread_create");
+    }
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+    if (0 != ret) {
+        worker->alive = false;
+        this->alive -= 1;
+    } else {
+        worker->joinable = true;
+
+        if (on_demand) {
+            stats_add(&this->stats->scaler.spawns, 1);
+            trace_instant(TRACE_SCALE_UP);
+        }
+    }
+
+    this->spawning -= 1;
+
+    if (0 == this->spawning) {
+        pthread_cond_broadcast(&this->spawned);
+    }
+
+    pool_mutex_unlock(&this->mutex);
+
+    return (0 == ret) ? 0 : -1;
+}
+
+static void release(thread_pool_t *this) {
+    for (int idx = 0; NULL != this->workers && idx < this->size; ++idx) {
+        pthread_cond_destroy(&this->workers[idx].wakeup);
+    }
+
+    for (int idx = 0; NULL != this->spare_workers &&
+                      idx < MAX_SPARE_WORKERS; ++idx) {
+        pthread_cond_destroy(&this->spare_workers[idx].wakeup);
+    }
+
+    free(this->workers);
+    free(this->spare_workers);
+    stats_region_destroy(this->stats);
+    pthread_mutex_destroy(&this->mutex);
+    pthread_cond_destroy(&this->spawned);
+    pthread_cond_destroy(&this->space_available);
+    pthread_cond_destroy(&this->spare_wakeup);
+    pthread_attr_destroy(&this->worker_attr);
+    task_queue_destroy(&this->task_queue);
+}
+
 int thread_pool_init(thread_pool_t *this, const int size) {
+    return thread_pool_init_elastic(this, size, size, 0, NULL);
+}
+
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options) {
+    return thread_pool_init_elastic(this, size, size, 0, options);
+}
+
+int thread_pool_init_elastic(thread_pool_t *this, const int min_size,
+                             const int max_size,
+                             const unsigned int idle_timeout,
+                             const thread_pool_options_t *options) {
     if (NULL == this) {
         fprintf(stderr, "Null pointer exception.\n");
         return -1;
     }
 
-    if (0 >= size) {
+    if (0 >= max_size || 0 > min_size || min_size > max_size) {
         fprintf(stderr, "Invalid size of thread pool.\n");
         return -1;
     }
 
+    // Every error path below can hand the pool to release(), which finds
+    // what has not been set up yet zeroed.
+    memset(this, 0, sizeof(*this));
+
+    if (NULL != options) {
+        this->options = *options;
+    }
+
+    if (-1 == pool_attr_init(&this->worker_attr, &this->options)) {
+        return -1;
+    }
+
     task_queue_init(&this->task_queue);
 
+    if (this->options.segmented_queue &&
+        -1 == task_queue_init_segmented(&this->task_queue,
+                                        this->options.queue_memory_cap)) {
+        perror("malloc");
+        goto Error;
+    }
+
+    pool_memory_prepare(&this->options, &this->task_queue,
+        sizeof(task_queue_t));
+
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_TIMED_NP);
+    int ret = pthread_mutex_init(&this->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
 
-    if (-1 == pthread_mutex_init(&this->mutex, &attr)) {
+    if (0 != ret) {
         perror("pthread_mutex_init");
-        return -1;
+        goto Error;
     }
 
-    pthread_mutexattr_destroy(&attr);
+    // The idle and submit timeouts are measured against CLOCK_MONOTONIC, so
+    // they are not affected by changes of the wall clock.
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
 
-    if (-1 == pthread_cond_init(&this->task_available, NULL) ||
-        -1 == pthread_cond_init(&this->space_available, NULL)) {
+    if (0 != pthread_cond_init(&this->space_available, &cond_attr) ||
+        0 != pthread_cond_init(&this->spare_wakeup, NULL) ||
+        0 != pthread_cond_init(&this->spawned, NULL)) {
         perror("pthread_cond_init");
-        return -1;
+        pthread_condattr_destroy(&cond_attr);
+        goto Error;
     }
 
-    this->size = size;
-    this->workers = (pthread_t *)malloc(this->size * sizeof(pthread_t));
-    if (NULL == this->workers) {
+    this->size = max_size;
+    this->min_size = min_size;
+    this->idle_timeout = idle_timeout;
+    this->overload_policy = OVERLOAD_BLOCK;
+    this->workers = (worker_t *)calloc(this->size, sizeof(worker_t));
+    this->spare_workers = (worker_t *)calloc(MAX_SPARE_WORKERS,
+                                             sizeof(worker_t));
+    this->stats = stats_region_create(this->size + MAX_SPARE_WORKERS);
+
+    if (NULL == this->workers || NULL == this->spare_workers ||
+        NULL == this->stats) {
         perror("malloc");
-        return -1;
+        pthread_condattr_destroy(&cond_attr);
+        goto Error;
     }
 
-    for (int tid = 0; tid < this->size; ++tid) {
-        if (-1 == pthread_create(&this->workers[tid],
-                                                NULL,
-                                                &start_routine,
-                                                this)) {
-            perror("pthread_create");
-            free(this->workers);
-            pthread_mutex_destroy(&this->mutex);
-            pthread_cond_destroy(&this->task_available);
-            pthread_cond_destroy(&this->space_available);
+    // Every slot owns its counters. Worker threads not spawned yet are shown
+    // as exited, spare workers as parked until they are first activated.
+    for (int idx = 0; idx < this->size && 0 == ret; ++idx) {
+        this->workers[idx].pool = this;
+        this->workers[idx].stats = &this->stats->workers[idx];
+        ret = pthread_cond_init(&this->workers[idx].wakeup, &cond_attr);
+        stats_set_state(this->workers[idx].stats, WORKER_EXITED);
+    }
+
+    for (int idx = 0; idx < MAX_SPARE_WORKERS && 0 == ret; ++idx) {
+        this->spare_workers[idx].pool = this;
+        this->spare_workers[idx].stats =
+            &this->stats->workers[this->size + idx];
+        ret = pthread_cond_init(&this->spare_workers[idx].wakeup, &cond_attr);
+        stats_set_state(this->spare_workers[idx].stats, WORKER_PARKED);
+    }
+
+    pthread_condattr_destroy(&cond_attr);
+
+    if (0 != ret) {
+        perror("pthread_cond_init");
+        goto Error;
+    }
+
+    for (int tid = 0; tid < this->min_size; ++tid) {
+        pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+        worker_t *worker = claim_slot(this);
+        pool_mutex_unlock(&this->mutex);
+
+        if (-1 == spawn(this, worker, false)) {
+            // Worker threads already started exit on the empty queue.
+            thread_pool_shutdown(this, SHUTDOWN_DRAIN);
             return -1;
         }
     }
 
+    return 0;
+
+Error:
+    release(this);
+    return -1;
+}
+
+// Insert the task, or handle a full task queue as policy says. With
+// OVERLOAD_BLOCK, wait until abstime at most, or for good if it is NULL.
+static int submit(thread_pool_t *this, task_t *task,
+                  const overload_policy_t policy,
+                  const struct timespec *abstime) {
+    producer_stats_t *stats = &this->stats->producer;
+    task_t oldest = { 0 };
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+    if (is_full(&this->task_queue)) {
+
+        switch (policy) {
+            case OVERLOAD_REJECT:
+                stats_add(&stats->tasks_rejected, 1);
+                pool_mutex_unlock(&this->mutex);
+                errno = EAGAIN;
+                return -1;
+
+            case OVERLOAD_CALLER_RUNS:
+                stats_add(&stats->tasks_caller_run, 1);
+                pool_mutex_unlock(&this->mutex);
+                task->run(task->arguments);
+                return 0;
+
+            case OVERLOAD_DROP_OLDEST:
+                // Handed to drop_handler once the new task is in its place.
+                task_queue_pop(&this->task_queue, &oldest);
+                stats_add(&stats->tasks_dropped, 1);
+                break;
+
+            default: {
+                int ret = 0;
+                unsigned long start = stats_now_ns();
+                stats_add(&stats->producer_blocks, 1);
+
+                do {
+                    if (NULL == abstime) {
+                        pool_cond_wait(&this->space_available, &this->mutex);
+                    } else {
+                        ret = pool_cond_timedwait(&this->space_available,
+                            &this->mutex, abstime);
+                    }
+
+                    if (ETIMEDOUT == ret) {
+                        break;
+                    }
+
+                    stats_add(&stats->wakeups, 1);
+
+                    if (is_full(&this->task_queue)) {
+                        stats_add(&stats->spurious_wakeups, 1);
+                    }
+                } while (is_full(&this->task_queue));
+
+                stats_add(&stats->producer_block_ns, stats_now_ns() - start);
+                trace_end(TRACE_SUBMIT_BLOCK, start, 0);
+
+                if (is_full(&this->task_queue)) {
+                    stats_add(&stats->tasks_timed_out, 1);
+                    pool_mutex_unlock(&this->mutex);
+                    errno = ETIMEDOUT;
+                    return -1;
+                }
+
+                break;
+            }
+        }
+    }
+
+    if (-1 == task_queue_push(&this->task_queue, task)) {
+        fprintf(stderr, "Full queue exception.\n");
+        void (*drop_handler)(task_t *) = this->drop_handler;
+        pool_mutex_unlock(&this->mutex);
+
+        if (NULL != oldest.run) {
+            drop_handler(&oldest);
+        }
+
+        return -1;
+    }
+
+    stats_add(&stats->tasks_submitted, 1);
+    stats_max(&stats->max_queue_depth, size(&this->task_queue));
+
+    // The queue backs up, more tasks are pending than worker threads are
+    // waiting for them.
+    worker_t *slot = NULL;
+
+    if (! this->shutdown && this->alive < this->size &&
+        size(&this->task_queue) > this->idle) {
+        slot = claim_slot(this);
+    }
+
+    worker_t *worker = pick_idle_worker(this);
+    void (*drop_handler)(task_t *) = this->drop_handler;
+
+    pool_mutex_unlock(&this->mutex);
+    wake(worker);
+
+    if (NULL != slot) {
+        spawn(this, slot, true);
+    }
+
+    if (NULL != oldest.run) {
+        drop_handler(&oldest);
+    }
+
     return 0;
 }
 
@@ -96,45 +580,252 @@ int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args) {
     }
 
     task_t task = { .run = run, .arguments = args };
-    pthread_mutex_lock(&this->mutex);
-    
+    return submit(this, &task, this->overload_policy, NULL);
+}
+
+int thread_pool_try_run(thread_pool_t *this, void (*run)(void *), void *args) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    task_t task = { .run = run, .arguments = args };
+    return submit(this, &task, OVERLOAD_REJECT, NULL);
+}
+
+int thread_pool_run_timed(thread_pool_t *this, void (*run)(void *), void *args,
+                          const unsigned int timeout) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    struct timespec abstime;
+    clock_gettime(CLOCK_MONOTONIC, &abstime);
+    abstime.tv_sec += timeout / 1000;
+    abstime.tv_nsec += (timeout % 1000) * 1000000L;
+
+    if (abstime.tv_nsec >= 1000000000L) {
+        abstime.tv_sec += 1;
+        abstime.tv_nsec -= 1000000000L;
+    }
+
+    task_t task = { .run = run, .arguments = args };
+    return submit(this, &task, OVERLOAD_BLOCK, &abstime);
+}
+
+int thread_pool_set_overload_policy(thread_pool_t *this,
+                                    const overload_policy_t policy) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (OVERLOAD_BLOCK > policy || OVERLOAD_DROP_OLDEST < policy) {
+        fprintf(stderr, "Invalid overload policy.\n");
+        return -1;
+    }
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+    // Tasks are never dropped without someone to tell.
+    if (OVERLOAD_DROP_OLDEST == policy && NULL == this->drop_handler) {
+        pool_mutex_unlock(&this->mutex);
+        fprintf(stderr, "No drop handler set.\n");
+        return -1;
+    }
+
+    this->overload_policy = policy;
+    pool_mutex_unlock(&this->mutex);
+
+    return 0;
+}
+
+int thread_pool_set_drop_handler(thread_pool_t *this,
+                                 void (*handler)(task_t *task)) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+    if (NULL == handler && OVERLOAD_DROP_OLDEST == this->overload_policy) {
+        pool_mutex_unlock(&this->mutex);
+        fprintf(stderr, "No drop handler set.\n");
+        return -1;
+    }
+
+    this->drop_handler = handler;
+    pool_mutex_unlock(&this->mutex);
+
+    return 0;
+}
+
+int thread_pool_begin_blocking(thread_pool_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+    this->blocking += 1;
+
+    if (! this->shutdown &&
+        this->spares_active < this->blocking &&
+        this->spares_active < MAX_SPARE_WORKERS) {
+        worker_t *spare = &this->spare_workers[this->spares];
+
+        if (this->spares_active < this->spares) {
+            this->spare_tokens += 1;
+            pthread_cond_signal(&this->spare_wakeup);
+        } else if (0 != pthread_create(&spare->thread,
+                                       &this->worker_attr,
+                                       &spare_routine,
+                                       spare)) {
+            perror("pthread_create");
+            pool_mutex_unlock(&this->mutex);
+            return -1;
+        } else {
+            this->spares += 1;
+        }
+
+        this->spares_active += 1;
+        stats_add(&this->stats->scaler.scale_ups, 1);
+        trace_instant(TRACE_SCALE_UP);
+    }
+
+    pool_mutex_unlock(&this->mutex);
+
+    return 0;
+}
+
+int thread_pool_end_blocking(thread_pool_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    // Spare workers check for retirement themselves, before they take their
+    // next task.
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+    this->blocking -= 1;
+    pool_mutex_unlock(&this->mutex);
+
+    return 0;
+}
+
+int thread_pool_take(thread_pool_t *this, task_t *task) {
+    if (NULL == this || NULL == task) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
     if (is_full(&this->task_queue)) {
-        pthread_cond_wait(&this->space_available, &this->mutex);
+        pthread_cond_signal(&this->space_available);
     }
 
-    if (-1 == task_queue_push(&this->task_queue, &task)) {
-        fprintf(stderr, "Full queue exception.\n");
-        pthread_mutex_unlock(&this->mutex);
+    // A worker thread woken for the task finds the queue empty and waits
+    // again.
+    int ret = task_queue_pop(&this->task_queue, task);
+    pool_mutex_unlock(&this->mutex);
+
+    if (0 == ret) {
+        atomic_fetch_add_explicit(&this->stats->producer.tasks_taken, 1,
+            memory_order_relaxed);
+    }
+
+    return ret;
+}
+
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot) {
+    if (NULL == this || NULL == snapshot) {
+        fprintf(stderr, "Null pointer exception.\n");
         return -1;
     }
 
-    pthread_cond_signal(&this->task_available);
-    pthread_mutex_unlock(&this->mutex);
+    stats_region_snapshot(this->stats, snapshot);
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+    snapshot->queue_depth = size(&this->task_queue);
+    pool_mutex_unlock(&this->mutex);
 
     return 0;
 }
 
-int thread_pool_destroy(thread_pool_t *this) {
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode) {
     if (NULL == this) {
         fprintf(stderr, "Null pointer exception.\n");
         return -1;
     }
 
-    for (int tid = 0; tid < this->size; ++tid) {
-        thread_pool_run(this, exit_routine, NULL);
+    task_t task;
+    long discarded = 0;
+
+    // Parked spare workers return to service, and every idle worker thread is
+    // woken up at once. Each of them exits as soon as it finds the task queue
+    // empty.
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+    this->shutdown = true;
+
+    if (SHUTDOWN_CANCEL == mode) {
+        while (0 == task_queue_pop(&this->task_queue, &task)) {
+            discarded += 1;
+        }
+
+        pthread_cond_broadcast(&this->space_available);
+    }
+
+    worker_t *idle = this->idle_workers;
+
+    for (worker_t *worker = idle; NULL != worker; worker = worker->next) {
+        worker->signaled = true;
+        this->waking += 1;
+    }
+
+    this->idle_workers = NULL;
+    this->idle_bottom = NULL;
+    int spares = this->spares;
+
+    // No slot is claimed from now on, the worker threads being created are
+    // joined below like the others.
+    while (0 != this->spawning) {
+        pool_cond_wait(&this->spawned, &this->mutex);
+    }
+
+    pthread_cond_broadcast(&this->spare_wakeup);
+    pool_mutex_unlock(&this->mutex);
+
+    // A signaled worker thread no longer touches its links.
+    for (worker_t *worker = idle; NULL != worker; worker = worker->next) {
+        wake(worker);
     }
 
     for (int tid = 0; tid < this->size; ++tid) {
-        if (-1 == pthread_join(this->workers[tid], NULL)) {
+        if (this->workers[tid].joinable &&
+            0 != pthread_join(this->workers[tid].thread, NULL)) {
             perror("pthread_join");
             return -1;
         }
     }
 
-    free(this->workers);
-    pthread_mutex_destroy(&this->mutex);
-    pthread_cond_destroy(&this->task_available);
-    pthread_cond_destroy(&this->space_available);
+    for (int tid = 0; tid < spares; ++tid) {
+        if (0 != pthread_join(this->spare_workers[tid].thread, NULL)) {
+            perror("pthread_join");
+            return -1;
+        }
+    }
 
-    return 0;
+    trace_dump();
+    lock_profile_report(this, sizeof(thread_pool_t));
+    release(this);
+
+    return discarded;
+}
+
+int thread_pool_destroy(thread_pool_t *this) {
+    return -1 == thread_pool_shutdown(this, SHUTDOWN_DRAIN) ? -1 : 0;
 }
@@ -1,35 +1,162 @@
 #ifndef THREAD_POOL_H_
 #define THREAD_POOL_H_
 
+#define MANAGED_BLOCKING 1
+#define ELASTIC 1
+#define SEGMENTED_QUEUE 1
+#define WAKE_ORDER 1
+#define TASK_TAKING 1
+#define MAX_SPARE_WORKERS 1024
+
+#include <stdbool.h>
 #include <pthread.h>
+#include "../thread-pool-stats.h"
+#include "../thread-pool-options.h"
 #include "task-queue.h"
 
 
+// Description:
+//      What thread_pool_run() does when the task queue is full.
+//
+// Values:
+//      OVERLOAD_BLOCK:
+//          Wait until a worker thread takes a task. The default.
+//      OVERLOAD_REJECT:
+//          Fail with errno EAGAIN.
+//      OVERLOAD_CALLER_RUNS:
+//          Run the task on the calling thread, which slows the producer down
+//          to the pace of the workers without sleeping in the kernel.
+//      OVERLOAD_DROP_OLDEST:
+//          Take the oldest pending task off the queue to make room, and hand
+//          it to the drop handler set with thread_pool_set_drop_handler().
+typedef enum __OVERLOAD_POLICY_TAG__ {
+    OVERLOAD_BLOCK = 0,
+    OVERLOAD_REJECT,
+    OVERLOAD_CALLER_RUNS,
+    OVERLOAD_DROP_OLDEST,
+
+} overload_policy_t;
+
+
+// Description:
+//      A slot for one worker thread.
+//
+// Attributes:
+//      alive:
+//          A thread runs in the slot. Set when the thread is spawned and
+//          cleared when it retires.
+//      joinable:
+//          A thread was created in the slot and has not been joined yet.
+//      wakeup / signaled:
+//          The worker thread waits on its own condition variable for a task,
+//          until signaled is set by the thread that hands it one.
+//      prev / next:
+//          Neighbours on the idle worker stack, while waiting.
+typedef struct __WORKER_TAG__ {
+    struct __THREAD_POOl_TAG__ *pool;
+    pthread_t thread;
+    worker_stats_t *stats;
+    bool alive;
+    bool joinable;
+    pthread_cond_t wakeup;
+    bool signaled;
+    struct __WORKER_TAG__ *prev;
+    struct __WORKER_TAG__ *next;
+
+} worker_t;
+
+
 // Description:
 //      Thread pool structure.
 //
 // Attributes:
 //      size:
-//          Number of the worker threads.
+//          Maximum number of the worker threads.
+//      min_size:
+//          Number of the worker threads started up front, and kept however
+//          long they are idle.
+//      alive:
+//          Number of the worker threads running, between min_size and size.
+//      idle:
+//          Number of the worker threads waiting for a task. A worker thread is
+//          spawned when more tasks are pending than idle worker threads.
+//      idle_timeout:
+//          Milliseconds after which an idle worker thread beyond min_size
+//          exits, or zero to keep it.
+//      overload_policy:
+//          What thread_pool_run() does when the task queue is full.
+//      drop_handler:
+//          Receives the tasks dropped under OVERLOAD_DROP_OLDEST.
 //      workers:
-//          Dynamically allocate 1-dim pthread array.
+//          Dynamically allocate 1-dim worker slot array.
+//      options / worker_attr:
+//          Memory footprint of the worker threads, and the attributes they
+//          are created with.
 //      space_available:
 //          Block the boss thread until task queue is not full.
-//      task_available:
-//          Block the worker threads until task queue is not empty.
+//      idle_workers / idle_bottom:
+//          Top and bottom of the stack of worker threads waiting for a task. A
+//          new task wakes the most recently idle one, so a small set of worker
+//          threads with warm stacks serves a light load, and the rest stay
+//          asleep and eventually retire.
+//      waking:
+//          Number of worker threads woken up that have not returned from
+//          waiting yet. No more are woken up than tasks are pending.
+//      spawning / spawned:
+//          Number of worker threads being created outside the mutex, and the
+//          condition thread_pool_shutdown() waits on until there are none.
 //      task_queue:
 //          The boss thread inserts task to the queue and the worker threads
-//          gets task from the task queue.
+//          gets task from the task queue. A fixed ring, or a list of segments
+//          if options.segmented_queue is set.
 //      mutex:
 //          The boss thread compete with the worker threads for the right to use
 //          the task queue.
+//      stats:
+//          Per-worker counters, summed up by thread_pool_stats().
+//      shutdown:
+//          Set by thread_pool_shutdown(), no more worker threads are spawned
+//          or activated, none retires, and each exits once it finds the task
+//          queue empty.
+//      blocking:
+//          Number of tasks inside thread_pool_begin_blocking() and
+//          thread_pool_end_blocking().
+//      spares:
+//          Number of spare worker threads created so far, they are kept
+//          parked on spare_wakeup when not needed.
+//      spares_active:
+//          Number of spare worker threads in service. Kept at blocking, up to
+//          MAX_SPARE_WORKERS.
+//      spare_tokens:
+//          Activations not yet picked up by a parked spare worker.
 typedef struct __THREAD_POOl_TAG__ {
     int size;
-    pthread_t *workers;
+    int min_size;
+    int alive;
+    int idle;
+    unsigned int idle_timeout;
+    overload_policy_t overload_policy;
+    void (*drop_handler)(task_t *task);
+    worker_t *workers;
+    thread_pool_options_t options;
+    pthread_attr_t worker_attr;
     pthread_mutex_t mutex;
-    pthread_cond_t task_available;
+    worker_t *idle_workers;
+    worker_t *idle_bottom;
+    int waking;
+    int spawning;
+    pthread_cond_t spawned;
     pthread_cond_t space_available;
     task_queue_t task_queue;
+    stats_region_t *stats;
+
+    bool shutdown;
+    int blocking;
+    int spares;
+    int spares_active;
+    int spare_tokens;
+    worker_t *spare_workers;
+    pthread_cond_t spare_wakeup;
 
 } thread_pool_t;
 
@@ -46,6 +173,39 @@ typedef struct __THREAD_POOl_TAG__ {
 int thread_pool_init(thread_pool_t *this, const int size);
 
 
+// Description:
+//      Initializes the thread pool, with the stack size, guard size and
+//      prefaulting of worker threads and task queue set by options.
+//
+// Example:
+//     thread_pool_options_t options = { .stack_size = 256 * 1024 };
+//     thread_pool_init_ex(&thrpool, 8, &options);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options);
+
+
+// Description:
+//      Initializes a thread pool that starts min_size worker threads, spawns
+//      more on demand up to max_size when tasks back up, and lets worker
+//      threads beyond min_size exit after idle_timeout milliseconds without
+//      a task. options may be NULL. thread_pool_init(this, size) is the same
+//      as thread_pool_init_elastic(this, size, size, 0, NULL).
+//
+// Example:
+//     thread_pool_t thrpool;
+//     thread_pool_init_elastic(&thrpool, 4, 4096, 1000, NULL);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init_elastic(thread_pool_t *this, const int min_size,
+                             const int max_size,
+                             const unsigned int idle_timeout,
+                             const thread_pool_options_t *options);
+
+
 // Description:
 //      The boss thread inserts the task into the task queue. The task waiting
 //      for the worker thread to execute.
@@ -60,12 +220,135 @@ int thread_pool_init(thread_pool_t *this, const int size);
 // Note:
 //      If the boss thread attempts to insert a task to a full task queue, then
 //      function blocks until sufficient data has been got from the task queue
-//      to allow the insert to complete.
+//      to allow the insert to complete, unless another overload policy has
+//      been set with thread_pool_set_overload_policy().
 int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args);
 
 
 // Description:
-//      Join the worker threads and release resources.
+//      Insert the task into the task queue if there is room, without waiting.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred. If the task queue
+//      is full, errno is EAGAIN and the task is counted as rejected.
+int thread_pool_try_run(thread_pool_t *this, void (*run)(void *), void *args);
+
+
+// Description:
+//      Insert the task into the task queue, waiting at most timeout
+//      milliseconds for room.
+//
+// Example:
+//      thread_pool_run_timed(&thrpool, &foo, "Hello World", 10);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred. If the task queue
+//      is still full after timeout, errno is ETIMEDOUT and the task is counted
+//      as timed out.
+int thread_pool_run_timed(thread_pool_t *this, void (*run)(void *), void *args,
+                          const unsigned int timeout);
+
+
+// Description:
+//      Choose what thread_pool_run() does when the task queue is full, see
+//      overload_policy_t. Rejected, caller-run and dropped tasks are counted
+//      in the thread pool stats.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred, e.g. if the policy
+//      is OVERLOAD_DROP_OLDEST and no drop handler has been set.
+int thread_pool_set_overload_policy(thread_pool_t *this,
+                                    const overload_policy_t policy);
+
+
+// Description:
+//      Set the function that receives the tasks dropped under
+//      OVERLOAD_DROP_OLDEST, e.g. to fail or log them. It runs on the thread
+//      whose task took the place of the dropped one, after the pool mutex has
+//      been released, so it may submit to the pool again.
+//
+// Example:
+//      void shed(task_t *task) { reply_busy(task->arguments); }
+//      thread_pool_set_drop_handler(&thrpool, &shed);
+//      thread_pool_set_overload_policy(&thrpool, OVERLOAD_DROP_OLDEST);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_set_drop_handler(thread_pool_t *this,
+                                 void (*handler)(task_t *task));
+
+
+// Description:
+//      Mark the start of a region of the calling task that blocks its worker
+//      thread, e.g. in third-party code. While the region lasts, a spare
+//      worker thread runs the other tasks in its place, so the pool can be
+//      sized for the cores instead of for the worst case of blocked tasks.
+//
+// Example:
+//      thread_pool_begin_blocking(&thrpool);
+//      read(fd, buf, sizeof(buf));
+//      thread_pool_end_blocking(&thrpool);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+//
+// Note:
+//      At most MAX_SPARE_WORKERS spare worker threads are in service at once.
+//      Spare worker threads are created when first needed and kept for
+//      reuse.
+int thread_pool_begin_blocking(thread_pool_t *this);
+
+
+// Description:
+//      Mark the end of a region started with thread_pool_begin_blocking().
+//      The spare worker that stood in retires once it finishes its current
+//      task.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_end_blocking(thread_pool_t *this);
+
+
+// Description:
+//      Take the oldest pending task off the task queue, for a thread outside
+//      the pool to run, e.g. a reserved worker thread of thread-pool-express.h
+//      with nothing else to do. The task counts as completed in the stats.
+//      Must not be called once thread_pool_destroy() has started.
+//
+// Return value:
+//      Return zero if a task was taken, or -1 if the task queue is empty or an
+//      error occurred.
+int thread_pool_take(thread_pool_t *this, task_t *task);
+
+
+// Description:
+//      Take a snapshot of the thread pool counters. Each worker thread keeps
+//      its own counters, they are only summed up here.
+//
+// Example:
+//      thread_pool_stats_t snapshot;
+//      thread_pool_stats(&thrpool, &snapshot);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot);
+
+
+// Description:
+//      Stop the worker threads and release resources. The worker threads are
+//      told by a single change of state and a wakeup of each idle worker
+//      thread, and exit once the task queue is empty: with SHUTDOWN_DRAIN after
+//      running the queued tasks, with SHUTDOWN_CANCEL right after the tasks
+//      they are running, the queued ones being discarded.
+//
+// Return value:
+//      Return the number of tasks discarded, or -1 if an error occurred.
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode);
+
+
+// Description:
+//      Run the queued tasks, join the worker threads and release resources,
+//      thread_pool_shutdown() with SHUTDOWN_DRAIN.
 //
 // Return value:
 //      Return zero on success, or -1 if an error occurred.
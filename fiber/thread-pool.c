@@ -0,0 +1,630 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "thread-pool.h"
+#include "../thread-pool-lock.h"
+#include "../thread-pool-trace.h"
+#include "../thread-pool-options.h"
+
+#define ADMIT_BATCH 64
+
+static __thread scheduler_t *self;
+
+
+/* ************************************************************************** */
+
+
+#if defined(__x86_64__)
+
+// Save the callee-saved registers on the current stack, store the stack
+// pointer in from, and restore the registers saved on the stack of to.
+void context_switch(context_t *from, context_t *to)
+    __asm__("fiber_context_switch");
+
+__asm__(
+    ".text\n"
+    ".type fiber_context_switch, @function\n"
+    "fiber_context_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq (%rsi), %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+);
+
+// Lay out the stack as if context_switch() had been called from entry, so
+// that the first switch to it "returns" into entry with the stack aligned as
+// after a call instruction.
+static void context_init(context_t *this, char *stack, void (*entry)(void)) {
+    void **top = (void **)((uintptr_t)(stack + FIBER_STACK_SIZE) & ~15UL);
+
+    *--top = NULL;
+    *--top = (void *)entry;
+
+    for (int reg = 0; reg < 6; ++reg) {
+        *--top = NULL;
+    }
+
+    this->sp = top;
+}
+
+#else
+
+static void context_switch(context_t *from, context_t *to) {
+    swapcontext(from, to);
+}
+
+static void context_init(context_t *this, char *stack, void (*entry)(void)) {
+    getcontext(this);
+    this->uc_stack.ss_sp = stack;
+    this->uc_stack.ss_size = FIBER_STACK_SIZE;
+    this->uc_link = NULL;
+    makecontext(this, entry, 0);
+}
+
+#endif
+
+
+/* ************************************************************************** */
+
+
+static void ready_push(scheduler_t *this, fiber_t *fiber) {
+    fiber->next = NULL;
+
+    if (NULL == this->ready_tail) {
+        this->ready_head = fiber;
+    } else {
+        this->ready_tail->next = fiber;
+    }
+
+    this->ready_tail = fiber;
+}
+
+static void sleepers_push(scheduler_t *this, fiber_t *fiber) {
+    fiber_t **heap = this->sleepers;
+    int idx = this->sleeping++;
+
+    while (idx > 0) {
+        int parent = (idx - 1) / 2;
+
+        if (heap[parent]->wake_at <= fiber->wake_at) {
+            break;
+        }
+
+        heap[idx] = heap[parent];
+        idx = parent;
+    }
+
+    heap[idx] = fiber;
+}
+
+static fiber_t *sleepers_pop(scheduler_t *this) {
+    fiber_t **heap = this->sleepers;
+    fiber_t *top = heap[0];
+    fiber_t *last = heap[--this->sleeping];
+    int idx = 0;
+
+    while (1) {
+        int child = 2 * idx + 1;
+
+        if (child >= this->sleeping) {
+            break;
+        }
+
+        if (child + 1 < this->sleeping &&
+            heap[child + 1]->wake_at < heap[child]->wake_at) {
+            child += 1;
+        }
+
+        if (last->wake_at <= heap[child]->wake_at) {
+            break;
+        }
+
+        heap[idx] = heap[child];
+        idx = child;
+    }
+
+    heap[idx] = last;
+    return top;
+}
+
+static void fiber_start(void) {
+    fiber_t *fiber = self->current;
+
+    fiber->task.run(fiber->task.arguments);
+    fiber->done = true;
+
+    // Never resumed, the scheduler recycles the fiber.
+    context_switch(&fiber->context, &self->context);
+}
+
+static void spawn(scheduler_t *this, task_t *task) {
+    fiber_t *fiber = this->free_list;
+    this->free_list = fiber->next;
+
+    // Guard pages split the reservation into a mapping each, so a stack gets
+    // its guard when first used. Guarding all of them up front would take
+    // two mappings per fiber and run into vm.max_map_count on a few cores.
+    // Past the limit, the fiber runs unguarded.
+    if (! fiber->guarded) {
+        mprotect(fiber->stack - this->guard_size, this->guard_size, PROT_NONE);
+        fiber->guarded = true;
+    }
+
+    fiber->done = false;
+    fiber->task = *task;
+    context_init(&fiber->context, fiber->stack, &fiber_start);
+
+    this->live += 1;
+    ready_push(this, fiber);
+}
+
+static void resume(scheduler_t *this, fiber_t *fiber) {
+    unsigned long run_start = trace_begin();
+
+    this->current = fiber;
+    context_switch(&this->context, &fiber->context);
+    this->current = NULL;
+
+    trace_end(TRACE_RUN, run_start, 0);
+
+    if (fiber->done) {
+        stats_add(&this->stats->tasks_completed, 1);
+        this->live -= 1;
+        fiber->next = this->free_list;
+        this->free_list = fiber;
+    }
+}
+
+
+/* ************************************************************************** */
+
+
+// Take new tasks from the task queue. If there is nothing to run, wait until
+// a task arrives or the next sleeping fiber is due. Return false when the
+// worker thread should exit.
+static bool admit(scheduler_t *this) {
+    thread_pool_t *pool = this->pool;
+    worker_stats_t *stats = this->stats;
+    task_t tasks[ADMIT_BATCH];
+    int admitted = 0;
+
+    if (FIBERS_PER_WORKER == this->live) {
+        if (NULL == this->ready_head) {
+            unsigned long wake_at = this->sleepers[0]->wake_at;
+            struct timespec abstime = {
+                .tv_sec = wake_at / 1000000000UL,
+                .tv_nsec = wake_at % 1000000000UL,
+            };
+
+            stats_set_state(stats, WORKER_IDLE);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &abstime, NULL);
+        }
+
+        return true;
+    }
+
+    pool_mutex_lock(&pool->mutex, LOCK_MUTEX);
+
+    while (is_empty(&pool->task_queue) && NULL == this->ready_head) {
+        int ret = 0;
+        unsigned long park_start = trace_begin();
+        stats_set_state(stats, WORKER_IDLE);
+
+        if (0 == this->sleeping) {
+            if (pool->shutdown) {
+                pool_mutex_unlock(&pool->mutex);
+                return false;
+            }
+
+            pool_cond_wait(&pool->task_available, &pool->mutex);
+        } else {
+            unsigned long wake_at = this->sleepers[0]->wake_at;
+            struct timespec abstime = {
+                .tv_sec = wake_at / 1000000000UL,
+                .tv_nsec = wake_at % 1000000000UL,
+            };
+
+            if (stats_now_ns() >= wake_at) {
+                break;
+            }
+
+            ret = pool_cond_timedwait(&pool->task_available, &pool->mutex,
+                &abstime);
+        }
+
+        trace_end(TRACE_PARK, park_start, 0);
+
+        if (ETIMEDOUT == ret) {
+            break;
+        }
+
+        stats_add(&stats->wakeups, 1);
+
+        if (is_empty(&pool->task_queue)) {
+            stats_add(&stats->spurious_wakeups, 1);
+        }
+    }
+
+    bool was_full = is_full(&pool->task_queue);
+
+    while (admitted < ADMIT_BATCH &&
+           this->live + admitted < FIBERS_PER_WORKER &&
+           0 == task_queue_pop(&pool->task_queue, &tasks[admitted])) {
+        admitted += 1;
+    }
+
+    if (was_full && 0 != admitted) {
+        pthread_cond_signal(&pool->space_available);
+    }
+
+    // Taking a batch consumes more than the one signal this worker got, pass
+    // the wakeup on while tasks are left.
+    if (! is_empty(&pool->task_queue)) {
+        pthread_cond_signal(&pool->task_available);
+    }
+
+    pool_mutex_unlock(&pool->mutex);
+
+    for (int idx = 0; idx < admitted; ++idx) {
+        trace_instant(TRACE_DEQUEUE);
+        spawn(this, &tasks[idx]);
+    }
+
+    return true;
+}
+
+static void wake_sleepers(scheduler_t *this) {
+    unsigned long now = stats_now_ns();
+
+    while (0 != this->sleeping && this->sleepers[0]->wake_at <= now) {
+        ready_push(this, sleepers_pop(this));
+    }
+}
+
+// Run every fiber that is ready now. Fibers that yield are queued behind
+// them and run in the next round, after new tasks have been admitted.
+static void run_ready(scheduler_t *this) {
+    fiber_t *fiber = this->ready_head;
+    this->ready_head = NULL;
+    this->ready_tail = NULL;
+
+    if (NULL != fiber) {
+        stats_set_state(this->stats, WORKER_RUNNING);
+    }
+
+    while (NULL != fiber) {
+        fiber_t *next = fiber->next;
+        resume(this, fiber);
+        fiber = next;
+    }
+}
+
+static void *start_routine(void *args) {
+    scheduler_t *this = args;
+    worker_stats_t unregistered = { 0 };
+
+    self = this;
+    this->stats = stats_region_register(this->pool->stats, &unregistered);
+    trace_thread_name("worker");
+    pool_stack_prepare(&this->pool->options);
+
+    while (admit(this)) {
+        wake_sleepers(this);
+        run_ready(this);
+    }
+
+    stats_set_state(this->stats, WORKER_EXITED);
+    pthread_exit(NULL);
+}
+
+
+/* ************************************************************************** */
+
+
+static int scheduler_init(scheduler_t *this, thread_pool_t *pool) {
+    this->pool = pool;
+    this->fibers = calloc(FIBERS_PER_WORKER, sizeof(fiber_t));
+    this->sleepers = malloc(FIBERS_PER_WORKER * sizeof(fiber_t *));
+
+    // Stacks are only reserved here, a page is backed when a fiber first
+    // touches it.
+    this->guard_size = sysconf(_SC_PAGESIZE);
+    this->stacks = mmap(NULL, (size_t)FIBERS_PER_WORKER *
+        (this->guard_size + FIBER_STACK_SIZE), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (NULL == this->fibers || NULL == this->sleepers ||
+        MAP_FAILED == this->stacks) {
+        perror("scheduler_init");
+        return -1;
+    }
+
+    for (int idx = FIBERS_PER_WORKER - 1; idx >= 0; --idx) {
+        fiber_t *fiber = &this->fibers[idx];
+        fiber->stack = this->stacks + (size_t)idx *
+            (this->guard_size + FIBER_STACK_SIZE) + this->guard_size;
+        fiber->next = this->free_list;
+        this->free_list = fiber;
+    }
+
+    return 0;
+}
+
+static void scheduler_destroy(scheduler_t *this) {
+    free(this->fibers);
+    free(this->sleepers);
+
+    if (NULL != this->stacks && MAP_FAILED != this->stacks) {
+        munmap(this->stacks, (size_t)FIBERS_PER_WORKER *
+            (this->guard_size + FIBER_STACK_SIZE));
+    }
+}
+
+int thread_pool_init(thread_pool_t *this, const int size) {
+    return thread_pool_init_ex(this, size, NULL);
+}
+
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 >= size) {
+        fprintf(stderr, "Invalid size of thread pool.\n");
+        return -1;
+    }
+
+    this->shutdown = false;
+    this->size = size;
+    this->workers = NULL;
+    this->schedulers = NULL;
+    this->stats = NULL;
+    task_queue_init(&this->task_queue);
+
+    if (NULL != options) {
+        this->options = *options;
+    } else {
+        memset(&this->options, 0, sizeof(thread_pool_options_t));
+    }
+
+    pool_memory_prepare(&this->options, &this->task_queue,
+        sizeof(task_queue_t));
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_TIMED_NP);
+
+    if (0 != pthread_mutex_init(&this->mutex, &attr)) {
+        perror("pthread_mutex_init");
+        return -1;
+    }
+
+    pthread_mutexattr_destroy(&attr);
+
+    // Sleeping fibers are woken by a timed wait against CLOCK_MONOTONIC, the
+    // clock thread_pool_sleep() measures with.
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    if (0 != pthread_cond_init(&this->task_available, &cond_attr) ||
+        0 != pthread_cond_init(&this->space_available, NULL)) {
+        perror("pthread_cond_init");
+        goto Error;
+    }
+
+    pthread_condattr_destroy(&cond_attr);
+
+    this->workers = (pthread_t *)malloc(this->size * sizeof(pthread_t));
+    this->stats = stats_region_create(this->size);
+
+    if (0 != posix_memalign((void **)&this->schedulers, CACHE_LINE_SIZE,
+                            this->size * sizeof(scheduler_t))) {
+        this->schedulers = NULL;
+    }
+
+    if (NULL == this->workers || NULL == this->schedulers ||
+        NULL == this->stats) {
+        perror("malloc");
+        goto Error;
+    }
+
+    memset(this->schedulers, 0, this->size * sizeof(scheduler_t));
+
+    for (int idx = 0; idx < this->size; ++idx) {
+        if (-1 == scheduler_init(&this->schedulers[idx], this)) {
+            goto Error;
+        }
+    }
+
+    pthread_attr_t worker_attr;
+    if (-1 == pool_attr_init(&worker_attr, &this->options)) {
+        goto Error;
+    }
+
+    for (int idx = 0; idx < this->size; ++idx) {
+        if (0 != pthread_create(&this->workers[idx],
+                                            &worker_attr,
+                                            &start_routine,
+                                            &this->schedulers[idx])) {
+            perror("pthread_create");
+            pthread_attr_destroy(&worker_attr);
+            goto Error;
+        }
+    }
+
+    pthread_attr_destroy(&worker_attr);
+
+    return 0;
+
+Error:
+    if (NULL != this->schedulers) {
+        for (int idx = 0; idx < this->size; ++idx) {
+            scheduler_destroy(&this->schedulers[idx]);
+        }
+    }
+
+    free(this->schedulers);
+    free(this->workers);
+    stats_region_destroy(this->stats);
+    pthread_cond_destroy(&this->task_available);
+    pthread_cond_destroy(&this->space_available);
+    pthread_mutex_destroy(&this->mutex);
+
+    return -1;
+}
+
+int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    task_t task = { .run = run, .arguments = args };
+    producer_stats_t *stats = &this->stats->producer;
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+    if (is_full(&this->task_queue)) {
+        unsigned long start = stats_now_ns();
+        stats_add(&stats->producer_blocks, 1);
+
+        do {
+            pool_cond_wait(&this->space_available, &this->mutex);
+            stats_add(&stats->wakeups, 1);
+
+            if (is_full(&this->task_queue)) {
+                stats_add(&stats->spurious_wakeups, 1);
+            }
+        } while (is_full(&this->task_queue));
+
+        stats_add(&stats->producer_block_ns, stats_now_ns() - start);
+        trace_end(TRACE_SUBMIT_BLOCK, start, 0);
+    }
+
+    if (-1 == task_queue_push(&this->task_queue, &task)) {
+        fprintf(stderr, "Full queue exception.\n");
+        pool_mutex_unlock(&this->mutex);
+        return -1;
+    }
+
+    stats_add(&stats->tasks_submitted, 1);
+    stats_max(&stats->max_queue_depth, size(&this->task_queue));
+
+    pthread_cond_signal(&this->task_available);
+    pool_mutex_unlock(&this->mutex);
+
+    return 0;
+}
+
+void thread_pool_sleep(const unsigned int usec) {
+    scheduler_t *this = self;
+
+    if (NULL == this || NULL == this->current) {
+        usleep(usec);
+        return;
+    }
+
+    fiber_t *fiber = this->current;
+    fiber->wake_at = stats_now_ns() + usec * 1000UL;
+    sleepers_push(this, fiber);
+
+    context_switch(&fiber->context, &this->context);
+}
+
+void thread_pool_yield(void) {
+    scheduler_t *this = self;
+
+    if (NULL == this || NULL == this->current) {
+        return;
+    }
+
+    fiber_t *fiber = this->current;
+    ready_push(this, fiber);
+
+    context_switch(&fiber->context, &this->context);
+}
+
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot) {
+    if (NULL == this || NULL == snapshot) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    stats_region_snapshot(this->stats, snapshot);
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+    snapshot->queue_depth = size(&this->task_queue);
+    pool_mutex_unlock(&this->mutex);
+
+    return 0;
+}
+
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    task_t task;
+    long discarded = 0;
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+    this->shutdown = true;
+
+    // Fibers admitted already run to completion, they hold a stack.
+    if (SHUTDOWN_CANCEL == mode) {
+        while (0 == task_queue_pop(&this->task_queue, &task)) {
+            discarded += 1;
+        }
+
+        pthread_cond_broadcast(&this->space_available);
+    }
+
+    pthread_cond_broadcast(&this->task_available);
+    pool_mutex_unlock(&this->mutex);
+
+    for (int idx = 0; idx < this->size; ++idx) {
+        if (0 != pthread_join(this->workers[idx], NULL)) {
+            perror("pthread_join");
+            return -1;
+        }
+    }
+
+    trace_dump();
+    lock_profile_report(this, sizeof(thread_pool_t));
+
+    for (int idx = 0; idx < this->size; ++idx) {
+        scheduler_destroy(&this->schedulers[idx]);
+    }
+
+    free(this->schedulers);
+    free(this->workers);
+    stats_region_destroy(this->stats);
+    pthread_cond_destroy(&this->task_available);
+    pthread_cond_destroy(&this->space_available);
+    pthread_mutex_destroy(&this->mutex);
+
+    return discarded;
+}
+
+int thread_pool_destroy(thread_pool_t *this) {
+    return -1 == thread_pool_shutdown(this, SHUTDOWN_DRAIN) ? -1 : 0;
+}
@@ -0,0 +1,243 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#define FIBER 1
+#define FIBERS_PER_WORKER 4096
+#define FIBER_STACK_SIZE  (64 * 1024)
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "../thread-pool-stats.h"
+#include "../thread-pool-options.h"
+#include "task-queue.h"
+
+
+// Description:
+//      Saved registers of a suspended fiber or scheduler.
+#if defined(__x86_64__)
+typedef struct __CONTEXT_TAG__ {
+    void *sp;
+
+} context_t;
+
+#else
+#include <ucontext.h>
+typedef ucontext_t context_t;
+
+#endif
+
+
+// Description:
+//      A task running on its own user-space stack.
+//
+// Attributes:
+//      next:
+//          Link in the ready list or the free list of its scheduler.
+//      done:
+//          Set when the task has returned.
+//      wake_at:
+//          While sleeping, the CLOCK_MONOTONIC time to resume at, in ns.
+//      stack:
+//          FIBER_STACK_SIZE bytes, reused by the next task.
+//      guarded:
+//          The page below stack has been made inaccessible, so an overflow
+//          faults instead of corrupting the stack of the next fiber down.
+typedef struct __FIBER_TAG__ {
+    struct __FIBER_TAG__ *next;
+    bool done;
+    bool guarded;
+    unsigned long wake_at;
+    task_t task;
+    context_t context;
+    char *stack;
+
+} fiber_t;
+
+
+// Description:
+//      Runs up to FIBERS_PER_WORKER fibers on one worker thread. Only the
+//      owner thread touches its scheduler.
+//
+// Attributes:
+//      context:
+//          Where a fiber returns to when it suspends or finishes.
+//      current:
+//          The running fiber, or NULL while the scheduler itself runs.
+//      ready_head / ready_tail:
+//          Fibers that can run, in FIFO order.
+//      free_list:
+//          Fibers whose task has finished, with their stacks.
+//      sleepers / sleeping:
+//          Min-heap of sleeping fibers ordered by wake_at, and its size.
+//      live:
+//          Number of fibers that have a task, running, ready or sleeping.
+//      stacks / guard_size:
+//          One reservation for the stacks of all fibers, each with a guard
+//          page of guard_size bytes below it.
+typedef struct __SCHEDULER_TAG__ {
+    struct __THREAD_POOl_TAG__ *pool;
+    worker_stats_t *stats;
+
+    context_t context;
+    fiber_t *current;
+    fiber_t *ready_head;
+    fiber_t *ready_tail;
+    fiber_t *free_list;
+    fiber_t **sleepers;
+    int sleeping;
+    int live;
+
+    fiber_t *fibers;
+    char *stacks;
+    size_t guard_size;
+
+} __attribute__((aligned(CACHE_LINE_SIZE))) scheduler_t;
+
+
+// Description:
+//      M:N thread pool. Tasks run as fibers multiplexed over a few worker
+//      threads, so a task that waits with thread_pool_sleep() or
+//      thread_pool_yield() suspends only its fiber, and the worker thread
+//      keeps running other tasks.
+//
+//      A worker takes tasks from the task queue as long as it has fewer than
+//      FIBERS_PER_WORKER live fibers, so one worker per core can keep
+//      thousands of blocking-style tasks in flight.
+//
+// Attributes:
+//      shutdown:
+//          If true, the worker threads exit once the task queue is empty and
+//          all their fibers have finished.
+//      size:
+//          Number of the worker threads.
+//      workers:
+//          Dynamically allocate 1-dim pthread array.
+//      options:
+//          Memory footprint of the worker threads.
+//      schedulers:
+//          One scheduler per worker thread.
+//      space_available:
+//          Block the boss thread until task queue is not full.
+//      task_available:
+//          Block the worker threads until task queue is not empty, or until
+//          their next sleeping fiber is due.
+//      task_queue:
+//          The boss thread inserts task to the queue and the worker threads
+//          gets task from the task queue.
+//      mutex:
+//          The boss thread compete with the worker threads for the right to use
+//          the task queue.
+//      stats:
+//          Per-worker counters, summed up by thread_pool_stats().
+typedef struct __THREAD_POOl_TAG__ {
+    bool shutdown;
+    int size;
+    pthread_t *workers;
+    thread_pool_options_t options;
+    scheduler_t *schedulers;
+    pthread_mutex_t mutex;
+    pthread_cond_t task_available;
+    pthread_cond_t space_available;
+    task_queue_t task_queue;
+    stats_region_t *stats;
+
+} thread_pool_t;
+
+
+// Description:
+//      Initializes the thread pool with the specified values.
+//
+// Example:
+//     thread_pool_t thrpool;
+//     thread_pool_init(&thrpool, 8);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init(thread_pool_t *this, const int size);
+
+
+// Description:
+//      Initializes the thread pool, with the stack size, guard size and
+//      prefaulting of worker threads and task queue set by options.
+//
+// Example:
+//     thread_pool_options_t options = { .stack_size = 256 * 1024 };
+//     thread_pool_init_ex(&thrpool, 8, &options);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options);
+
+
+// Description:
+//      The boss thread inserts the task into the task queue. The task waiting
+//      for the worker thread to execute.
+//
+// Example:
+//      void foo(void *str) { ... }
+//      thread_pool_run(&thrpool, &foo, "Hello World");
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+//
+// Note:
+//      If the boss thread attempts to insert a task to a full task queue, then
+//      function blocks until sufficient data has been got from the task queue
+//      to allow the insert to complete.
+int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args);
+
+
+// Description:
+//      Suspend the calling fiber for at least usec microseconds. The worker
+//      thread runs other fibers in the meantime.
+//
+// Example:
+//      void foo(void *args) { thread_pool_sleep(1000); }
+//
+// Note:
+//      Outside of a fiber, this falls back to usleep().
+void thread_pool_sleep(const unsigned int usec);
+
+
+// Description:
+//      Let the other ready fibers of the worker thread run before the calling
+//      fiber continues. Does nothing outside of a fiber.
+void thread_pool_yield(void);
+
+
+// Description:
+//      Take a snapshot of the thread pool counters. Each worker thread keeps
+//      its own counters, they are only summed up here.
+//
+// Example:
+//      thread_pool_stats_t snapshot;
+//      thread_pool_stats(&thrpool, &snapshot);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot);
+
+
+// Description:
+//      Stop the worker threads and release resources. The worker threads are
+//      told by a single change of state and a broadcast, and exit once the task
+//      queue is empty: with SHUTDOWN_DRAIN after running the queued tasks, with
+//      SHUTDOWN_CANCEL right after the fibers they are running, the queued ones
+//      being discarded.
+//
+// Return value:
+//      Return the number of tasks discarded, or -1 if an error occurred.
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode);
+
+
+// Description:
+//      Run the queued tasks, join the worker threads and release resources,
+//      thread_pool_shutdown() with SHUTDOWN_DRAIN.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_destroy(thread_pool_t *this);
+
+
+#endif /* THREAD_POOL_H_ */
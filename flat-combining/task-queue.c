@@ -0,0 +1,201 @@
+#include <sched.h>
+
+#include "task-queue.h"
+
+#define FC_FREE    0
+#define FC_CLAIMED 1
+#define FC_PUSH    2
+#define FC_POP     3
+#define FC_DONE    4
+
+static _Atomic unsigned int next_hint = 0;
+static __thread unsigned int hint = 0;
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static int ring_pop(task_queue_t *this, task_t *task_ptr) {
+    int front = atomic_load_explicit(&this->front, memory_order_relaxed);
+
+    if (atomic_load_explicit(&this->rear, memory_order_relaxed) == front) {
+        return -1;
+    }
+
+    *task_ptr = this->queue[front];
+    atomic_store_explicit(&this->front, (front + 1) % (RING_QUEUE_CAPACITY + 1),
+        memory_order_relaxed);
+
+    return 0;
+}
+
+static int ring_push(task_queue_t *this, task_t *task_ptr) {
+    int front = atomic_load_explicit(&this->front, memory_order_relaxed);
+    int rear = atomic_load_explicit(&this->rear, memory_order_relaxed);
+    int next = (rear + 1) % (RING_QUEUE_CAPACITY + 1);
+
+    if (front == next) {
+        return -1;
+    }
+
+    this->queue[rear] = *task_ptr;
+    atomic_store_explicit(&this->rear, next, memory_order_relaxed);
+
+    return (front <= rear)
+        ? rear - front
+        : (RING_QUEUE_CAPACITY + 1) - (front - rear);
+}
+
+static int ring_apply(task_queue_t *this, const int op, task_t *task_ptr) {
+    return (FC_PUSH == op) ? ring_push(this, task_ptr)
+                           : ring_pop(this, task_ptr);
+}
+
+static bool try_combine(task_queue_t *this) {
+    return ! atomic_load_explicit(&this->combining, memory_order_relaxed) &&
+           ! atomic_exchange_explicit(&this->combining, true,
+                 memory_order_acquire);
+}
+
+// Apply every published request, then let go of the combiner.
+static void combine(task_queue_t *this) {
+    uint64_t pending = 0;
+
+    if (0 != atomic_load_explicit(&this->published, memory_order_relaxed)) {
+        pending = atomic_exchange_explicit(&this->published, 0,
+            memory_order_acquire);
+    }
+
+    while (0 != pending) {
+        fc_slot_t *slot = &this->slots[__builtin_ctzll(pending)];
+        int op = atomic_load_explicit(&slot->state, memory_order_relaxed);
+
+        slot->result = ring_apply(this, op, &slot->task);
+        atomic_store_explicit(&slot->state, FC_DONE, memory_order_release);
+        pending &= pending - 1;
+    }
+
+    atomic_store_explicit(&this->combining, false, memory_order_release);
+}
+
+static int claim(task_queue_t *this) {
+    if (0 == hint) {
+        hint = atomic_fetch_add_explicit(&next_hint, 1,
+            memory_order_relaxed) + 1;
+    }
+
+    for (int idx = 0; idx < FC_SLOTS; ++idx) {
+        int slot = (hint + idx) % FC_SLOTS;
+        int state = FC_FREE;
+
+        if (FC_FREE == atomic_load_explicit(&this->slots[slot].state,
+                                            memory_order_relaxed) &&
+            atomic_compare_exchange_strong_explicit(&this->slots[slot].state,
+                &state, FC_CLAIMED, memory_order_acquire,
+                memory_order_relaxed)) {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+static int operate(task_queue_t *this, const int op, task_t *task_ptr) {
+    if (try_combine(this)) {
+        int ret = ring_apply(this, op, task_ptr);
+        combine(this);
+        return ret;
+    }
+
+    int idx = claim(this);
+
+    if (-1 == idx) {
+        // Every slot is taken, wait for the combiner instead.
+        for (int spin = 0; ! try_combine(this); ++spin) {
+            if (spin < FC_SPIN) {
+                cpu_relax();
+            } else {
+                sched_yield();
+            }
+        }
+
+        int ret = ring_apply(this, op, task_ptr);
+        combine(this);
+        return ret;
+    }
+
+    fc_slot_t *slot = &this->slots[idx];
+
+    if (FC_PUSH == op) {
+        slot->task = *task_ptr;
+    }
+
+    atomic_store_explicit(&slot->state, op, memory_order_relaxed);
+    atomic_fetch_or_explicit(&this->published, (uint64_t)1 << idx,
+        memory_order_release);
+
+    for (int spin = 0; FC_DONE != atomic_load_explicit(&slot->state,
+                                                       memory_order_acquire);
+         ++spin) {
+        if (try_combine(this)) {
+            combine(this);
+        } else if (spin < FC_SPIN) {
+            cpu_relax();
+        } else {
+            // The combiner may have been preempted, let it run.
+            sched_yield();
+        }
+    }
+
+    int ret = slot->result;
+
+    if (FC_POP == op && -1 != ret) {
+        *task_ptr = slot->task;
+    }
+
+    atomic_store_explicit(&slot->state, FC_FREE, memory_order_release);
+
+    return ret;
+}
+
+
+/* ************************************************************************** */
+
+
+int size(task_queue_t *this) {
+    int front = atomic_load_explicit(&this->front, memory_order_relaxed);
+    int rear = atomic_load_explicit(&this->rear, memory_order_relaxed);
+
+    return (front <= rear)
+        ? rear - front
+        : (RING_QUEUE_CAPACITY + 1) - (front - rear);
+}
+
+bool is_full(task_queue_t *this) {
+    return RING_QUEUE_CAPACITY == size(this);
+}
+
+bool is_empty(task_queue_t *this) {
+    return 0 == size(this);
+}
+
+void task_queue_init(task_queue_t *this) {
+    atomic_init(&this->combining, false);
+    atomic_init(&this->published, 0);
+    atomic_init(&this->front, 0);
+    atomic_init(&this->rear, 0);
+
+    for (int idx = 0; idx < FC_SLOTS; ++idx) {
+        atomic_init(&this->slots[idx].state, FC_FREE);
+    }
+}
+
+int task_queue_pop(task_queue_t *this, task_t *task_ptr) {
+    return operate(this, FC_POP, task_ptr);
+}
+
+int task_queue_push(task_queue_t *this, task_t *task_ptr) {
+    return operate(this, FC_PUSH, task_ptr);
+}
@@ -0,0 +1,88 @@
+#ifndef TASK_QUEUE_H_
+#define TASK_QUEUE_H_
+
+#define RING_QUEUE_CAPACITY 4096
+#define FC_SLOTS            64    // One bit of published each
+#define FC_SPIN             64
+
+// Push and pop synchronize by themselves, see queue-bench.c.
+#define TASK_QUEUE_THREAD_SAFE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+typedef struct __TASK_TAG__ {
+    void (*run)(void *);
+    void *arguments;
+
+} task_t;
+
+
+// Description:
+//      A request published by a thread that did not get to combine itself.
+//
+// Attributes:
+//      state:
+//          FC_FREE, FC_CLAIMED while the owner fills it in, FC_PUSH or FC_POP
+//          once published, FC_DONE once a combiner applied it.
+//      task:
+//          The task to push, or the task popped.
+//      result:
+//          What task_queue_push() or task_queue_pop() returns.
+typedef struct __FC_SLOT_TAG__ {
+    _Atomic int state;
+    task_t task;
+    int result;
+
+} __attribute__((aligned(64))) fc_slot_t;
+
+
+// Description:
+//      A ring of tasks behind a flat combiner. A thread that finds the queue
+//      busy publishes its push or pop in one of the slots instead of queuing
+//      on a lock, and whichever thread holds the combiner applies all of the
+//      published requests in one pass. The ring is only ever touched by the
+//      combiner, so it stays in the cache of one core under contention.
+//
+// Attributes:
+//      combining:
+//          Held by the combiner.
+//      published:
+//          A bit per slot with a request in it, so the combiner only looks at
+//          those.
+//      front / rear / queue:
+//          The ring, written by the combiner only.
+//      slots:
+//          Requests waiting for a combiner. A thread starts looking for a free
+//          one at a slot of its own, so it usually reuses the same one.
+typedef struct __TASK_QUEUE_TAG__ {
+    _Atomic bool combining __attribute__((aligned(64)));
+    _Atomic uint64_t published;
+
+    _Atomic int front __attribute__((aligned(64)));
+    _Atomic int rear;
+    task_t queue[RING_QUEUE_CAPACITY + 1];
+
+    fc_slot_t slots[FC_SLOTS];
+
+} task_queue_t;
+
+// The size, fullness and emptiness of the queue as of some point during the
+// call, as other threads may push and pop meanwhile.
+int size(task_queue_t *this);
+
+bool is_full(task_queue_t *this);
+
+bool is_empty(task_queue_t *this);
+
+void task_queue_init(task_queue_t *this);
+
+// Return -1 if the queue is empty, may be called by any thread.
+int task_queue_pop(task_queue_t *this, task_t *task_ptr);
+
+// Return -1 if the queue is full, otherwise the number of tasks that were
+// ahead of the new one, may be called by any thread.
+int task_queue_push(task_queue_t *this, task_t *task_ptr);
+
+#endif /* TASK_QUEUE_H_ */
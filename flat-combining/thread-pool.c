@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread-pool.h"
+#include "../thread-pool-lock.h"
+#include "../thread-pool-trace.h"
+#include "../thread-pool-options.h"
+
+// A sleeper announces itself in idle_workers or blocked_producers before it
+// checks the task queue a last time, and the other side checks the counter
+// after it changed the task queue. The fences make sure at least one of them
+// sees the other, so no wakeup is lost.
+//
+// The mutex is only taken to wake a sleeper no one is waking yet, and no more
+// are woken than there are tasks, or free slots, for them. A woken thread
+// passes the wakeup on once it is back, see pop() and push().
+static void notify(thread_pool_t *this, _Atomic int *sleepers,
+                   _Atomic int *waking, pthread_cond_t *cond,
+                   const int work) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    int pending = atomic_load_explicit(waking, memory_order_relaxed);
+
+    do {
+        if (pending >= atomic_load_explicit(sleepers, memory_order_relaxed) ||
+            pending >= work) {
+            return;
+        }
+    } while (! atomic_compare_exchange_weak_explicit(waking, &pending,
+                 pending + 1, memory_order_relaxed, memory_order_relaxed));
+
+    // Under the mutex, the sleepers are waiting or woken and not back yet.
+    // The one counted may have found work without waiting after all.
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+
+    if (atomic_load(sleepers) >= atomic_load(waking)) {
+        pthread_cond_signal(cond);
+    } else {
+        atomic_fetch_sub(waking, 1);
+    }
+
+    pool_mutex_unlock(&this->mutex);
+}
+
+static int free_slots(thread_pool_t *this) {
+    return RING_QUEUE_CAPACITY - size(&this->task_queue);
+}
+
+// The calling thread returned from waiting, which may have been its wakeup.
+// Called with the mutex locked.
+static void woken(_Atomic int *waking) {
+    if (0 < atomic_load(waking)) {
+        atomic_fetch_sub(waking, 1);
+    }
+}
+
+// Producers insert without holding a lock, so the producer counters are
+// updated atomically, apart from those updated under mutex.
+static void push(thread_pool_t *this, task_t *task) {
+    producer_stats_t *stats = &this->stats->producer;
+
+    int ahead = task_queue_push(&this->task_queue, task);
+
+    if (-1 == ahead) {
+        unsigned long start = stats_now_ns();
+        atomic_fetch_add_explicit(&stats->producer_blocks, 1,
+            memory_order_relaxed);
+
+        pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+        atomic_fetch_add(&this->blocked_producers, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        while (-1 == (ahead = task_queue_push(&this->task_queue, task))) {
+            pool_cond_wait(&this->space_available, &this->mutex);
+            woken(&this->waking_producers);
+            stats_add(&stats->wakeups, 1);
+
+            if (is_full(&this->task_queue)) {
+                stats_add(&stats->spurious_wakeups, 1);
+            }
+        }
+
+        atomic_fetch_sub(&this->blocked_producers, 1);
+        pool_mutex_unlock(&this->mutex);
+
+        atomic_fetch_add_explicit(&stats->producer_block_ns,
+            stats_now_ns() - start, memory_order_relaxed);
+        trace_end(TRACE_SUBMIT_BLOCK, start, 0);
+
+        // Pass the wakeup on to the next blocked producer, while there is
+        // room.
+        if (! is_full(&this->task_queue)) {
+            notify(this, &this->blocked_producers, &this->waking_producers,
+                &this->space_available, free_slots(this));
+        }
+    }
+
+    // A worker thread woken for an earlier task passes the wakeup on, see
+    // pop().
+    if (0 == ahead) {
+        notify(this, &this->idle_workers, &this->waking_workers,
+            &this->task_available, size(&this->task_queue));
+    }
+
+}
+
+// Return false once the pool shuts down and the task queue is empty.
+static bool pop(thread_pool_t *this, task_t *task, worker_stats_t *stats) {
+    if (-1 == task_queue_pop(&this->task_queue, task)) {
+        pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+        atomic_fetch_add(&this->idle_workers, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        while (-1 == task_queue_pop(&this->task_queue, task)) {
+            // thread_pool_shutdown() broadcasts under the mutex after setting
+            // shutdown, so it is seen here or wakes the wait below.
+            if (atomic_load(&this->shutdown)) {
+                atomic_fetch_sub(&this->idle_workers, 1);
+                pool_mutex_unlock(&this->mutex);
+                return false;
+            }
+
+            unsigned long park_start = trace_begin();
+            pool_cond_wait(&this->task_available, &this->mutex);
+            woken(&this->waking_workers);
+            trace_end(TRACE_PARK, park_start, 0);
+            stats_add(&stats->wakeups, 1);
+
+            if (is_empty(&this->task_queue)) {
+                stats_add(&stats->spurious_wakeups, 1);
+            }
+        }
+
+        atomic_fetch_sub(&this->idle_workers, 1);
+        pool_mutex_unlock(&this->mutex);
+    }
+
+    notify(this, &this->blocked_producers, &this->waking_producers,
+        &this->space_available, free_slots(this));
+
+    if (! is_empty(&this->task_queue)) {
+        notify(this, &this->idle_workers, &this->waking_workers,
+            &this->task_available, size(&this->task_queue));
+    }
+
+    return true;
+}
+
+static void *start_routine(void *args) {
+    task_t task = { 0 };
+    thread_pool_t *this = args;
+    worker_stats_t unregistered = { 0 };
+    worker_stats_t *stats = stats_region_register(this->stats, &unregistered);
+
+    trace_thread_name("worker");
+    pool_stack_prepare(&this->options);
+
+    while (pop(this, &task, stats)) {
+        trace_instant(TRACE_DEQUEUE);
+
+        stats_set_state(stats, WORKER_RUNNING);
+        unsigned long run_start = trace_begin();
+        task.run(task.arguments);
+        trace_end(TRACE_RUN, run_start, 0);
+        stats_add(&stats->tasks_completed, 1);
+        stats_set_state(stats, WORKER_IDLE);
+    }
+
+    stats_set_state(stats, WORKER_EXITED);
+    pthread_exit(NULL);
+}
+
+int thread_pool_init(thread_pool_t *this, const int size) {
+    return thread_pool_init_ex(this, size, NULL);
+}
+
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 >= size) {
+        fprintf(stderr, "Invalid size of thread pool.\n");
+        return -1;
+    }
+
+    // Initialize all integer/boolean attributes to zero/false.
+    memset(this, 0, sizeof(thread_pool_t));
+    task_queue_init(&this->task_queue);
+
+    if (NULL != options) {
+        this->options = *options;
+    }
+
+    pool_memory_prepare(&this->options, &this->task_queue,
+        sizeof(task_queue_t));
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_TIMED_NP);
+
+    if (-1 == pthread_mutex_init(&this->mutex, &attr)) {
+        perror("pthread_mutex_init");
+        goto Error;
+    }
+
+    pthread_mutexattr_destroy(&attr);
+
+    if (-1 == pthread_cond_init(&this->task_available, NULL) ||
+        -1 == pthread_cond_init(&this->space_available, NULL)) {
+        perror("pthread_cond_init");
+        goto Error;
+    }
+
+    this->size = size;
+    this->workers = (pthread_t *)malloc(this->size * sizeof(pthread_t));
+    if (NULL == this->workers) {
+        perror("malloc");
+        goto Error;
+    }
+
+    this->stats = stats_region_create(this->size);
+    if (NULL == this->stats) {
+        goto Error;
+    }
+
+    pthread_attr_t worker_attr;
+    if (-1 == pool_attr_init(&worker_attr, &this->options)) {
+        goto Error;
+    }
+
+    for (int tid = 0; tid < this->size; ++tid) {
+        if (-1 == pthread_create(&this->workers[tid],
+                                                &worker_attr,
+                                                &start_routine,
+                                                this)) {
+            perror("pthread_create");
+            pthread_attr_destroy(&worker_attr);
+            goto Error;
+        }
+    }
+
+    pthread_attr_destroy(&worker_attr);
+
+    return 0;
+
+Error:
+    free(this->workers);
+    stats_region_destroy(this->stats);
+    pthread_cond_destroy(&this->task_available);
+    pthread_cond_destroy(&this->space_available);
+    pthread_mutex_destroy(&this->mutex);
+
+    return -1;
+}
+
+int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    task_t task = { .run = run, .arguments = args };
+    producer_stats_t *stats = &this->stats->producer;
+
+    push(this, &task);
+
+    atomic_fetch_add_explicit(&stats->tasks_submitted, 1,
+        memory_order_relaxed);
+
+    unsigned long depth = size(&this->task_queue);
+    unsigned long max = atomic_load_explicit(&stats->max_queue_depth,
+        memory_order_relaxed);
+
+    while (depth > max &&
+           ! atomic_compare_exchange_weak_explicit(&stats->max_queue_depth,
+               &max, depth, memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    return 0;
+}
+
+int thread_pool_take(thread_pool_t *this, task_t *task) {
+    if (NULL == this || NULL == task) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (-1 == task_queue_pop(&this->task_queue, task)) {
+        return -1;
+    }
+
+    notify(this, &this->blocked_producers, &this->waking_producers,
+        &this->space_available, free_slots(this));
+    atomic_fetch_add_explicit(&this->stats->producer.tasks_taken, 1,
+        memory_order_relaxed);
+
+    return 0;
+}
+
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot) {
+    if (NULL == this || NULL == snapshot) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    stats_region_snapshot(this->stats, snapshot);
+    snapshot->queue_depth = size(&this->task_queue);
+
+    return 0;
+}
+
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    task_t task;
+    long discarded = 0;
+
+    atomic_store(&this->shutdown, true);
+
+    if (SHUTDOWN_CANCEL == mode) {
+        while (0 == task_queue_pop(&this->task_queue, &task)) {
+            discarded += 1;
+        }
+    }
+
+    pool_mutex_lock(&this->mutex, LOCK_MUTEX);
+    pthread_cond_broadcast(&this->task_available);
+    pthread_cond_broadcast(&this->space_available);
+    pool_mutex_unlock(&this->mutex);
+
+    for (int tid = 0; tid < this->size; ++tid) {
+        if (-1 == pthread_join(this->workers[tid], NULL)) {
+            perror("pthread_join");
+            return -1;
+        }
+    }
+
+    trace_dump();
+    lock_profile_report(this, sizeof(thread_pool_t));
+
+    free(this->workers);
+    stats_region_destroy(this->stats);
+    pthread_cond_destroy(&this->task_available);
+    pthread_cond_destroy(&this->space_available);
+    pthread_mutex_destroy(&this->mutex);
+
+    return discarded;
+}
+
+int thread_pool_destroy(thread_pool_t *this) {
+    return -1 == thread_pool_shutdown(this, SHUTDOWN_DRAIN) ? -1 : 0;
+}
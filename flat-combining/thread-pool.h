@@ -0,0 +1,163 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#define TASK_TAKING 1
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "../thread-pool-stats.h"
+#include "../thread-pool-options.h"
+#include "task-queue.h"
+
+
+// Description:
+//      The boss thread and the worker threads push and pop tasks without a
+//      lock, through a flat-combining task queue: under contention one thread
+//      applies the requests of all the others in one pass.
+//
+//      The mutex is only taken by a worker thread that found the task queue
+//      empty and goes to sleep, by a boss thread that found it full, and by
+//      whoever has to wake either of them.
+//
+// Attributes:
+//      shutdown:
+//          Set by thread_pool_shutdown(). Each worker thread exits once it
+//          finds the task queue empty.
+//      size:
+//          Number of the worker threads.
+//      workers:
+//          Dynamically allocate 1-dim pthread array.
+//      options:
+//          Memory footprint of the worker threads.
+//      idle_workers:
+//          Worker threads that are about to wait, or wait, on task_available.
+//      blocked_producers:
+//          Threads that are about to wait, or wait, on space_available.
+//      waking_workers / waking_producers:
+//          Of those, the ones signaled that have not returned from waiting
+//          yet. No one else is woken while they cover the sleepers, the
+//          woken thread passes the wakeup on if there is more to do.
+//      mutex:
+//          Guards the waits on task_available and space_available.
+//      task_available:
+//          Block a worker thread until task queue is not empty.
+//      space_available:
+//          Block the boss thread until task queue is not full.
+//      task_queue:
+//          The boss thread inserts task to the queue and the worker threads
+//          gets task from the task queue.
+//      stats:
+//          Per-worker counters, summed up by thread_pool_stats().
+typedef struct __THREAD_POOl_TAG__ {
+    _Atomic bool shutdown;
+    int size;
+    pthread_t *workers;
+    thread_pool_options_t options;
+
+    _Atomic int idle_workers;
+    _Atomic int blocked_producers;
+    _Atomic int waking_workers;
+    _Atomic int waking_producers;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t task_available;
+    pthread_cond_t space_available;
+
+    task_queue_t task_queue;
+    stats_region_t *stats;
+
+} thread_pool_t;
+
+
+// Description:
+//      Initializes the thread pool with the specified values.
+//
+// Example:
+//     thread_pool_t thrpool;
+//     thread_pool_init(&thrpool, 8);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init(thread_pool_t *this, const int size);
+
+
+// Description:
+//      Initializes the thread pool, with the stack size, guard size and
+//      prefaulting of worker threads and task queue set by options.
+//
+// Example:
+//     thread_pool_options_t options = { .stack_size = 256 * 1024 };
+//     thread_pool_init_ex(&thrpool, 8, &options);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options);
+
+
+// Description:
+//      The boss thread inserts the task into the task queue. The task waiting
+//      for the worker thread to execute.
+//
+// Example:
+//      void foo(void *str) { ... }
+//      thread_pool_run(&thrpool, &foo, "Hello World");
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+//
+// Note:
+//      If the boss thread attempts to insert a task to a full task queue, then
+//      function blocks until sufficient data has been got from the task queue
+//      to allow the insert to complete.
+int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args);
+
+
+// Description:
+//      Take the oldest pending task off the task queue, for a thread outside
+//      the pool to run, e.g. a reserved worker thread of thread-pool-express.h
+//      with nothing else to do. The task counts as completed in the stats.
+//      Must not be called once thread_pool_destroy() has started.
+//
+// Return value:
+//      Return zero if a task was taken, or -1 if the task queue is empty or an
+//      error occurred.
+int thread_pool_take(thread_pool_t *this, task_t *task);
+
+
+// Description:
+//      Take a snapshot of the thread pool counters. Each worker thread keeps
+//      its own counters, they are only summed up here.
+//
+// Example:
+//      thread_pool_stats_t snapshot;
+//      thread_pool_stats(&thrpool, &snapshot);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot);
+
+
+// Description:
+//      Stop the worker threads and release resources. The worker threads are
+//      told by a single change of state and a broadcast, and exit once the task
+//      queue is empty: with SHUTDOWN_DRAIN after running the queued tasks, with
+//      SHUTDOWN_CANCEL right after the tasks they are running, the queued ones
+//      being discarded.
+//
+// Return value:
+//      Return the number of tasks discarded, or -1 if an error occurred.
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode);
+
+
+// Description:
+//      Run the queued tasks, join the worker threads and release resources,
+//      thread_pool_shutdown() with SHUTDOWN_DRAIN.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_destroy(thread_pool_t *this);
+
+
+#endif /* THREAD_POOL_H_ */
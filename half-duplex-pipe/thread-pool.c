@@ -1,22 +1,32 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 #include <unistd.h>
+#include <sys/ioctl.h>
 
 #include "thread-pool.h"
+#include "../thread-pool-lock.h"
+#include "../thread-pool-trace.h"
+#include "../thread-pool-options.h"
 
 // worker thread starts from here.
 static void *start_routine(void *args) {
     int nbytes = 0;
     task_t task = { 0 };
     thread_pool_t *this = args;
+    worker_stats_t unregistered = { 0 };
+    worker_stats_t *stats = stats_region_register(this->stats, &unregistered);
+
+    trace_thread_name("worker");
+    pool_stack_prepare(&this->options);
 
     while (1) {
-        pthread_mutex_lock(&this->mutex);
+        pool_mutex_lock(&this->mutex, LOCK_MUTEX);
 
         if (this->shutdown) {
-            pthread_mutex_unlock(&this->mutex);
+            pool_mutex_unlock(&this->mutex);
             break;
         }
         
@@ -27,20 +37,39 @@ static void *start_routine(void *args) {
 
         if (0 == nbytes) {
             this->shutdown = true;
-            pthread_mutex_unlock(&this->mutex);
+            pool_mutex_unlock(&this->mutex);
             break;
         } else if (-1 == nbytes) {
             perror("read");
         }
 
-        pthread_mutex_unlock(&this->mutex);
+        if (atomic_load_explicit(&this->cancel, memory_order_relaxed)) {
+            this->discarded += 1;
+            pool_mutex_unlock(&this->mutex);
+            continue;
+        }
+
+        pool_mutex_unlock(&this->mutex);
+        trace_instant(TRACE_DEQUEUE);
+
+        stats_set_state(stats, WORKER_RUNNING);
+        unsigned long run_start = trace_begin();
         task.run(task.arguments);
+        trace_end(TRACE_RUN, run_start, 0);
+        stats_add(&stats->tasks_completed, 1);
+        stats_set_state(stats, WORKER_IDLE);
     }
 
+    stats_set_state(stats, WORKER_EXITED);
     pthread_exit(NULL);
 }
 
 int thread_pool_init(thread_pool_t *this, const int size) {
+    return thread_pool_init_ex(this, size, NULL);
+}
+
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options) {
     if (0 >= size) {
         fprintf(stderr, "Invalid size of thread pool.\n");
         return -1;
@@ -52,6 +81,15 @@ int thread_pool_init(thread_pool_t *this, const int size) {
     }
 
     this->shutdown = false;
+    this->discarded = 0;
+    atomic_init(&this->cancel, false);
+
+    if (NULL != options) {
+        this->options = *options;
+    } else {
+        memset(&this->options, 0, sizeof(thread_pool_options_t));
+    }
+
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_TIMED_NP);
@@ -71,14 +109,30 @@ int thread_pool_init(thread_pool_t *this, const int size) {
 
     this->size = size;
     this->workers = (pthread_t *)malloc(this->size * sizeof(pthread_t));
+    this->stats = stats_region_create(this->size);
+
+    pthread_attr_t worker_attr;
+
+    if (NULL == this->workers || NULL == this->stats ||
+        -1 == pool_attr_init(&worker_attr, &this->options)) {
+        perror("malloc");
+        free(this->workers);
+        stats_region_destroy(this->stats);
+        close(this->pipefd[0]);
+        close(this->pipefd[1]);
+        pthread_mutex_destroy(&this->mutex);
+        return -1;
+    }
 
     for (int idx = 0; idx < this->size; ++idx) {
         if (-1 == pthread_create(&this->workers[idx],
-                                                NULL,
+                                                &worker_attr,
                                                 &start_routine,
                                                 this)) {
             perror("pthread_create");
+            pthread_attr_destroy(&worker_attr);
             free(this->workers);
+            stats_region_destroy(this->stats);
             close(this->pipefd[0]);
             close(this->pipefd[1]);
             pthread_mutex_destroy(&this->mutex);
@@ -86,6 +140,8 @@ int thread_pool_init(thread_pool_t *this, const int size) {
         }
     }
 
+    pthread_attr_destroy(&worker_attr);
+
     return 0;
 }
 
@@ -97,10 +153,48 @@ int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args) {
         return -1;
     }
 
+    // Several threads may write to the pipe without holding any lock, so the
+    // counter cannot use the single-writer stats_add().
+    atomic_fetch_add_explicit(&this->stats->producer.tasks_submitted,
+        1, memory_order_relaxed);
+
     return 0;
 }
 
-int thread_pool_destroy(thread_pool_t *this) {
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot) {
+    if (NULL == this || NULL == snapshot) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    stats_region_snapshot(this->stats, snapshot);
+
+    // The pipe is the task queue, so the queue depth is the number of unread
+    // bytes. The maximum depth is not tracked, since it would take an extra
+    // system call per task.
+    int nbytes = 0;
+    if (-1 == ioctl(this->pipefd[0], FIONREAD, &nbytes)) {
+        perror("ioctl");
+        return -1;
+    }
+
+    snapshot->queue_depth = nbytes / sizeof(task_t);
+
+    return 0;
+}
+
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    // The tasks left in the pipe are still read, one by one, but no longer
+    // run.
+    if (SHUTDOWN_CANCEL == mode) {
+        atomic_store_explicit(&this->cancel, true, memory_order_relaxed);
+    }
+
     // Close the write end pipe to notify worker threads that no tasks need to
     // be executed.
     close(this->pipefd[1]);
@@ -112,9 +206,17 @@ int thread_pool_destroy(thread_pool_t *this) {
         }
     }
 
+    trace_dump();
+    lock_profile_report(this, sizeof(thread_pool_t));
+
     free(this->workers);
+    stats_region_destroy(this->stats);
     close(this->pipefd[0]);
     pthread_mutex_destroy(&this->mutex);
 
-    return 0;
+    return this->discarded;
+}
+
+int thread_pool_destroy(thread_pool_t *this) {
+    return -1 == thread_pool_shutdown(this, SHUTDOWN_DRAIN) ? -1 : 0;
 }
@@ -2,7 +2,10 @@
 #define THREAD_POOL_H_
 
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include "../thread-pool-stats.h"
+#include "../thread-pool-options.h"
 
 
 // Description:
@@ -20,10 +23,17 @@ typedef struct __TASK_TAG__ {
 // Attributes:
 //      shutdown:
 //          If true, the worker threads is terminated.
+//      cancel:
+//          Set by thread_pool_shutdown() with SHUTDOWN_CANCEL, the worker
+//          threads discard what they read from the pipe from then on.
+//      discarded:
+//          Number of the tasks discarded, guarded by mutex.
 //      size:
 //          Number of the worker threads.
 //      workers:
 //          Dynamically allocate 1-dim pthread array.
+//      options:
+//          Memory footprint of the worker threads.
 //      pipefd[0]:
 //          The worker threads reads the task from the blocking pipe.
 //      pipefd[1]:
@@ -31,12 +41,18 @@ typedef struct __TASK_TAG__ {
 //      mutex:
 //          The worker threads compete with each other for the right to use the
 //          read end pipe.
+//      stats:
+//          Per-worker counters, summed up by thread_pool_stats().
 typedef struct __THREAD_POOl_TAG__ {
     bool shutdown;
+    _Atomic bool cancel;
+    long discarded;
     int size;
     int pipefd[2];
     pthread_mutex_t mutex;
     pthread_t *workers;
+    thread_pool_options_t options;
+    stats_region_t *stats;
 
 } thread_pool_t;
 
@@ -53,6 +69,20 @@ typedef struct __THREAD_POOl_TAG__ {
 int thread_pool_init(thread_pool_t *this, const int size);
 
 
+// Description:
+//      Initializes the thread pool, with the stack size, guard size and
+//      prefaulting of worker threads set by options.
+//
+// Example:
+//     thread_pool_options_t options = { .stack_size = 256 * 1024 };
+//     thread_pool_init_ex(&thrpool, 8, &options);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options);
+
+
 // Description:
 //      The boss thread inserts the task into the task queue. The task waiting
 //      for the worker thread to execute.
@@ -74,7 +104,33 @@ int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args);
 
 
 // Description:
-//      Join the worker threads and release resources.
+//      Take a snapshot of the thread pool counters. Each worker thread keeps
+//      its own counters, they are only summed up here.
+//
+// Example:
+//      thread_pool_stats_t snapshot;
+//      thread_pool_stats(&thrpool, &snapshot);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot);
+
+
+// Description:
+//      Stop the worker threads and release resources. The worker threads are
+//      told by a single change of state, closing the pipe, and exit once the
+//      task queue is empty: with SHUTDOWN_DRAIN after running the queued tasks,
+//      with SHUTDOWN_CANCEL right after the tasks they are running, the queued
+//      ones being discarded.
+//
+// Return value:
+//      Return the number of tasks discarded, or -1 if an error occurred.
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode);
+
+
+// Description:
+//      Run the queued tasks, join the worker threads and release resources,
+//      thread_pool_shutdown() with SHUTDOWN_DRAIN.
 //
 // Return value:
 //      Return zero on success, or -1 if an error occurred.
@@ -1,10 +1,58 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <stdatomic.h>
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
 
 #include IMPL
+#include "thread-pool-io.h"
+#include "thread-pool-strand.h"
+#include "thread-pool-graph.h"
+#include "thread-pool-parallel.h"
+#include "thread-pool-completion.h"
+#include "thread-pool-shm.h"
+#include "thread-pool-tenant.h"
+#include "thread-pool-express.h"
+
+#define IDLE_TIMEOUT 1000
+
+// The tasks only sleep or count, a fraction of the default 8 MiB stack is
+// plenty for the worker threads.
+#define STACK_SIZE   (128 * 1024)
+
+// Bursts are buffered up to this much queue memory before the boss thread
+// blocks, where the queue is segmented.
+#define QUEUE_MEMORY_CAP (64 * 1024 * 1024)
+
+// Pools that can grow and shrink, or buffer bursts in a segmented queue, do
+// so in the sync test, and in the benchmark only if built with 'make
+// ELASTIC=1' or 'make SEGMENTED=1', so that by default every pool is measured
+// at a fixed size with a fixed queue.
+#if defined(ELASTIC) && (defined(SYNC_TEST) || defined(ELASTIC_POOL))
+#define WITH_ELASTIC 1
+#endif
+
+#if defined(SEGMENTED_QUEUE) && (defined(SYNC_TEST) || defined(SEGMENTED_POOL))
+#define WITH_SEGMENTED 1
+#endif
+
+// Reserved worker threads of the express lane. The sync test always runs
+// one, the benchmark only if built with 'make EXPRESS=1', since its worker
+// threads and probes change what the throughput is measured for.
+#define EXPRESS_WORKERS 2
+
+#if defined(SYNC_TEST) || defined(EXPRESS_LANE)
+#define WITH_EXPRESS 1
+#endif
 
 
 #ifdef SYNC_TEST
@@ -13,7 +61,335 @@
 _Atomic int cnt;
 
 void task(void *args) {
+#ifdef MANAGED_BLOCKING
+    // Exercise the activation and retirement of spare workers.
+    thread_pool_begin_blocking(args);
+    atomic_fetch_add_explicit(&cnt, 1, memory_order_relaxed);
+    thread_pool_end_blocking(args);
+#else
     atomic_fetch_add_explicit(&cnt, 1, memory_order_relaxed);
+#endif
+}
+
+#define NUM_OF_KEYS 100
+
+typedef struct {
+    int key;
+    int sequence;
+} keyed_args_t;
+
+keyed_args_t keyed_args[NUM_OF_REQUESTS];
+int next_sequence[NUM_OF_KEYS];
+_Atomic int out_of_order;
+
+void keyed_task(void *args) {
+    // Tasks of a key never overlap, so the plain increment is safe.
+    keyed_args_t *keyed = args;
+
+    if (next_sequence[keyed->key]++ != keyed->sequence) {
+        atomic_fetch_add(&out_of_order, 1);
+    }
+}
+
+#define NUM_OF_BRANCHES 8
+#define NUM_OF_GRAPH_RUNS 100
+
+_Atomic int branches_done;
+int graph_failures;
+
+void branch_task(void *args) {
+    atomic_fetch_add(&branches_done, 1);
+}
+
+void join_task(void *args) {
+    // Runs once all branches of the run have finished, and alone.
+    if (NUM_OF_BRANCHES != atomic_exchange(&branches_done, 0)) {
+        graph_failures += 1;
+    }
+}
+
+#define NUM_OF_ELEMENTS 1000000
+
+long elements[NUM_OF_ELEMENTS];
+
+void fill(long lo, long hi, void *ctx) {
+    for (long idx = lo; idx < hi; ++idx) {
+        elements[idx] = idx;
+    }
+}
+
+void sum(long lo, long hi, void *partial, void *ctx) {
+    for (long idx = lo; idx < hi; ++idx) {
+        *(long *)partial += elements[idx];
+    }
+}
+
+void add(void *result, const void *partial, void *ctx) {
+    *(long *)result += *(const long *)partial;
+}
+
+// Fewer records than requests, so submission runs into EBUSY and has to wait
+// for completions.
+#define COMPLETION_CAPACITY 256
+#define HARVEST_BATCH 64
+#define HARVEST_TIMEOUT 5000
+
+int harvested;
+int completion_failures;
+
+int tracked_task(void *args) {
+    return 2 * (int)(intptr_t)args;
+}
+
+// Wait for fd, then harvest until the completion queue is drained.
+void harvest(thread_pool_completions_t *completions) {
+    struct pollfd pollfd = { .fd = completions->fd, .events = POLLIN };
+    completion_t batch[HARVEST_BATCH];
+    int count;
+
+    if (1 != poll(&pollfd, 1, HARVEST_TIMEOUT)) {
+        completion_failures += 1;
+        return;
+    }
+
+    do {
+        count = thread_pool_completions_harvest(completions, batch,
+            HARVEST_BATCH);
+
+        for (int idx = 0; idx < count; ++idx) {
+            if (batch[idx].status != 2 * (int)batch[idx].cookie) {
+                completion_failures += 1;
+            }
+        }
+
+        harvested += count;
+    } while (HARVEST_BATCH == count);
+}
+
+// Fewer records than requests, so the client process runs into a full ring.
+#define SHM_CAPACITY 512
+
+_Atomic int shm_served;
+_Atomic long shm_total;
+
+void shm_task(void *ctx, const void *payload, const size_t length) {
+    atomic_fetch_add(&shm_served, 1);
+    atomic_fetch_add(&shm_total, *(const int *)payload);
+}
+
+// A flooding tenant, a heavier one and one capped at a couple of tasks at once.
+#define NUM_OF_TENANTS 3
+#define TENANT_CAP 2
+
+const int tenant_weights[NUM_OF_TENANTS] = { 1, 4, 2 };
+const int tenant_caps[NUM_OF_TENANTS] = { 1 << 20, 1 << 20, TENANT_CAP };
+
+_Atomic int tenant_served;
+_Atomic int capped_running;
+_Atomic int capped_peak;
+
+void tenant_task(void *args) {
+    atomic_fetch_add(&tenant_served, 1);
+}
+
+void capped_task(void *args) {
+    int running = atomic_fetch_add(&capped_running, 1) + 1;
+    int peak = atomic_load(&capped_peak);
+
+    while (peak < running &&
+           ! atomic_compare_exchange_weak(&capped_peak, &peak, running)) {
+    }
+
+    atomic_fetch_add(&tenant_served, 1);
+    atomic_fetch_sub(&capped_running, 1);
+}
+
+_Atomic int express_served;
+
+void express_task(void *args) {
+    atomic_fetch_add(&express_served, 1);
+}
+
+#define WAIT_TIMEOUT 10000
+
+// Wait up to WAIT_TIMEOUT milliseconds for counter to reach target.
+int wait_for(_Atomic int *counter, const int target) {
+    for (int elapsed = 0; elapsed < WAIT_TIMEOUT; ++elapsed) {
+        if (target <= atomic_load(counter)) {
+            return 0;
+        }
+
+        usleep(1000);
+    }
+
+    return -1;
+}
+
+// Few enough entries that the timeouts below fill the ring.
+#define IO_ENTRIES 4
+#define IO_TIMEOUT 10000
+
+const char io_message[] = "Hello, io_uring";
+
+_Atomic int io_completed;
+int io_failures;
+
+void io_task(io_request_t *request) {
+    atomic_fetch_add(&io_completed, 1);
+}
+
+// Submit request with submit, wait for its callback and check its result.
+#define IO_CHECK(submit, expected)                                            \
+    do {                                                                      \
+        int target = atomic_load(&io_completed) + 1;                          \
+        if (-1 == (submit) || -1 == wait_for(&io_completed, target) ||        \
+            (expected) != request.result) {                                   \
+            io_failures += 1;                                                 \
+        }                                                                     \
+    } while (0)
+
+// Write, flush and read back a temporary file, wait for a timeout, and fill
+// the ring with timeouts until a submission is turned away with EBUSY.
+void io_test(thread_pool_t *pool) {
+    char path[] = "/tmp/thread-pool-sync-test-XXXXXX";
+    char buf[sizeof(io_message)] = { 0 };
+    int length = sizeof(io_message) - 1;
+    io_request_t request = { .callback = &io_task };
+    io_request_t timeouts[2 * IO_ENTRIES];
+    thread_pool_io_t io;
+
+    int fd = mkstemp(path);
+
+    if (-1 == fd || -1 == thread_pool_io_init(&io, pool, IO_ENTRIES)) {
+        io_failures += 1;
+        return;
+    }
+
+    unlink(path);
+
+    IO_CHECK(thread_pool_io_write(&io, &request, fd, io_message, length, 0),
+        length);
+    IO_CHECK(thread_pool_io_fsync(&io, &request, fd), 0);
+    IO_CHECK(thread_pool_io_read(&io, &request, fd, buf, length, 0), length);
+    IO_CHECK(thread_pool_io_timeout(&io, &request, 1000), -ETIME);
+
+    if (0 != strcmp(buf, io_message)) {
+        io_failures += 1;
+    }
+
+    int submitted = 0;
+    int target = atomic_load(&io_completed);
+
+    for (; submitted < 2 * IO_ENTRIES; ++submitted) {
+        timeouts[submitted].callback = &io_task;
+
+        if (-1 == thread_pool_io_timeout(&io, &timeouts[submitted],
+                                         IO_TIMEOUT)) {
+            break;
+        }
+    }
+
+    if (EBUSY != errno || io.capacity != submitted ||
+        -1 == wait_for(&io_completed, target + submitted)) {
+        io_failures += 1;
+    }
+
+    thread_pool_io_destroy(&io);
+    close(fd);
+}
+
+int parking_failures;
+
+#ifdef WORK_GROUP
+
+// The tasks of the parking test wait in gated_task() until gate reaches the
+// level passed as argument.
+_Atomic unsigned int gate;
+_Atomic int parking_cnt;
+
+void gated_task(void *args) {
+    unsigned int level = (unsigned int)(intptr_t)args;
+    unsigned int now;
+
+    while ((now = atomic_load(&gate)) < level) {
+        syscall(SYS_futex, &gate, FUTEX_WAIT_PRIVATE, now, NULL, NULL, 0);
+    }
+
+    atomic_fetch_add(&parking_cnt, 1);
+}
+
+void counted_task(void *args) {
+    atomic_fetch_add(&parking_cnt, 1);
+}
+
+void open_gate(const unsigned int level) {
+    atomic_store(&gate, level);
+    syscall(SYS_futex, &gate, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Get the last work group parked while its worker threads are busy and its
+// task queue holds a backlog, which they have to drain before they park.
+int parking_test(const int size, const thread_pool_options_t *options) {
+    thread_pool_t pool;
+    int submitted = 0;
+
+    if (-1 == thread_pool_init_ex(&pool, size, options)) {
+        return -1;
+    }
+
+    int last = pool.group_size - 1;
+
+    // The tasks go to the groups a batch at a time, in turn. Those of the
+    // last group wait for the gate, a backlog its worker threads cannot run,
+    // the others return right away.
+    for (int idx = 0; idx < SUBMIT_BATCH * pool.group_size; ++idx) {
+        unsigned int batch = atomic_load(&pool.next_task) / SUBMIT_BATCH;
+        bool gated = batch % pool.group_size == last &&
+                     atomic_load(&pool.active_groups) == pool.group_size;
+
+        thread_pool_run(&pool, gated ? &gated_task : &counted_task,
+                        (void *)1);
+        submitted += 1;
+    }
+
+    // Then a trickle of tasks, taken as soon as they come. The worker threads
+    // of the other groups find their task queues dry, and get the last group
+    // parked.
+    for (int elapsed = 0; elapsed < WAIT_TIMEOUT &&
+         atomic_load(&pool.active_groups) == pool.group_size; ++elapsed) {
+        thread_pool_run(&pool, &counted_task, NULL);
+        submitted += 1;
+        usleep(1000);
+    }
+
+    bool parked = atomic_load(&pool.active_groups) < pool.group_size;
+    open_gate(1);
+
+    if (-1 == wait_for(&parking_cnt, submitted)) {
+        return -1;
+    }
+
+    return (-1 == thread_pool_destroy(&pool) || ! parked) ? -1 : 0;
+}
+
+#endif
+
+// Runs in a forked process: no stdio, and _exit() rather than exit().
+void shm_client(const char *name) {
+    thread_pool_shm_client_t client;
+
+    if (-1 == thread_pool_shm_client_open(&client, name)) {
+        _exit(1);
+    }
+
+    for (int idx = 0; idx < NUM_OF_REQUESTS; ++idx) {
+        if (-1 == thread_pool_shm_submit(&client, 0, &idx, sizeof(idx))) {
+            _exit(1);
+        }
+    }
+
+    thread_pool_shm_client_close(&client);
+    _exit(0);
 }
 
 #else
@@ -33,9 +409,52 @@ static double diff_in_second(struct timespec t1, struct timespec t2) {
     return (diff.tv_sec + diff.tv_nsec / 1000000000.0);
 }
 
+#ifdef EXPRESS_LANE
+// Every PROBE_INTERVAL requests, a task that only takes the time goes to the
+// express lane and another one to the pool, to compare their queueing delay.
+#define PROBE_INTERVAL 1000
+#define NUM_OF_PROBES  (NUM_OF_REQUESTS / PROBE_INTERVAL)
+
+typedef struct {
+    struct timespec submitted;
+    double latency;
+} probe_t;
+
+probe_t express_probes[NUM_OF_PROBES];
+probe_t normal_probes[NUM_OF_PROBES];
+
+void probe(void *args) {
+    probe_t *this = args;
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    this->latency = diff_in_second(this->submitted, now);
+}
+
+static int compare_probes(const void *lhs, const void *rhs) {
+    double diff = ((const probe_t *)lhs)->latency -
+                  ((const probe_t *)rhs)->latency;
+
+    return (0 < diff) - (0 > diff);
+}
+
+static void print_latency(const char *lane, probe_t *probes) {
+    qsort(probes, NUM_OF_PROBES, sizeof(probe_t), &compare_probes);
+    printf("%s latency: p50 %.3lf ms, p99 %.3lf ms, max %.3lf ms\n", lane,
+        probes[NUM_OF_PROBES / 2].latency * 1000,
+        probes[NUM_OF_PROBES * 99 / 100].latency * 1000,
+        probes[NUM_OF_PROBES - 1].latency * 1000);
+}
+
+#endif
+
 void task(void *args) {
     // Spend a millisecond to execute an I/O bound task.
+#ifdef FIBER
+    thread_pool_sleep(1000);
+#else
     usleep(1000);
+#endif
 }
 
 #endif
@@ -45,13 +464,15 @@ int main(int argc, char const *argv[]) {
     // fprintf(stderr, "%d\n", getpid());
     // sleep(20);
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <#threads>\n", argv[0]);
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Usage: %s <#threads> [<#threads started up front>]\n",
+            argv[0]);
         return -1;
     }
 
     thread_pool_t thrpool;
     int size = atoi(argv[1]);
+    int min_size = (argc == 3) ? atoi(argv[2]) : size;
 
 
 #ifdef WORK_GROUP
@@ -60,11 +481,62 @@ int main(int argc, char const *argv[]) {
 #endif
 
 
-    if (-1 == thread_pool_init(&thrpool, size)) {
+#ifdef FIBER
+    // One worker thread per core, each with up to FIBERS_PER_WORKER tasks in
+    // flight.
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size = (0 < cores && cores < size) ? cores : size;
+
+#endif
+
+
+    thread_pool_options_t options = { .stack_size = STACK_SIZE };
+
+#ifdef WITH_SEGMENTED
+    options.segmented_queue = true;
+    options.queue_memory_cap = QUEUE_MEMORY_CAP;
+
+#endif
+
+#ifdef FIFO_WAKEUP_POOL
+    options.fifo_wakeup = true;
+
+#endif
+
+    struct timespec init_start, init_end;
+    clock_gettime(CLOCK_REALTIME, &init_start);
+
+
+#ifdef WITH_ELASTIC
+    // Worker threads beyond min_size are spawned when tasks back up, and
+    // exit again after IDLE_TIMEOUT milliseconds without a task.
+    int ret = thread_pool_init_elastic(&thrpool, min_size, size, IDLE_TIMEOUT,
+        &options);
+
+#else
+    (void)min_size;
+    int ret = thread_pool_init_ex(&thrpool, size, &options);
+
+#endif
+
+
+    if (-1 == ret) {
         fprintf(stderr, "Failed to initialize the thread pool.\n");
         return -1;
     }
 
+    clock_gettime(CLOCK_REALTIME, &init_end);
+
+#ifdef WITH_EXPRESS
+    thread_pool_express_t express;
+
+    if (-1 == thread_pool_express_init(&express, &thrpool, EXPRESS_WORKERS)) {
+        fprintf(stderr, "Failed to initialize the express lane.\n");
+        return -1;
+    }
+
+#endif
+
 
 #ifndef SYNC_TEST
     struct timespec start, end;
@@ -76,12 +548,211 @@ int main(int argc, char const *argv[]) {
     int requests = NUM_OF_REQUESTS;
 
     while (requests--) {
-        if (-1 == thread_pool_run(&thrpool, &task, NULL)) {
+        if (-1 == thread_pool_run(&thrpool, &task, &thrpool)) {
             fprintf(stderr, "Failed to run a task.\n");
             return -1;
         }
+
+#if defined(EXPRESS_LANE) && ! defined(SYNC_TEST)
+        if (0 == requests % PROBE_INTERVAL) {
+            probe_t *express_probe = &express_probes[requests / PROBE_INTERVAL];
+            probe_t *normal_probe = &normal_probes[requests / PROBE_INTERVAL];
+
+            clock_gettime(CLOCK_REALTIME, &express_probe->submitted);
+            normal_probe->submitted = express_probe->submitted;
+
+            if (-1 == thread_pool_run_express(&express, &probe,
+                                              express_probe) ||
+                -1 == thread_pool_run(&thrpool, &probe, normal_probe)) {
+                fprintf(stderr, "Failed to run a probe.\n");
+                return -1;
+            }
+        }
+
+#endif
+    }
+
+    thread_pool_stats_t snapshot;
+
+    if (-1 == thread_pool_stats(&thrpool, &snapshot)) {
+        fprintf(stderr, "Failed to take a snapshot of the thread pool.\n");
+        return -1;
+    }
+
+#ifdef SYNC_TEST
+#ifdef WORK_GROUP
+    parking_failures = -1 == parking_test(size, &options);
+
+#endif
+
+    io_test(&thrpool);
+
+    thread_pool_strands_t strands;
+
+    if (-1 == thread_pool_strands_init(&strands, &thrpool)) {
+        fprintf(stderr, "Failed to initialize the strands.\n");
+        return -1;
+    }
+
+    for (int idx = 0; idx < NUM_OF_REQUESTS; ++idx) {
+        keyed_args[idx].key = idx % NUM_OF_KEYS;
+        keyed_args[idx].sequence = idx / NUM_OF_KEYS;
+
+        if (-1 == thread_pool_run_keyed(&strands, keyed_args[idx].key,
+                                        &keyed_task, &keyed_args[idx])) {
+            fprintf(stderr, "Failed to run a keyed task.\n");
+            return -1;
+        }
+    }
+
+    if (-1 == thread_pool_strands_destroy(&strands)) {
+        fprintf(stderr, "Failed to destroy the strands.\n");
+        return -1;
+    }
+
+    // A fork of NUM_OF_BRANCHES nodes joined by a single one, run over and
+    // over again.
+    thread_pool_graph_t graph;
+
+    if (-1 == thread_pool_graph_init(&graph, &thrpool)) {
+        fprintf(stderr, "Failed to initialize the graph.\n");
+        return -1;
     }
 
+    int join = thread_pool_graph_add_node(&graph, &join_task, NULL);
+
+    for (int idx = 0; idx < NUM_OF_BRANCHES; ++idx) {
+        int branch = thread_pool_graph_add_node(&graph, &branch_task, NULL);
+        thread_pool_graph_add_edge(&graph, branch, join);
+    }
+
+    for (int idx = 0; idx < NUM_OF_GRAPH_RUNS; ++idx) {
+        thread_pool_graph_run(&graph);
+        thread_pool_graph_wait(&graph);
+    }
+
+    // Closing a cycle through the join, the graph is refused instead of
+    // leaving the wait hanging.
+    thread_pool_graph_add_edge(&graph, join, join + 1);
+
+    if (-1 != thread_pool_graph_run(&graph) || EDEADLK != errno) {
+        graph_failures += 1;
+    }
+
+    thread_pool_graph_destroy(&graph);
+
+    long total = 0, zero = 0;
+    thread_pool_parallel_for(&thrpool, 0, NUM_OF_ELEMENTS, 1024, &fill, NULL);
+    thread_pool_parallel_reduce(&thrpool, 0, NUM_OF_ELEMENTS, 1024, &sum, &add,
+        &total, &zero, sizeof(long), NULL);
+
+    thread_pool_completions_t completions;
+
+    if (-1 == thread_pool_completions_init(&completions, &thrpool,
+                                           COMPLETION_CAPACITY)) {
+        fprintf(stderr, "Failed to initialize the completion queue.\n");
+        return -1;
+    }
+
+    for (int idx = 0; idx < NUM_OF_REQUESTS && 0 == completion_failures; ) {
+        if (0 == thread_pool_run_tracked(&completions, &tracked_task,
+                                         (void *)(intptr_t)idx, idx)) {
+            ++idx;
+        } else if (EBUSY == errno) {
+            harvest(&completions);
+        } else {
+            fprintf(stderr, "Failed to run a tracked task.\n");
+            return -1;
+        }
+    }
+
+    while (harvested < NUM_OF_REQUESTS && 0 == completion_failures) {
+        harvest(&completions);
+    }
+
+    if (-1 == thread_pool_completions_destroy(&completions)) {
+        fprintf(stderr, "Failed to destroy the completion queue.\n");
+        return -1;
+    }
+
+    thread_pool_tenants_t tenants;
+
+    if (-1 == thread_pool_tenants_init(&tenants, &thrpool, size)) {
+        fprintf(stderr, "Failed to initialize the tenants.\n");
+        return -1;
+    }
+
+    for (int idx = 0; idx < NUM_OF_TENANTS; ++idx) {
+        if (idx != thread_pool_tenant_add(&tenants, tenant_weights[idx],
+                                          tenant_caps[idx])) {
+            fprintf(stderr, "Failed to add a tenant.\n");
+            return -1;
+        }
+    }
+
+    // Half of the requests flood the first tenant before the others submit.
+    for (int idx = 0; idx < NUM_OF_REQUESTS; ++idx) {
+        int tenant = idx < NUM_OF_REQUESTS / 2 ? 0 : idx % NUM_OF_TENANTS;
+
+        if (-1 == thread_pool_run_tenant(&tenants, tenant,
+                                         tenant == NUM_OF_TENANTS - 1 ?
+                                         &capped_task : &tenant_task, NULL)) {
+            fprintf(stderr, "Failed to run a tenant task.\n");
+            return -1;
+        }
+    }
+
+    if (-1 == thread_pool_tenants_destroy(&tenants)) {
+        fprintf(stderr, "Failed to destroy the tenants.\n");
+        return -1;
+    }
+
+    for (int idx = 0; idx < NUM_OF_REQUESTS; ++idx) {
+        if (-1 == thread_pool_run_express(&express, &express_task, NULL)) {
+            fprintf(stderr, "Failed to run an express task.\n");
+            return -1;
+        }
+    }
+
+    thread_pool_shm_server_t server;
+    char shm_name[SHM_NAME_MAX];
+    int client_status = -1;
+
+    snprintf(shm_name, SHM_NAME_MAX, "/thread-pool-sync-test-%d", getpid());
+
+    if (-1 == thread_pool_shm_server_init(&server, &thrpool, shm_name,
+                                          SHM_CAPACITY) ||
+        -1 == thread_pool_shm_register(&server, 0, &shm_task, NULL)) {
+        fprintf(stderr, "Failed to initialize the shared memory server.\n");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+
+    if (0 == pid) {
+        shm_client(shm_name);
+    } else if (-1 == pid || -1 == waitpid(pid, &client_status, 0)) {
+        perror("fork");
+    }
+
+    // Every record is in the ring by now, and runs before this returns.
+    if (-1 == thread_pool_shm_server_destroy(&server)) {
+        fprintf(stderr, "Failed to destroy the shared memory server.\n");
+        return -1;
+    }
+
+#endif
+
+
+#ifdef WITH_EXPRESS
+    if (-1 == thread_pool_express_destroy(&express)) {
+        fprintf(stderr, "Failed to destroy the express lane.\n");
+        return -1;
+    }
+
+#endif
+
     if (-1 == thread_pool_destroy(&thrpool)) {
         fprintf(stderr, "Failed to destroy a thread pool.\n");
         return -1;
@@ -89,7 +760,17 @@ int main(int argc, char const *argv[]) {
 
 
 #ifdef SYNC_TEST
-    printf("%s\n", (cnt == NUM_OF_REQUESTS) ? "PASS" : "FAIL");
+    printf("%s\n", (cnt == NUM_OF_REQUESTS &&
+        snapshot.tasks_submitted == NUM_OF_REQUESTS && 0 == out_of_order &&
+        0 == graph_failures && 0 == completion_failures &&
+        0 == parking_failures && 0 == io_failures &&
+        harvested == NUM_OF_REQUESTS && 0 == client_status &&
+        shm_served == NUM_OF_REQUESTS &&
+        tenant_served == NUM_OF_REQUESTS && capped_peak <= TENANT_CAP &&
+        express_served == NUM_OF_REQUESTS &&
+        shm_total == (long)NUM_OF_REQUESTS * (NUM_OF_REQUESTS - 1) / 2 &&
+        total == (long)NUM_OF_ELEMENTS * (NUM_OF_ELEMENTS - 1) / 2 &&
+        next_sequence[0] == NUM_OF_REQUESTS / NUM_OF_KEYS) ? "PASS" : "FAIL");
 
 #else
     clock_gettime(CLOCK_REALTIME, &end);
@@ -100,8 +781,30 @@ int main(int argc, char const *argv[]) {
         return -1;
     }
 
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
     double requests_per_second = NUM_OF_REQUESTS / diff_in_second(start, end);
     printf("requests per second: %.2lf\n", requests_per_second);
+    printf("init: %.2lf ms, max RSS: %ld KiB, workers spawned/retired: "
+        "%lu/%lu\n", diff_in_second(init_start, init_end) * 1000,
+        usage.ru_maxrss, snapshot.spawns, snapshot.retires);
+    printf("max queue depth: %lu, producer blocked %lu times for %.2lf s, "
+        "wakeups: %lu (%lu spurious), scale up/down: %lu/%lu\n",
+        snapshot.max_queue_depth, snapshot.producer_blocks,
+        snapshot.producer_block_time, snapshot.wakeups,
+        snapshot.spurious_wakeups, snapshot.scale_ups, snapshot.scale_downs);
+    printf("workers woken: %d, idle before wakeup: %.3lf ms on average\n",
+        snapshot.woken_workers, snapshot.wakeup_idle_time * 1000);
+
+#ifdef EXPRESS_LANE
+    print_latency("express", express_probes);
+    print_latency("normal", normal_probes);
+    printf("express tasks: %lu, pool tasks run by reserved workers: %lu\n",
+        express.served, express.borrowed);
+
+#endif
+
     fprintf(out, "%lf\n", requests_per_second);
     fclose(out);
 
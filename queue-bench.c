@@ -0,0 +1,339 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include QUEUE
+
+#define SINGLE_THREAD_OPS  10000000
+#define PING_PONG_ROUNDS     200000
+#define MPMC_OPS            2000000
+#define BATCH                  1024
+
+
+// Description:
+//      The task queues are not thread-safe by themselves, the thread pools
+//      protect them with a mutex and two condition variables. The benchmark
+//      wraps the queue the same way, unless the queue declares itself
+//      thread-safe by defining TASK_QUEUE_THREAD_SAFE, in which case push and
+//      pop are called directly and retried until they succeed.
+typedef struct __LOCKED_QUEUE_TAG__ {
+    pthread_mutex_t mutex;
+    pthread_cond_t task_available;
+    pthread_cond_t space_available;
+    task_queue_t task_queue;
+
+} locked_queue_t;
+
+typedef struct __COUNTER_TAG__ {
+    int fd_misses;
+    int fd_references;
+
+} counter_t;
+
+typedef struct __MPMC_TAG__ {
+    locked_queue_t *queue;
+    int ops;
+
+} mpmc_t;
+
+static void nop(void *args) { }
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+/* ************************************************************************** */
+
+
+static int perf_open(uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void counter_start(counter_t *this) {
+    this->fd_misses = perf_open(PERF_COUNT_HW_CACHE_MISSES);
+    this->fd_references = perf_open(PERF_COUNT_HW_CACHE_REFERENCES);
+
+    if (-1 != this->fd_misses && -1 != this->fd_references) {
+        ioctl(this->fd_misses, PERF_EVENT_IOC_ENABLE, 0);
+        ioctl(this->fd_references, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Print the cache-miss rate of all threads created since counter_start(), or
+// "n/a" if hardware counters are not available (e.g. perf_event_paranoid).
+static void counter_stop(counter_t *this) {
+    uint64_t misses = 0, references = 0;
+
+    if (-1 != this->fd_misses && -1 != this->fd_references) {
+        ioctl(this->fd_misses, PERF_EVENT_IOC_DISABLE, 0);
+        ioctl(this->fd_references, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    if (-1 == this->fd_misses || -1 == this->fd_references ||
+        sizeof(misses) != read(this->fd_misses, &misses, sizeof(misses)) ||
+        sizeof(references) != read(this->fd_references,
+                                   &references,
+                                   sizeof(references)) ||
+        0 == references) {
+        printf(", cache-miss rate: n/a\n");
+    } else {
+        printf(", cache-miss rate: %.2lf%% (%lu / %lu)\n",
+            100.0 * misses / references, misses, references);
+    }
+
+    if (-1 != this->fd_misses) {
+        close(this->fd_misses);
+    }
+
+    if (-1 != this->fd_references) {
+        close(this->fd_references);
+    }
+}
+
+
+/* ************************************************************************** */
+
+
+static void locked_queue_init(locked_queue_t *this) {
+    task_queue_init(&this->task_queue);
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->task_available, NULL);
+    pthread_cond_init(&this->space_available, NULL);
+}
+
+static void locked_queue_destroy(locked_queue_t *this) {
+    pthread_mutex_destroy(&this->mutex);
+    pthread_cond_destroy(&this->task_available);
+    pthread_cond_destroy(&this->space_available);
+}
+
+#ifdef TASK_QUEUE_THREAD_SAFE
+static void locked_queue_push(locked_queue_t *this, task_t *task_ptr) {
+    while (-1 == task_queue_push(&this->task_queue, task_ptr)) {
+        sched_yield();
+    }
+}
+
+static void locked_queue_pop(locked_queue_t *this, task_t *task_ptr) {
+    while (-1 == task_queue_pop(&this->task_queue, task_ptr)) {
+        sched_yield();
+    }
+}
+
+#else
+static void locked_queue_push(locked_queue_t *this, task_t *task_ptr) {
+    pthread_mutex_lock(&this->mutex);
+
+    while (is_full(&this->task_queue)) {
+        pthread_cond_wait(&this->space_available, &this->mutex);
+    }
+
+    task_queue_push(&this->task_queue, task_ptr);
+    pthread_cond_signal(&this->task_available);
+    pthread_mutex_unlock(&this->mutex);
+}
+
+static void locked_queue_pop(locked_queue_t *this, task_t *task_ptr) {
+    pthread_mutex_lock(&this->mutex);
+
+    while (is_empty(&this->task_queue)) {
+        pthread_cond_wait(&this->task_available, &this->mutex);
+    }
+
+    task_queue_pop(&this->task_queue, task_ptr);
+    pthread_cond_signal(&this->space_available);
+    pthread_mutex_unlock(&this->mutex);
+}
+
+#endif
+
+
+/* ************************************************************************** */
+
+
+// Push and pop in batches on a single thread, without any locking, to measure
+// the raw cost of task_queue_push() and task_queue_pop().
+static void bench_single_thread(void) {
+    task_t task = { .run = &nop, .arguments = NULL };
+    task_queue_t *queue = malloc(sizeof(task_queue_t));
+    counter_t counter;
+
+    task_queue_init(queue);
+    counter_start(&counter);
+    double start = now();
+
+    for (int round = 0; round < SINGLE_THREAD_OPS / BATCH; ++round) {
+        for (int idx = 0; idx < BATCH; ++idx) {
+            task_queue_push(queue, &task);
+        }
+
+        for (int idx = 0; idx < BATCH; ++idx) {
+            task_queue_pop(queue, &task);
+        }
+    }
+
+    double elapsed = now() - start;
+    long ops = 2L * (SINGLE_THREAD_OPS / BATCH) * BATCH;
+
+    printf("  single-thread: %.2lf ns/op, %.0lf ops/s",
+        elapsed * 1e9 / ops, ops / elapsed);
+    counter_stop(&counter);
+
+    free(queue);
+}
+
+static void *ping_pong_routine(void *args) {
+    locked_queue_t *queues = args;
+    task_t task = { 0 };
+
+    for (int round = 0; round < PING_PONG_ROUNDS; ++round) {
+        locked_queue_pop(&queues[0], &task);
+        locked_queue_push(&queues[1], &task);
+    }
+
+    return NULL;
+}
+
+// Bounce a single task between two threads through two queues. Every round
+// trip goes through two pushes and two pops, so the result is dominated by
+// the hand-off latency rather than by the queue operations themselves.
+static void bench_ping_pong(void) {
+    task_t task = { .run = &nop, .arguments = NULL };
+    locked_queue_t *queues = malloc(2 * sizeof(locked_queue_t));
+    pthread_t peer;
+    counter_t counter;
+
+    locked_queue_init(&queues[0]);
+    locked_queue_init(&queues[1]);
+
+    counter_start(&counter);
+    double start = now();
+    pthread_create(&peer, NULL, &ping_pong_routine, queues);
+
+    for (int round = 0; round < PING_PONG_ROUNDS; ++round) {
+        locked_queue_push(&queues[0], &task);
+        locked_queue_pop(&queues[1], &task);
+    }
+
+    pthread_join(peer, NULL);
+    double elapsed = now() - start;
+
+    printf("  spsc ping-pong: %.2lf ns/round-trip, %.0lf ops/s",
+        elapsed * 1e9 / PING_PONG_ROUNDS, 4 * PING_PONG_ROUNDS / elapsed);
+    counter_stop(&counter);
+
+    locked_queue_destroy(&queues[0]);
+    locked_queue_destroy(&queues[1]);
+    free(queues);
+}
+
+static void *producer_routine(void *args) {
+    mpmc_t *mpmc = args;
+    task_t task = { .run = &nop, .arguments = NULL };
+
+    for (int idx = 0; idx < mpmc->ops; ++idx) {
+        locked_queue_push(mpmc->queue, &task);
+    }
+
+    return NULL;
+}
+
+static void *consumer_routine(void *args) {
+    mpmc_t *mpmc = args;
+    task_t task = { 0 };
+
+    for (int idx = 0; idx < mpmc->ops; ++idx) {
+        locked_queue_pop(mpmc->queue, &task);
+    }
+
+    return NULL;
+}
+
+// N producers and M consumers share one queue. The total number of pushes is
+// split evenly among the producers, and the number of pops among consumers.
+static void bench_mpmc(const int producers, const int consumers) {
+    locked_queue_t *queue = malloc(sizeof(locked_queue_t));
+    pthread_t *threads = malloc((producers + consumers) * sizeof(pthread_t));
+    mpmc_t *args = malloc((producers + consumers) * sizeof(mpmc_t));
+    int ops = MPMC_OPS / (producers * consumers) * (producers * consumers);
+    counter_t counter;
+
+    locked_queue_init(queue);
+
+    counter_start(&counter);
+    double start = now();
+
+    for (int idx = 0; idx < producers + consumers; ++idx) {
+        args[idx].queue = queue;
+        args[idx].ops = (idx < producers) ? ops / producers : ops / consumers;
+        pthread_create(&threads[idx],
+                       NULL,
+                       (idx < producers) ? &producer_routine
+                                         : &consumer_routine,
+                       &args[idx]);
+    }
+
+    for (int idx = 0; idx < producers + consumers; ++idx) {
+        pthread_join(threads[idx], NULL);
+    }
+
+    double elapsed = now() - start;
+
+    printf("  mpmc %dP/%dC: %.2lf ns/op, %.0lf ops/s", producers, consumers,
+        elapsed * 1e9 / (2.0 * ops), 2.0 * ops / elapsed);
+    counter_stop(&counter);
+
+    locked_queue_destroy(queue);
+    free(queue);
+    free(threads);
+    free(args);
+}
+
+
+/* ************************************************************************** */
+
+
+int main(int argc, char const *argv[]) {
+    if (argc != 1 && argc != 3) {
+        fprintf(stderr, "Usage: %s [<#producers> <#consumers>]\n", argv[0]);
+        return -1;
+    }
+
+    int producers = (argc == 3) ? atoi(argv[1]) : 4;
+    int consumers = (argc == 3) ? atoi(argv[2]) : 4;
+
+    if (0 >= producers || 0 >= consumers) {
+        fprintf(stderr, "Invalid number of producers or consumers.\n");
+        return -1;
+    }
+
+    bench_single_thread();
+    bench_ping_pong();
+    bench_mpmc(1, 1);
+    bench_mpmc(producers, consumers);
+
+    return 0;
+}
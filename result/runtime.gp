@@ -11,7 +11,11 @@ plot [:][:1500] \
 	'result/output.txt' using 3:xtic(1) with histogram title 'half-duplex-pipe', \
 	'result/output.txt' using 4:xtic(1) with histogram title 'two-stage-mutex', \
 	'result/output.txt' using 5:xtic(1) with histogram title 'work-group', \
+	'result/output.txt' using 6:xtic(1) with histogram title 'fiber', \
+	'result/output.txt' using 7:xtic(1) with histogram title 'flat-combining', \
 	'result/output.txt' using ($0-0):(900):2 with labels title '' textcolor lt 1, \
 	'result/output.txt' using ($0-0):(970):3 with labels title '' textcolor lt 2, \
 	'result/output.txt' using ($0-0):(1040):4 with labels title '' textcolor lt 3, \
 	'result/output.txt' using ($0-0):(1110):5 with labels title '' textcolor lt 4, \
+	'result/output.txt' using ($0-0):(1180):6 with labels title '' textcolor lt 5, \
+	'result/output.txt' using ($0-0):(1250):7 with labels title '' textcolor lt 6, \
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include IMPL
+
+// Below the capacity of every task queue, so submitting never blocks.
+#define BACKLOG       4000
+#define SETTLE_TIME   100000    // Microseconds for the worker threads to park
+
+
+// Description:
+//      How long thread_pool_shutdown() takes, for a pool of the given size:
+//      once idle, where every worker thread is parked and SHUTDOWN_DRAIN has
+//      nothing to drain, and once with BACKLOG blocking tasks queued, which
+//      SHUTDOWN_CANCEL discards.
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void task(void *args) {
+#ifdef FIBER
+    thread_pool_sleep(1000);
+#else
+    usleep(1000);
+#endif
+}
+
+static int init(thread_pool_t *pool, int size) {
+#ifdef WORK_GROUP
+    size = size / WORKERS_PER_GROUP;
+
+#endif
+
+
+#ifdef FIBER
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size = (0 < cores && cores < size) ? cores : size;
+
+#endif
+
+    thread_pool_options_t options = { .stack_size = 128 * 1024 };
+
+    if (-1 == thread_pool_init_ex(pool, size, &options)) {
+        fprintf(stderr, "Failed to initialize the thread pool.\n");
+        return -1;
+    }
+
+    usleep(SETTLE_TIME);
+
+    return 0;
+}
+
+
+/* ************************************************************************** */
+
+
+int main(int argc, char const *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <#threads>\n", argv[0]);
+        return -1;
+    }
+
+    int size = atoi(argv[1]);
+    thread_pool_t pool;
+
+    if (-1 == init(&pool, size)) {
+        return -1;
+    }
+
+    double start = now();
+    long discarded = thread_pool_shutdown(&pool, SHUTDOWN_DRAIN);
+    double idle = now() - start;
+
+    if (-1 == discarded || -1 == init(&pool, size)) {
+        return -1;
+    }
+
+    for (int idx = 0; idx < BACKLOG; ++idx) {
+        if (-1 == thread_pool_run(&pool, &task, NULL)) {
+            fprintf(stderr, "Failed to run a task.\n");
+            return -1;
+        }
+    }
+
+    start = now();
+    discarded = thread_pool_shutdown(&pool, SHUTDOWN_CANCEL);
+    double cancel = now() - start;
+
+    if (-1 == discarded) {
+        return -1;
+    }
+
+    printf("%5d workers: drain when idle %8.3lf ms, cancel %8.3lf ms "
+        "(%ld of %d tasks discarded)\n", size, idle * 1000, cancel * 1000,
+        discarded, BACKLOG);
+
+    return 0;
+}
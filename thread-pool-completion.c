@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "thread-pool-completion.h"
+
+static int index_ring_init(index_ring_t *this, const unsigned int capacity) {
+    this->cells = malloc(capacity * sizeof(*this->cells));
+    if (NULL == this->cells) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (unsigned int idx = 0; idx < capacity; ++idx) {
+        atomic_init(&this->cells[idx].sequence, idx);
+    }
+
+    this->mask = capacity - 1;
+    atomic_init(&this->enqueue_pos, 0);
+    atomic_init(&this->dequeue_pos, 0);
+
+    return 0;
+}
+
+static int index_ring_push(index_ring_t *this, const unsigned int value) {
+    unsigned long pos = atomic_load_explicit(&this->enqueue_pos,
+        memory_order_relaxed);
+    struct __INDEX_CELL_TAG__ *cell;
+
+    while (1) {
+        cell = &this->cells[pos & this->mask];
+        long diff = (long)(atomic_load_explicit(&cell->sequence,
+                                                memory_order_acquire) - pos);
+
+        if (0 == diff) {
+            if (atomic_compare_exchange_weak_explicit(&this->enqueue_pos,
+                    &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (0 > diff) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&this->enqueue_pos,
+                memory_order_relaxed);
+        }
+    }
+
+    cell->value = value;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+static int index_ring_pop(index_ring_t *this, unsigned int *value) {
+    unsigned long pos = atomic_load_explicit(&this->dequeue_pos,
+        memory_order_relaxed);
+    struct __INDEX_CELL_TAG__ *cell;
+
+    while (1) {
+        cell = &this->cells[pos & this->mask];
+        long diff = (long)(atomic_load_explicit(&cell->sequence,
+                                                memory_order_acquire) -
+                           (pos + 1));
+
+        if (0 == diff) {
+            if (atomic_compare_exchange_weak_explicit(&this->dequeue_pos,
+                    &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (0 > diff) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&this->dequeue_pos,
+                memory_order_relaxed);
+        }
+    }
+
+    *value = cell->value;
+    atomic_store_explicit(&cell->sequence, pos + this->mask + 1,
+        memory_order_release);
+
+    return 0;
+}
+
+static void signal_fd(thread_pool_completions_t *this) {
+    eventfd_write(this->fd, 1);
+}
+
+static void run_tracked(void *args) {
+    completion_record_t *record = args;
+    thread_pool_completions_t *this = record->owner;
+
+    record->status = record->run(record->args);
+
+    // There is a record for every cell, the queue is never full.
+    index_ring_push(&this->completed, record->index);
+
+    if (0 == atomic_fetch_add(&this->unharvested, 1)) {
+        signal_fd(this);
+    }
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_completions_init(thread_pool_completions_t *this,
+                                 thread_pool_t *pool,
+                                 const unsigned int capacity) {
+    if (NULL == this || NULL == pool) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 == capacity || (1u << 31) < capacity) {
+        fprintf(stderr, "Invalid capacity of completion queue.\n");
+        return -1;
+    }
+
+    this->pool = pool;
+    this->capacity = 1;
+    while (this->capacity < capacity) {
+        this->capacity <<= 1;
+    }
+
+    this->records = NULL;
+    this->free_records.cells = NULL;
+    this->completed.cells = NULL;
+    atomic_init(&this->unharvested, 0);
+
+    this->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == this->fd) {
+        perror("eventfd");
+        return -1;
+    }
+
+    this->records = malloc(this->capacity * sizeof(completion_record_t));
+    if (NULL == this->records) {
+        perror("malloc");
+        goto Error;
+    }
+
+    if (-1 == index_ring_init(&this->free_records, this->capacity) ||
+        -1 == index_ring_init(&this->completed, this->capacity)) {
+        goto Error;
+    }
+
+    for (unsigned int idx = 0; idx < this->capacity; ++idx) {
+        this->records[idx].index = idx;
+        this->records[idx].owner = this;
+        index_ring_push(&this->free_records, idx);
+    }
+
+    return 0;
+
+Error:
+    close(this->fd);
+    free(this->records);
+    free(this->free_records.cells);
+    free(this->completed.cells);
+
+    return -1;
+}
+
+int thread_pool_run_tracked(thread_pool_completions_t *this,
+                            int (*run)(void *), void *args,
+                            const uint64_t cookie) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    unsigned int index;
+
+    if (-1 == index_ring_pop(&this->free_records, &index)) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    completion_record_t *record = &this->records[index];
+    record->run = run;
+    record->args = args;
+    record->cookie = cookie;
+
+    if (-1 == thread_pool_run(this->pool, &run_tracked, record)) {
+        index_ring_push(&this->free_records, index);
+        return -1;
+    }
+
+    return 0;
+}
+
+int thread_pool_completions_harvest(thread_pool_completions_t *this,
+                                    completion_t *completions, const int max) {
+    if (NULL == this || NULL == completions) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    unsigned int index;
+    int count = 0;
+
+    while (count < max && 0 == index_ring_pop(&this->completed, &index)) {
+        completion_record_t *record = &this->records[index];
+
+        completions[count].cookie = record->cookie;
+        completions[count].status = record->status;
+        ++count;
+
+        index_ring_push(&this->free_records, index);
+    }
+
+    if (0 < atomic_fetch_sub(&this->unharvested, count) - count) {
+        return count;
+    }
+
+    // Drained: clear fd. A worker thread may have posted and signaled fd in
+    // between, whose signal is cleared as well, so look again afterwards.
+    eventfd_t value;
+    eventfd_read(this->fd, &value);
+
+    if (0 < atomic_load(&this->unharvested)) {
+        signal_fd(this);
+    }
+
+    return count;
+}
+
+int thread_pool_completions_destroy(thread_pool_completions_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (this->capacity != atomic_load(&this->free_records.enqueue_pos) -
+                          atomic_load(&this->free_records.dequeue_pos)) {
+        fprintf(stderr, "Tracked tasks not harvested.\n");
+        return -1;
+    }
+
+    close(this->fd);
+    free(this->records);
+    free(this->free_records.cells);
+    free(this->completed.cells);
+
+    return 0;
+}
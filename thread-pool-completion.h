@@ -0,0 +1,154 @@
+#ifndef THREAD_POOL_COMPLETION_H_
+#define THREAD_POOL_COMPLETION_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include IMPL
+
+
+// Description:
+//      A finished task, as handed back by thread_pool_completions_harvest().
+//
+// Attributes:
+//      cookie:
+//          The value passed to thread_pool_run_tracked().
+//      status:
+//          The return value of the task.
+typedef struct __COMPLETION_TAG__ {
+    uint64_t cookie;
+    int status;
+
+} completion_t;
+
+
+// Description:
+//      A bounded lock-free queue of record indices, after Dmitry Vyukov's
+//      MPMC queue. Every cell carries a sequence number telling whether it is
+//      free or holds a value for the position the cell is reached at.
+typedef struct __INDEX_RING_TAG__ {
+    struct __INDEX_CELL_TAG__ {
+        _Atomic unsigned long sequence;
+        unsigned int value;
+
+    } *cells;
+    unsigned long mask;
+
+    _Atomic unsigned long enqueue_pos __attribute__((aligned(64)));
+    _Atomic unsigned long dequeue_pos __attribute__((aligned(64)));
+
+} index_ring_t;
+
+
+// Description:
+//      A tracked task, from thread_pool_run_tracked() until it is harvested.
+typedef struct __COMPLETION_RECORD_TAG__ {
+    int (*run)(void *);
+    void *args;
+    uint64_t cookie;
+    int status;
+    unsigned int index;
+    struct __THREAD_POOL_COMPLETIONS_TAG__ *owner;
+
+} completion_record_t;
+
+
+// Description:
+//      Finished tasks posted by the worker threads for a single thread, the
+//      boss thread, to harvest, e.g. from an epoll loop. The worker threads
+//      never take a lock to post, and fd becomes readable only when the
+//      first completion lands in an empty queue, so the loop wakes up once
+//      per batch rather than once per task.
+//
+// Attributes:
+//      fd:
+//          An eventfd, readable while there are completions to harvest.
+//          Register it with epoll, poll or select.
+//      records / capacity:
+//          One record per task that may be in flight at once, capacity is
+//          rounded up to a power of two.
+//      free_records:
+//          Indices of the records not in use.
+//      completed:
+//          Indices of the records of finished tasks, in the order they
+//          finished.
+//      unharvested:
+//          Completions posted and not harvested yet. The worker thread that
+//          raises it from zero signals fd. May dip below zero for a moment,
+//          when a completion is harvested before it was counted.
+typedef struct __THREAD_POOL_COMPLETIONS_TAG__ {
+    thread_pool_t *pool;
+    int fd;
+
+    completion_record_t *records;
+    unsigned int capacity;
+
+    index_ring_t free_records;
+    index_ring_t completed;
+
+    _Atomic long unharvested __attribute__((aligned(64)));
+
+} thread_pool_completions_t;
+
+
+// Description:
+//      Set up a completion queue for up to capacity tasks of pool in flight
+//      at once.
+//
+// Example:
+//      thread_pool_completions_t completions;
+//      thread_pool_completions_init(&completions, &thrpool, 4096);
+//      struct epoll_event event = { .events = EPOLLIN };
+//      epoll_ctl(epfd, EPOLL_CTL_ADD, completions.fd, &event);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_completions_init(thread_pool_completions_t *this,
+                                 thread_pool_t *pool,
+                                 const unsigned int capacity);
+
+
+// Description:
+//      Run run(args) in the thread pool and post its return value, along with
+//      cookie, to the completion queue once it has finished.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred. With errno EBUSY,
+//      capacity tasks are in flight or not harvested yet, and the caller may
+//      retry after harvesting.
+int thread_pool_run_tracked(thread_pool_completions_t *this,
+                            int (*run)(void *), void *args,
+                            const uint64_t cookie);
+
+
+// Description:
+//      Move up to max completions into completions, oldest first. fd is
+//      cleared once the completion queue has been drained, so keep calling
+//      it on a readable event until it returns less than max. Must only be
+//      called by one thread at a time.
+//
+// Example:
+//      completion_t batch[64];
+//      int count;
+//      do {
+//          count = thread_pool_completions_harvest(&completions, batch, 64);
+//          ...
+//      } while (64 == count);
+//
+// Return value:
+//      Return the number of completions harvested, or -1 if an error
+//      occurred.
+int thread_pool_completions_harvest(thread_pool_completions_t *this,
+                                    completion_t *completions, const int max);
+
+
+// Description:
+//      Close fd and release the records. Every tracked task must have been
+//      harvested.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_completions_destroy(thread_pool_completions_t *this);
+
+
+#endif /* THREAD_POOL_COMPLETION_H_ */
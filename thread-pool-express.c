@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "thread-pool-express.h"
+#include "thread-pool-trace.h"
+
+static void futex_wait(_Atomic unsigned int *word, const unsigned int value,
+                       const struct timespec *timeout) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, timeout, NULL, 0);
+}
+
+static void futex_wake(_Atomic unsigned int *word, const int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static unsigned long now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+static void lane_init(express_lane_t *this) {
+    for (unsigned int idx = 0; idx < EXPRESS_CAPACITY; ++idx) {
+        atomic_init(&this->cells[idx].sequence, idx);
+    }
+
+    atomic_init(&this->enqueue_pos, 0);
+    atomic_init(&this->dequeue_pos, 0);
+}
+
+static int lane_push(express_lane_t *this, void (*run)(void *), void *args) {
+    unsigned long pos = atomic_load_explicit(&this->enqueue_pos,
+        memory_order_relaxed);
+    struct __EXPRESS_CELL_TAG__ *cell;
+
+    while (1) {
+        cell = &this->cells[pos % EXPRESS_CAPACITY];
+        long diff = (long)(atomic_load_explicit(&cell->sequence,
+                                                memory_order_acquire) - pos);
+
+        if (0 == diff) {
+            if (atomic_compare_exchange_weak_explicit(&this->enqueue_pos,
+                    &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (0 > diff) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&this->enqueue_pos,
+                memory_order_relaxed);
+        }
+    }
+
+    cell->run = run;
+    cell->args = args;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+static int lane_pop(express_lane_t *this, void (**run)(void *), void **args) {
+    unsigned long pos = atomic_load_explicit(&this->dequeue_pos,
+        memory_order_relaxed);
+    struct __EXPRESS_CELL_TAG__ *cell;
+
+    while (1) {
+        cell = &this->cells[pos % EXPRESS_CAPACITY];
+        long diff = (long)(atomic_load_explicit(&cell->sequence,
+                                                memory_order_acquire) -
+                           (pos + 1));
+
+        if (0 == diff) {
+            if (atomic_compare_exchange_weak_explicit(&this->dequeue_pos,
+                    &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (0 > diff) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&this->dequeue_pos,
+                memory_order_relaxed);
+        }
+    }
+
+    *run = cell->run;
+    *args = cell->args;
+    atomic_store_explicit(&cell->sequence, pos + EXPRESS_CAPACITY,
+        memory_order_release);
+
+    return 0;
+}
+
+static bool lane_is_empty(express_lane_t *this) {
+    unsigned long pos = atomic_load_explicit(&this->dequeue_pos,
+        memory_order_relaxed);
+
+    return pos + 1 != atomic_load_explicit(
+        &this->cells[pos % EXPRESS_CAPACITY].sequence, memory_order_acquire);
+}
+
+// A submitter pushes before it looks at sleepers, a reserved worker thread
+// counts itself in sleepers before it looks at the lane a last time. The
+// fences make sure at least one of them sees the other.
+static void park(thread_pool_express_t *this, const long timeout_ns) {
+    unsigned int word = atomic_load(&this->word);
+
+    atomic_fetch_add(&this->sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (lane_is_empty(&this->lane) && ! atomic_load(&this->stopping)) {
+        struct timespec timeout = { 0, timeout_ns };
+        unsigned long park_start = trace_begin();
+        futex_wait(&this->word, word, 0 == timeout_ns ? NULL : &timeout);
+        trace_end(TRACE_PARK, park_start, 0);
+    }
+
+    atomic_fetch_sub(&this->sleepers, 1);
+}
+
+static void *express_routine(void *args) {
+    thread_pool_express_t *this = args;
+    unsigned long last_express = now_ns();
+    void (*run)(void *);
+    void *run_args;
+
+    trace_thread_name("express");
+
+    while (1) {
+        if (0 == lane_pop(&this->lane, &run, &run_args)) {
+            unsigned long run_start = trace_begin();
+            run(run_args);
+            trace_end(TRACE_RUN, run_start, 0);
+            atomic_fetch_add_explicit(&this->served, 1, memory_order_relaxed);
+            last_express = now_ns();
+            continue;
+        }
+
+        if (atomic_load(&this->stopping)) {
+            break;
+        }
+
+        bool idle = EXPRESS_IDLE_NS <= now_ns() - last_express;
+
+        // Express tasks tend to come in bursts, catch the next one without
+        // a round trip through the kernel.
+        if (! idle && 0 < this->spin_ns) {
+            unsigned long deadline = now_ns() + this->spin_ns;
+
+            while (lane_is_empty(&this->lane) && now_ns() < deadline) {
+                cpu_relax();
+            }
+
+            if (! lane_is_empty(&this->lane)) {
+                continue;
+            }
+        }
+
+#ifdef TASK_TAKING
+        // Rather than sitting idle, help the pool out one task at a time, and
+        // look at the lane again in between.
+        if (idle) {
+            task_t task;
+
+            if (0 == thread_pool_take(this->pool, &task)) {
+                task.run(task.arguments);
+                atomic_fetch_add_explicit(&this->borrowed, 1,
+                    memory_order_relaxed);
+                continue;
+            }
+
+            // Nothing tells a parked reserved worker thread about new tasks
+            // of the pool, so it looks every now and then.
+            park(this, EXPRESS_POLL_NS);
+            continue;
+        }
+
+        // Wake up once the lane has been empty for EXPRESS_IDLE_NS, rather
+        // than only for the next express task.
+        unsigned long empty_ns = now_ns() - last_express;
+
+        if (EXPRESS_IDLE_NS > empty_ns) {
+            park(this, EXPRESS_IDLE_NS - empty_ns);
+        }
+
+#else
+        park(this, 0);
+
+#endif
+    }
+
+    return NULL;
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_express_init(thread_pool_express_t *this, thread_pool_t *pool,
+                             const int size) {
+    if (NULL == this || NULL == pool) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 >= size) {
+        fprintf(stderr, "Invalid number of reserved worker threads.\n");
+        return -1;
+    }
+
+    this->pool = pool;
+    this->size = 0;
+    this->spin_ns = 1 < sysconf(_SC_NPROCESSORS_ONLN) ? EXPRESS_SPIN_NS : 0;
+
+    lane_init(&this->lane);
+    atomic_init(&this->sleepers, 0);
+    atomic_init(&this->word, 0);
+    atomic_init(&this->stopping, false);
+    atomic_init(&this->served, 0);
+    atomic_init(&this->borrowed, 0);
+
+    this->workers = malloc(size * sizeof(pthread_t));
+    if (NULL == this->workers) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (; this->size < size; ++this->size) {
+        if (0 != pthread_create(&this->workers[this->size], NULL,
+                                &express_routine, this)) {
+            perror("pthread_create");
+            goto Error;
+        }
+    }
+
+    return 0;
+
+Error:
+    thread_pool_express_destroy(this);
+
+    return -1;
+}
+
+int thread_pool_run_express(thread_pool_express_t *this, void (*run)(void *),
+                            void *args) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (-1 == lane_push(&this->lane, run, args)) {
+        return thread_pool_run(this->pool, run, args);
+    }
+
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (0 < atomic_load_explicit(&this->sleepers, memory_order_relaxed)) {
+        atomic_fetch_add(&this->word, 1);
+        futex_wake(&this->word, 1);
+    }
+
+    return 0;
+}
+
+int thread_pool_express_destroy(thread_pool_express_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    atomic_store(&this->stopping, true);
+    atomic_fetch_add(&this->word, 1);
+    futex_wake(&this->word, INT_MAX);
+
+    for (int idx = 0; idx < this->size; ++idx) {
+        if (0 != pthread_join(this->workers[idx], NULL)) {
+            perror("pthread_join");
+        }
+    }
+
+    free(this->workers);
+
+    return 0;
+}
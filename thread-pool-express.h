@@ -0,0 +1,119 @@
+#ifndef THREAD_POOL_EXPRESS_H_
+#define THREAD_POOL_EXPRESS_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include IMPL
+
+#define EXPRESS_CAPACITY 256
+#define EXPRESS_SPIN_NS  50000L       // Spin before parking
+#define EXPRESS_IDLE_NS  10000000L    // Lane empty before taking normal tasks
+#define EXPRESS_POLL_NS  1000000L     // Look at the task queue while parked
+
+
+// Description:
+//      A bounded lock-free queue of express tasks, after Dmitry Vyukov's MPMC
+//      queue, see thread-pool-completion.h.
+typedef struct __EXPRESS_LANE_TAG__ {
+    struct __EXPRESS_CELL_TAG__ {
+        _Atomic unsigned long sequence;
+        void (*run)(void *);
+        void *args;
+
+    } cells[EXPRESS_CAPACITY];
+
+    _Atomic unsigned long enqueue_pos __attribute__((aligned(64)));
+    _Atomic unsigned long dequeue_pos __attribute__((aligned(64)));
+
+} express_lane_t;
+
+
+// Description:
+//      A lane for latency-critical tasks, served by reserved worker threads
+//      that run nothing else while it has work. A task in the lane never
+//      waits behind the tasks of the pool, however busy its worker threads
+//      are with blocking tasks.
+//
+//      A reserved worker thread spins for EXPRESS_SPIN_NS after the lane runs
+//      dry and then parks. Once the lane has been empty for EXPRESS_IDLE_NS,
+//      it takes tasks off the task queue of the pool as well, where the
+//      variant defines TASK_TAKING, and goes back to the lane alone as soon as
+//      an express task shows up.
+//
+// Attributes:
+//      pool:
+//          The pool whose tasks the reserved worker threads may take.
+//      workers / size:
+//          The reserved worker threads.
+//      spin_ns:
+//          EXPRESS_SPIN_NS, or zero on a uniprocessor, where spinning only
+//          keeps the submitter off the CPU.
+//      lane:
+//          Express tasks, oldest first.
+//      sleepers / word:
+//          Reserved worker threads that park, or are about to, and the futex
+//          word they park on. A submitter bumps word only if one parks.
+//      stopping:
+//          Set by thread_pool_express_destroy().
+//      served / borrowed:
+//          Express tasks run, and tasks of the pool run by the reserved
+//          worker threads.
+typedef struct __THREAD_POOL_EXPRESS_TAG__ {
+    thread_pool_t *pool;
+    pthread_t *workers;
+    int size;
+    long spin_ns;
+
+    express_lane_t lane;
+
+    _Atomic int sleepers __attribute__((aligned(64)));
+    _Atomic unsigned int word;
+    _Atomic bool stopping;
+
+    _Atomic unsigned long served __attribute__((aligned(64)));
+    _Atomic unsigned long borrowed;
+
+} thread_pool_express_t;
+
+
+// Description:
+//      Start size reserved worker threads serving an express lane next to
+//      pool.
+//
+// Example:
+//      thread_pool_express_t express;
+//      thread_pool_express_init(&express, &thrpool, 2);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_express_init(thread_pool_express_t *this, thread_pool_t *pool,
+                             const int size);
+
+
+// Description:
+//      Run a task on a reserved worker thread, ahead of every task of the
+//      pool.
+//
+// Note:
+//      If EXPRESS_CAPACITY express tasks are pending already, the task goes to
+//      the pool instead.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_run_express(thread_pool_express_t *this, void (*run)(void *),
+                            void *args);
+
+
+// Description:
+//      Run the express tasks left and stop the reserved worker threads. Must
+//      be called before thread_pool_destroy(), and no express task may be
+//      submitted once it has started.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_express_destroy(thread_pool_express_t *this);
+
+
+#endif /* THREAD_POOL_EXPRESS_H_ */
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "thread-pool-graph.h"
+
+static void execute(void *args);
+
+static void enqueue(graph_node_t *node) {
+    // A node refused by the pool, e.g. under OVERLOAD_REJECT, runs right away
+    // rather than stalling the graph.
+    if (-1 == thread_pool_run(node->owner->pool, &execute, node)) {
+        execute(node);
+    }
+}
+
+static void execute(void *args) {
+    graph_node_t *node = args;
+    thread_pool_graph_t *this = node->owner;
+
+    while (NULL != node) {
+        graph_node_t *next = NULL;
+
+        node->run(node->args);
+
+        // The first successor made ready continues on this worker thread,
+        // the others go through the pool.
+        for (int idx = 0; idx < node->num_of_successors; ++idx) {
+            graph_node_t *successor = &this->nodes[node->successors[idx]];
+
+            if (1 == atomic_fetch_sub(&successor->pending, 1)) {
+                if (NULL == next) {
+                    next = successor;
+                } else {
+                    enqueue(successor);
+                }
+            }
+        }
+
+        if (1 == atomic_fetch_sub(&this->remaining, 1)) {
+            pthread_mutex_lock(&this->mutex);
+            this->running = 0;
+            pthread_cond_broadcast(&this->done);
+            pthread_mutex_unlock(&this->mutex);
+        }
+
+        node = next;
+    }
+}
+
+
+// Kahn's algorithm: every node is reached through nodes without predecessors
+// left, unless it lies on or behind a cycle, which would never become ready.
+static int validate(thread_pool_graph_t *this) {
+    int *ready = malloc(this->num_of_nodes * sizeof(int));
+    int num_of_ready = 0, num_of_reached = 0;
+
+    if (NULL == ready) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (int idx = 0; idx < this->num_of_nodes; ++idx) {
+        atomic_store(&this->nodes[idx].pending,
+            this->nodes[idx].num_of_predecessors);
+
+        if (0 == this->nodes[idx].num_of_predecessors) {
+            ready[num_of_ready++] = idx;
+        }
+    }
+
+    while (0 < num_of_ready) {
+        graph_node_t *node = &this->nodes[ready[--num_of_ready]];
+        num_of_reached += 1;
+
+        for (int idx = 0; idx < node->num_of_successors; ++idx) {
+            int successor = node->successors[idx];
+
+            if (1 == atomic_fetch_sub(&this->nodes[successor].pending, 1)) {
+                ready[num_of_ready++] = successor;
+            }
+        }
+    }
+
+    free(ready);
+
+    // A cycle is the caller's to report, it may well expect one.
+    if (num_of_reached != this->num_of_nodes) {
+        errno = EDEADLK;
+        return -1;
+    }
+
+    this->validated = 1;
+
+    return 0;
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_graph_init(thread_pool_graph_t *this, thread_pool_t *pool) {
+    if (NULL == this || NULL == pool) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    this->pool = pool;
+    this->nodes = NULL;
+    this->num_of_nodes = 0;
+    this->capacity = 0;
+    this->running = 0;
+    this->validated = 0;
+    atomic_init(&this->remaining, 0);
+
+    if (0 != pthread_mutex_init(&this->mutex, NULL)) {
+        perror("pthread_mutex_init");
+        return -1;
+    }
+
+    if (0 != pthread_cond_init(&this->done, NULL)) {
+        perror("pthread_cond_init");
+        pthread_mutex_destroy(&this->mutex);
+        return -1;
+    }
+
+    return 0;
+}
+
+int thread_pool_graph_add_node(thread_pool_graph_t *this, void (*run)(void *),
+                               void *args) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (this->num_of_nodes == this->capacity) {
+        int capacity = (0 == this->capacity) ? 16 : 2 * this->capacity;
+        graph_node_t *nodes = realloc(this->nodes,
+            capacity * sizeof(graph_node_t));
+
+        if (NULL == nodes) {
+            perror("realloc");
+            return -1;
+        }
+
+        this->nodes = nodes;
+        this->capacity = capacity;
+    }
+
+    graph_node_t *node = &this->nodes[this->num_of_nodes];
+    node->run = run;
+    node->args = args;
+    node->owner = this;
+    node->successors = NULL;
+    node->num_of_successors = 0;
+    node->capacity = 0;
+    node->num_of_predecessors = 0;
+    atomic_init(&node->pending, 0);
+    this->validated = 0;
+
+    return this->num_of_nodes++;
+}
+
+int thread_pool_graph_add_edge(thread_pool_graph_t *this, const int from,
+                               const int to) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 > from || from >= this->num_of_nodes || 0 > to ||
+        to >= this->num_of_nodes || from == to) {
+        fprintf(stderr, "Invalid edge of graph.\n");
+        return -1;
+    }
+
+    graph_node_t *node = &this->nodes[from];
+
+    if (node->num_of_successors == node->capacity) {
+        int capacity = (0 == node->capacity) ? 4 : 2 * node->capacity;
+        int *successors = realloc(node->successors, capacity * sizeof(int));
+
+        if (NULL == successors) {
+            perror("realloc");
+            return -1;
+        }
+
+        node->successors = successors;
+        node->capacity = capacity;
+    }
+
+    node->successors[node->num_of_successors++] = to;
+    this->nodes[to].num_of_predecessors += 1;
+    this->validated = 0;
+
+    return 0;
+}
+
+int thread_pool_graph_run(thread_pool_graph_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 == this->num_of_nodes) {
+        return 0;
+    }
+
+    if (! this->validated && -1 == validate(this)) {
+        return -1;
+    }
+
+    // Every counter is reset before the first node may finish and decrement
+    // any of them.
+    for (int idx = 0; idx < this->num_of_nodes; ++idx) {
+        atomic_store(&this->nodes[idx].pending,
+            this->nodes[idx].num_of_predecessors);
+    }
+
+    atomic_store(&this->remaining, this->num_of_nodes);
+
+    pthread_mutex_lock(&this->mutex);
+    this->running = 1;
+    pthread_mutex_unlock(&this->mutex);
+
+    for (int idx = 0; idx < this->num_of_nodes; ++idx) {
+        if (0 == this->nodes[idx].num_of_predecessors) {
+            enqueue(&this->nodes[idx]);
+        }
+    }
+
+    return 0;
+}
+
+int thread_pool_graph_wait(thread_pool_graph_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+
+    while (this->running) {
+        pthread_cond_wait(&this->done, &this->mutex);
+    }
+
+    pthread_mutex_unlock(&this->mutex);
+
+    return 0;
+}
+
+int thread_pool_graph_destroy(thread_pool_graph_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    for (int idx = 0; idx < this->num_of_nodes; ++idx) {
+        free(this->nodes[idx].successors);
+    }
+
+    free(this->nodes);
+    pthread_cond_destroy(&this->done);
+    pthread_mutex_destroy(&this->mutex);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef THREAD_POOL_GRAPH_H_
+#define THREAD_POOL_GRAPH_H_
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include IMPL
+
+
+// Description:
+//      A task of a graph.
+//
+// Attributes:
+//      run / args:
+//          The task, set by thread_pool_graph_add_node().
+//      successors / num_of_successors / capacity:
+//          Nodes that depend on this one, set by thread_pool_graph_add_edge().
+//      num_of_predecessors:
+//          Number of nodes this one depends on.
+//      pending:
+//          Predecessors that have not finished in the current run. The node
+//          becomes ready when the last one decrements it to zero.
+typedef struct __GRAPH_NODE_TAG__ {
+    void (*run)(void *);
+    void *args;
+    struct __THREAD_POOL_GRAPH_TAG__ *owner;
+    int *successors;
+    int num_of_successors;
+    int capacity;
+    int num_of_predecessors;
+    _Atomic int pending;
+
+} graph_node_t;
+
+
+// Description:
+//      A directed acyclic graph of tasks run by a thread pool. A node is
+//      enqueued once all of its predecessors have finished. The worker that
+//      finishes a node runs one of the successors it makes ready itself, so
+//      a chain of stages stays on one worker thread and in its cache.
+//
+//      Nodes and edges are added once, the graph can then be run any number
+//      of times without allocating.
+//
+// Attributes:
+//      pool:
+//          Runs the nodes.
+//      nodes / num_of_nodes / capacity:
+//          The nodes, indexed by the value thread_pool_graph_add_node()
+//          returned.
+//      remaining:
+//          Nodes that have not finished in the current run.
+//      mutex / done:
+//          Signaled when remaining drops to zero.
+//      running:
+//          Set by thread_pool_graph_run(), cleared when the run completes.
+//      validated:
+//          The graph has been checked to be acyclic since it last changed.
+typedef struct __THREAD_POOL_GRAPH_TAG__ {
+    thread_pool_t *pool;
+    graph_node_t *nodes;
+    int num_of_nodes;
+    int capacity;
+    _Atomic int remaining;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    int running;
+    int validated;
+
+} thread_pool_graph_t;
+
+
+// Description:
+//      Initialize an empty graph whose nodes run in pool.
+//
+// Example:
+//      thread_pool_graph_t graph;
+//      thread_pool_graph_init(&graph, &thrpool);
+//      int parse = thread_pool_graph_add_node(&graph, &parse_input, input);
+//      int build = thread_pool_graph_add_node(&graph, &build_index, input);
+//      thread_pool_graph_add_edge(&graph, parse, build);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_graph_init(thread_pool_graph_t *this, thread_pool_t *pool);
+
+
+// Description:
+//      Add a node running run(args).
+//
+// Return value:
+//      Return the index of the node, or -1 if an error occurred.
+int thread_pool_graph_add_node(thread_pool_graph_t *this, void (*run)(void *),
+                               void *args);
+
+
+// Description:
+//      Let the node numbered to wait for the node numbered from to finish.
+//      The graph must stay acyclic, and may not be changed while it runs.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_graph_add_edge(thread_pool_graph_t *this, const int from,
+                               const int to);
+
+
+// Description:
+//      Enqueue the nodes without predecessors, the others follow as their
+//      predecessors finish. A graph runs once at a time, wait for the run
+//      to complete before starting another one.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred. A graph with a
+//      cycle is refused with errno EDEADLK and nothing printed, none of its
+//      nodes run.
+//
+// Note:
+//      The first run after a change of the graph checks it for cycles, which
+//      takes time linear in its nodes and edges.
+int thread_pool_graph_run(thread_pool_graph_t *this);
+
+
+// Description:
+//      Block until every node of the current run has finished. Must not be
+//      called from a node of the graph.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_graph_wait(thread_pool_graph_t *this);
+
+
+// Description:
+//      Release the nodes and edges. The graph must not be running.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_graph_destroy(thread_pool_graph_t *this);
+
+
+#endif /* THREAD_POOL_GRAPH_H_ */
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "thread-pool-io.h"
+#include "thread-pool-trace.h"
+
+// liburing is not required, the few system calls needed are issued directly.
+static int io_uring_setup(const unsigned int entries,
+                          struct io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(const int fd, const unsigned int to_submit,
+                          const unsigned int min_complete,
+                          const unsigned int flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+        NULL, 0);
+}
+
+static void dispatch(void *args) {
+    io_request_t *request = args;
+    request->callback(request);
+}
+
+static void *reap_routine(void *args) {
+    thread_pool_io_t *this = args;
+    trace_thread_name("io reaper");
+
+    while (! atomic_load(&this->stopping) || 0 != atomic_load(&this->inflight)) {
+        unsigned int head = *this->cq_head;
+        unsigned int tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (-1 == io_uring_enter(this->fd, 0, 1, IORING_ENTER_GETEVENTS) &&
+                EINTR != errno) {
+                perror("io_uring_enter");
+            }
+
+            continue;
+        }
+
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &this->cqes[head & *this->cq_mask];
+            io_request_t *request = (io_request_t *)(uintptr_t)cqe->user_data;
+            int result = cqe->res;
+
+            head += 1;
+            __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+            atomic_fetch_sub(&this->inflight, 1);
+
+            // The request that wakes the reaper on destroy carries no
+            // callback.
+            if (NULL != request) {
+                request->result = result;
+                thread_pool_run(this->pool, &dispatch, request);
+            }
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+static int submit(thread_pool_io_t *this, io_request_t *request,
+                  const unsigned char opcode, const int fd, const void *addr,
+                  const unsigned int len, const unsigned long offset) {
+    if (NULL != request && NULL == request->callback) {
+        fprintf(stderr, "Null pointer exception.\n");
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (NULL != request &&
+        atomic_fetch_add(&this->inflight, 1) >= this->capacity) {
+        atomic_fetch_sub(&this->inflight, 1);
+        errno = EBUSY;
+        return -1;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+
+    // Every submission enters the kernel right away, so the submission queue
+    // is empty again by the time the mutex is released.
+    unsigned int tail = *this->sq_tail;
+    unsigned int idx = tail & *this->sq_mask;
+    struct io_uring_sqe *sqe = &this->sqes[idx];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = (uintptr_t)request;
+
+    this->sq_array[idx] = idx;
+    __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int ret;
+    do {
+        ret = io_uring_enter(this->fd, 1, 0, 0);
+    } while (-1 == ret && (EINTR == errno || EAGAIN == errno));
+
+    pthread_mutex_unlock(&this->mutex);
+
+    if (-1 == ret) {
+        perror("io_uring_enter");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_io_init(thread_pool_io_t *this, thread_pool_t *pool,
+                        const unsigned int entries) {
+    if (NULL == this || NULL == pool) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * entries;
+
+    memset(this, 0, sizeof(thread_pool_io_t));
+    this->pool = pool;
+    this->sq_ring = MAP_FAILED;
+    this->cq_ring = MAP_FAILED;
+    this->sqes = MAP_FAILED;
+    this->fd = io_uring_setup(entries, &params);
+
+    if (-1 == this->fd) {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    this->capacity = params.cq_entries - 1;
+    this->sq_ring_bytes = params.sq_off.array +
+        params.sq_entries * sizeof(unsigned int);
+    this->cq_ring_bytes = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    this->sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Both rings may share a single mapping.
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (this->cq_ring_bytes > this->sq_ring_bytes) {
+            this->sq_ring_bytes = this->cq_ring_bytes;
+        }
+
+        this->cq_ring_bytes = this->sq_ring_bytes;
+    }
+
+    this->sq_ring = mmap(NULL, this->sq_ring_bytes, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+
+    if (MAP_FAILED == this->sq_ring) {
+        perror("mmap");
+        goto Error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        this->cq_ring = this->sq_ring;
+    } else {
+        this->cq_ring = mmap(NULL, this->cq_ring_bytes, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+
+        if (MAP_FAILED == this->cq_ring) {
+            perror("mmap");
+            goto Error;
+        }
+    }
+
+    this->sqes = mmap(NULL, this->sqes_bytes, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+
+    if (MAP_FAILED == this->sqes) {
+        perror("mmap");
+        goto Error;
+    }
+
+    char *sq = this->sq_ring, *cq = this->cq_ring;
+    this->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    this->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    this->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    this->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    this->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    this->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    this->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    if (0 != pthread_mutex_init(&this->mutex, NULL)) {
+        perror("pthread_mutex_init");
+        goto Error;
+    }
+
+    if (0 != pthread_create(&this->reaper, NULL, &reap_routine, this)) {
+        perror("pthread_create");
+        pthread_mutex_destroy(&this->mutex);
+        goto Error;
+    }
+
+    return 0;
+
+Error:
+    if (MAP_FAILED != this->sqes) {
+        munmap(this->sqes, this->sqes_bytes);
+    }
+
+    if (MAP_FAILED != this->cq_ring && this->cq_ring != this->sq_ring) {
+        munmap(this->cq_ring, this->cq_ring_bytes);
+    }
+
+    if (MAP_FAILED != this->sq_ring) {
+        munmap(this->sq_ring, this->sq_ring_bytes);
+    }
+
+    close(this->fd);
+
+    return -1;
+}
+
+int thread_pool_io_read(thread_pool_io_t *this, io_request_t *request,
+                        const int fd, void *buf, const unsigned int len,
+                        const off_t offset) {
+    if (NULL == this || NULL == request) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    return submit(this, request, IORING_OP_READ, fd, buf, len, offset);
+}
+
+int thread_pool_io_write(thread_pool_io_t *this, io_request_t *request,
+                         const int fd, const void *buf, const unsigned int len,
+                         const off_t offset) {
+    if (NULL == this || NULL == request) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    return submit(this, request, IORING_OP_WRITE, fd, buf, len, offset);
+}
+
+int thread_pool_io_fsync(thread_pool_io_t *this, io_request_t *request,
+                         const int fd) {
+    if (NULL == this || NULL == request) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    return submit(this, request, IORING_OP_FSYNC, fd, NULL, 0, 0);
+}
+
+int thread_pool_io_timeout(thread_pool_io_t *this, io_request_t *request,
+                           const unsigned long usec) {
+    if (NULL == this || NULL == request) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    request->timeout.tv_sec = usec / 1000000;
+    request->timeout.tv_nsec = (usec % 1000000) * 1000;
+
+    return submit(this, request, IORING_OP_TIMEOUT, -1, &request->timeout,
+        1, 0);
+}
+
+int thread_pool_io_destroy(thread_pool_io_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    // A no-op wakes the reaper should it wait for completions with nothing
+    // left in flight.
+    atomic_store(&this->stopping, true);
+    atomic_fetch_add(&this->inflight, 1);
+
+    if (-1 == submit(this, NULL, IORING_OP_NOP, -1, NULL, 0, 0)) {
+        return -1;
+    }
+
+    if (0 != pthread_join(this->reaper, NULL)) {
+        perror("pthread_join");
+        return -1;
+    }
+
+    munmap(this->sqes, this->sqes_bytes);
+
+    if (this->cq_ring != this->sq_ring) {
+        munmap(this->cq_ring, this->cq_ring_bytes);
+    }
+
+    munmap(this->sq_ring, this->sq_ring_bytes);
+    pthread_mutex_destroy(&this->mutex);
+    close(this->fd);
+
+    return 0;
+}
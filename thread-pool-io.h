@@ -0,0 +1,153 @@
+#ifndef THREAD_POOL_IO_H_
+#define THREAD_POOL_IO_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <linux/time_types.h>
+
+#include IMPL
+
+#define IO_RING_ENTRIES 4096
+
+
+// Description:
+//      An asynchronous I/O operation. The caller owns the request and keeps
+//      it alive until its callback has run.
+//
+// Attributes:
+//      callback:
+//          Set by the caller. Enqueued into the thread pool as a normal task
+//          once the operation completes, and runs on a worker thread.
+//      arguments:
+//          Set by the caller, untouched by the helpers.
+//      result:
+//          Filled in before the callback runs: the number of bytes read or
+//          written, zero for fsync, or a negated errno. A timeout that expires
+//          completes with -ETIME.
+//      timeout:
+//          Storage for thread_pool_io_timeout(), the kernel reads it after
+//          submission.
+typedef struct __IO_REQUEST_TAG__ {
+    void (*callback)(struct __IO_REQUEST_TAG__ *request);
+    void *arguments;
+    int result;
+    struct __kernel_timespec timeout;
+
+} io_request_t;
+
+
+// Description:
+//      An io_uring shared by all tasks of a thread pool. Any thread may submit
+//      requests. A reaper thread waits for completions and hands each one
+//      back to the pool with thread_pool_run(), so no worker thread blocks
+//      while an operation is in flight.
+//
+// Attributes:
+//      fd:
+//          The io_uring file descriptor.
+//      mutex:
+//          Serializes submitters, the submission queue has a single tail.
+//      inflight:
+//          Requests submitted and not yet reaped. Bounded by capacity, so the
+//          completion queue never overflows.
+//      capacity:
+//          Number of completion queue entries, less one kept for the request
+//          that wakes the reaper on destroy.
+//      stopping:
+//          Set by thread_pool_io_destroy(). The reaper exits once inflight
+//          drops to zero.
+typedef struct __THREAD_POOL_IO_TAG__ {
+    int fd;
+    thread_pool_t *pool;
+    pthread_t reaper;
+    pthread_mutex_t mutex;
+    _Atomic unsigned int inflight;
+    unsigned int capacity;
+    _Atomic bool stopping;
+
+    void *sq_ring;
+    size_t sq_ring_bytes;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_bytes;
+
+    void *cq_ring;
+    size_t cq_ring_bytes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+} thread_pool_io_t;
+
+
+// Description:
+//      Set up an io_uring with room for entries submissions at once and twice
+//      as many operations in flight, and start the reaper thread.
+//      Completions are enqueued into pool.
+//
+// Example:
+//      thread_pool_io_t io;
+//      thread_pool_io_init(&io, &thrpool, IO_RING_ENTRIES);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_io_init(thread_pool_io_t *this, thread_pool_t *pool,
+                        const unsigned int entries);
+
+
+// Description:
+//      Read up to len bytes at offset of fd into buf. An offset of -1 reads at
+//      the current file position.
+//
+// Example:
+//      void done(io_request_t *request) { ... request->result ... }
+//      io_request_t request = { .callback = &done };
+//      thread_pool_io_read(&io, &request, fd, buf, sizeof(buf), 0);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred. With errno EBUSY,
+//      the ring already has its capacity of operations in flight, and the
+//      caller may retry later or fall back to a blocking call.
+int thread_pool_io_read(thread_pool_io_t *this, io_request_t *request,
+                        const int fd, void *buf, const unsigned int len,
+                        const off_t offset);
+
+
+// Description:
+//      Write len bytes of buf at offset of fd, see thread_pool_io_read().
+int thread_pool_io_write(thread_pool_io_t *this, io_request_t *request,
+                         const int fd, const void *buf, const unsigned int len,
+                         const off_t offset);
+
+
+// Description:
+//      Flush fd to its storage device, see thread_pool_io_read(). Operations
+//      in flight at the same time are not ordered against the fsync.
+int thread_pool_io_fsync(thread_pool_io_t *this, io_request_t *request,
+                         const int fd);
+
+
+// Description:
+//      Run the callback after usec microseconds without holding a worker
+//      thread meanwhile, see thread_pool_io_read().
+int thread_pool_io_timeout(thread_pool_io_t *this, io_request_t *request,
+                           const unsigned long usec);
+
+
+// Description:
+//      Wait until every request in flight has completed and its callback has
+//      been enqueued, stop the reaper thread and release the ring. Must be
+//      called before thread_pool_destroy(), and no request may be submitted
+//      once it has started.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_io_destroy(thread_pool_io_t *this);
+
+
+#endif /* THREAD_POOL_IO_H_ */
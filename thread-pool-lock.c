@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "thread-pool-lock.h"
+#include "thread-pool-trace.h"
+
+const char *pool_lock_names[] = {
+    "mutex", "mutex_for_pool", "mutex_for_queue",
+};
+
+#if defined(THREAD_POOL_TRACE) || defined(THREAD_POOL_LOCK_PROFILE)
+
+#ifdef THREAD_POOL_LOCK_PROFILE
+
+// Description:
+//      Profile of a single mutex. Apart from key, the counters are only
+//      updated by the thread that holds the mutex, so they need no
+//      synchronization of their own.
+//
+// Attributes:
+//      key:
+//          Address of the mutex, or FREED once lock_profile_report() has
+//          released the profile.
+//      acquired_at:
+//          When the current holder acquired the mutex.
+//      wait_histogram / hold_histogram:
+//          Bin i counts waits / holds of [2^i, 2^(i+1)) nanoseconds.
+typedef struct __LOCK_PROFILE_TAG__ {
+    _Atomic(pthread_mutex_t *) key;
+    pool_lock_t lock;
+    unsigned long acquired_at;
+    unsigned long acquisitions;
+    unsigned long contended;
+    unsigned long wait_ns;
+    unsigned long hold_ns;
+    unsigned long wait_histogram[LOCK_HISTOGRAM_BINS];
+    unsigned long hold_histogram[LOCK_HISTOGRAM_BINS];
+
+} __attribute__((aligned(64))) lock_profile_t;
+
+
+// Description:
+//      Open addressing table of the profiles, at most half full so that a
+//      probe sequence stays short. It is replaced by one twice the size
+//      rather than filled up. A profile never moves, and a replaced table is
+//      kept, since a lookup may still be probing it.
+//
+// Attributes:
+//      slots:
+//          Power of two, up to LOCK_PROFILE_MAX_SLOTS.
+//      used:
+//          Slots that point to a profile, including released ones.
+//      previous:
+//          The table this one replaced.
+typedef struct __LOCK_TABLE_TAG__ {
+    size_t slots;
+    size_t used;
+    struct __LOCK_TABLE_TAG__ *previous;
+    _Atomic(lock_profile_t *) profiles[];
+
+} lock_table_t;
+
+static _Atomic(lock_table_t *) table;
+
+// Serializes claiming a profile and replacing the table. Lookups of mutexes
+// already profiled never take it.
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Set once the table cannot grow any further. Acquisitions of the mutexes
+// left out are counted instead.
+static _Atomic bool table_full;
+static _Atomic unsigned long unprofiled;
+
+// The mutex the calling thread last looked up and its profile, NULL if it is
+// not profiled. Unlocking finds the profile of the mutex just locked here.
+static __thread pthread_mutex_t *cached_key;
+static __thread lock_profile_t *cached_profile;
+
+// Marks a released profile, to be reused by the next mutex whose probe
+// sequence passes it.
+#define FREED ((pthread_mutex_t *)(uintptr_t)1)
+
+static unsigned long now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int bin(const unsigned long ns) {
+    int idx = (0 == ns) ? 0 : 63 - __builtin_clzl(ns);
+    return (idx < LOCK_HISTOGRAM_BINS) ? idx : LOCK_HISTOGRAM_BINS - 1;
+}
+
+static size_t hash(pthread_mutex_t *mutex, const size_t slots) {
+    return ((uintptr_t)mutex >> 6) & (slots - 1);
+}
+
+// Probe for the profile of the mutex. Set vacant to the first released
+// profile or empty slot on the way, for the mutex to claim.
+static lock_profile_t *probe(lock_table_t *this, pthread_mutex_t *mutex,
+                             size_t *vacant) {
+    size_t idx = hash(mutex, this->slots);
+    bool found = false;
+
+    while (1) {
+        lock_profile_t *profile = atomic_load_explicit(&this->profiles[idx],
+            memory_order_acquire);
+
+        if (NULL == profile) {
+            break;
+        }
+
+        pthread_mutex_t *key = atomic_load_explicit(&profile->key,
+            memory_order_acquire);
+
+        if (key == mutex) {
+            return profile;
+        }
+
+        if (FREED == key && ! found) {
+            *vacant = idx;
+            found = true;
+        }
+
+        idx = (idx + 1) & (this->slots - 1);
+    }
+
+    if (! found) {
+        *vacant = idx;
+    }
+
+    return NULL;
+}
+
+// Replace the table by one twice the size. Return NULL if it would exceed
+// LOCK_PROFILE_MAX_SLOTS or cannot be allocated. Called with table_mutex
+// locked.
+static lock_table_t *grow(lock_table_t *this) {
+    size_t slots = (NULL == this) ? LOCK_PROFILE_MIN_SLOTS : 2 * this->slots;
+
+    if (slots > LOCK_PROFILE_MAX_SLOTS) {
+        return NULL;
+    }
+
+    lock_table_t *grown = calloc(1, sizeof(lock_table_t) +
+        slots * sizeof(lock_profile_t *));
+
+    if (NULL == grown) {
+        return NULL;
+    }
+
+    grown->slots = slots;
+    grown->previous = this;
+
+    for (size_t idx = 0; NULL != this && idx < this->slots; ++idx) {
+        lock_profile_t *profile = atomic_load_explicit(&this->profiles[idx],
+            memory_order_relaxed);
+
+        if (NULL == profile) {
+            continue;
+        }
+
+        size_t slot = hash(atomic_load_explicit(&profile->key,
+            memory_order_relaxed), slots);
+
+        while (NULL != atomic_load_explicit(&grown->profiles[slot],
+                                            memory_order_relaxed)) {
+            slot = (slot + 1) & (slots - 1);
+        }
+
+        atomic_store_explicit(&grown->profiles[slot], profile,
+            memory_order_relaxed);
+        grown->used += 1;
+    }
+
+    atomic_store_explicit(&table, grown, memory_order_release);
+
+    return grown;
+}
+
+// Claim a profile for the mutex, reusing a released one on its probe
+// sequence if there is one.
+static lock_profile_t *claim(pthread_mutex_t *mutex) {
+    pthread_mutex_lock(&table_mutex);
+
+    lock_table_t *this = atomic_load_explicit(&table, memory_order_relaxed);
+    lock_profile_t *profile = NULL;
+    size_t vacant = 0;
+
+    if (NULL != this) {
+        profile = probe(this, mutex, &vacant);
+    }
+
+    if (NULL == profile && NULL != this) {
+        profile = atomic_load_explicit(&this->profiles[vacant],
+            memory_order_relaxed);
+
+        if (NULL != profile) {
+            atomic_store_explicit(&profile->key, mutex, memory_order_release);
+        }
+    }
+
+    if (NULL == profile) {
+        if (NULL == this || 2 * (this->used + 1) > this->slots) {
+            this = grow(this);
+
+            if (NULL != this) {
+                probe(this, mutex, &vacant);
+            }
+        }
+
+        if (NULL != this &&
+            0 == posix_memalign((void **)&profile, 64,
+                                sizeof(lock_profile_t))) {
+            memset(profile, 0, sizeof(lock_profile_t));
+            atomic_store_explicit(&profile->key, mutex, memory_order_relaxed);
+            atomic_store_explicit(&this->profiles[vacant], profile,
+                memory_order_release);
+            this->used += 1;
+        } else {
+            profile = NULL;
+            atomic_store(&table_full, true);
+        }
+    }
+
+    pthread_mutex_unlock(&table_mutex);
+
+    return profile;
+}
+
+// Find the profile of the mutex, claiming one for it if create is true.
+// Return NULL if the mutex is unknown, or the table is full. Called with the
+// mutex locked, so no other thread claims a profile for the same one.
+static lock_profile_t *lookup(pthread_mutex_t *mutex, const bool create) {
+    if (cached_key == mutex &&
+        (NULL == cached_profile ||
+         mutex == atomic_load_explicit(&cached_profile->key,
+                                       memory_order_relaxed))) {
+        if (NULL == cached_profile && create) {
+            atomic_fetch_add_explicit(&unprofiled, 1, memory_order_relaxed);
+        }
+
+        return cached_profile;
+    }
+
+    lock_table_t *this = atomic_load_explicit(&table, memory_order_acquire);
+    lock_profile_t *profile = NULL;
+    size_t vacant;
+
+    if (NULL != this) {
+        profile = probe(this, mutex, &vacant);
+    }
+
+    if (NULL == profile && create) {
+        if (atomic_load_explicit(&table_full, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&unprofiled, 1, memory_order_relaxed);
+        } else {
+            profile = claim(mutex);
+        }
+    }
+
+    // A mutex is only known to be left out once a claim has been refused.
+    if (NULL != profile || create) {
+        cached_key = mutex;
+        cached_profile = profile;
+    }
+
+    return profile;
+}
+
+static void record_hold(lock_profile_t *this) {
+    unsigned long held = now() - this->acquired_at;
+    this->hold_ns += held;
+    this->hold_histogram[bin(held)] += 1;
+}
+
+#endif /* THREAD_POOL_LOCK_PROFILE */
+
+
+void pool_mutex_lock(pthread_mutex_t *mutex, const pool_lock_t lock) {
+    bool contended = false;
+    unsigned long wait = 0;
+
+    if (0 != pthread_mutex_trylock(mutex)) {
+        // Both clocks are CLOCK_MONOTONIC, the start serves the trace too.
+#ifdef THREAD_POOL_LOCK_PROFILE
+        unsigned long start = now();
+#else
+        unsigned long start = trace_begin();
+#endif
+        pthread_mutex_lock(mutex);
+        trace_end(TRACE_LOCK_WAIT, start, lock);
+
+        contended = true;
+#ifdef THREAD_POOL_LOCK_PROFILE
+        wait = now() - start;
+#endif
+    }
+
+#ifdef THREAD_POOL_LOCK_PROFILE
+    lock_profile_t *this = lookup(mutex, true);
+    if (NULL != this) {
+        this->lock = lock;
+        this->acquisitions += 1;
+
+        if (contended) {
+            this->contended += 1;
+            this->wait_ns += wait;
+            this->wait_histogram[bin(wait)] += 1;
+        }
+
+        this->acquired_at = now();
+    }
+#else
+    (void)contended;
+    (void)wait;
+#endif
+}
+
+void pool_mutex_unlock(pthread_mutex_t *mutex) {
+#ifdef THREAD_POOL_LOCK_PROFILE
+    lock_profile_t *this = lookup(mutex, false);
+    if (NULL != this) {
+        record_hold(this);
+    }
+#endif
+
+    pthread_mutex_unlock(mutex);
+}
+
+void pool_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+#ifdef THREAD_POOL_LOCK_PROFILE
+    lock_profile_t *this = lookup(mutex, false);
+    if (NULL != this) {
+        record_hold(this);
+    }
+
+    pthread_cond_wait(cond, mutex);
+
+    // Reacquired inside pthread_cond_wait(), the wait for the mutex itself
+    // cannot be told apart from the wait for the signal.
+    if (NULL != this) {
+        this->acquisitions += 1;
+        this->acquired_at = now();
+    }
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+int pool_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                        const struct timespec *abstime) {
+#ifdef THREAD_POOL_LOCK_PROFILE
+    lock_profile_t *this = lookup(mutex, false);
+    if (NULL != this) {
+        record_hold(this);
+    }
+
+    int ret = pthread_cond_timedwait(cond, mutex, abstime);
+
+    if (NULL != this) {
+        this->acquisitions += 1;
+        this->acquired_at = now();
+    }
+
+    return ret;
+#else
+    return pthread_cond_timedwait(cond, mutex, abstime);
+#endif
+}
+
+
+/* ************************************************************************** */
+
+
+#ifdef THREAD_POOL_LOCK_PROFILE
+
+static void print_histogram(const char *title, const unsigned long *histogram,
+                            const unsigned long count, const unsigned long ns) {
+    if (0 == count) {
+        fprintf(stderr, "    %s: none\n", title);
+        return;
+    }
+
+    unsigned long seen = 0;
+    int p50 = -1, p99 = -1;
+
+    for (int idx = 0; idx < LOCK_HISTOGRAM_BINS; ++idx) {
+        seen += histogram[idx];
+
+        if (-1 == p50 && seen * 2 >= count) {
+            p50 = idx;
+        }
+
+        if (-1 == p99 && seen * 100 >= count * 99) {
+            p99 = idx;
+        }
+    }
+
+    fprintf(stderr, "    %s: avg %.0lf ns, p50 < %lu ns, p99 < %lu ns\n",
+        title, (double)ns / count, 2UL << p50, 2UL << p99);
+    fprintf(stderr, "     ");
+
+    for (int idx = 0; idx < LOCK_HISTOGRAM_BINS; ++idx) {
+        if (0 != histogram[idx]) {
+            fprintf(stderr, " [%lu,%lu):%lu", 1UL << idx, 2UL << idx,
+                histogram[idx]);
+        }
+    }
+
+    fprintf(stderr, "\n");
+}
+
+static bool in_ranges(const char *key, const lock_range_t *ranges,
+                      const int count) {
+    for (int idx = 0; idx < count; ++idx) {
+        const char *begin = ranges[idx].begin;
+
+        if (key >= begin && key < begin + ranges[idx].bytes) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void lock_profile_report(const void *pool, const size_t bytes) {
+    lock_range_t range = { .begin = pool, .bytes = bytes };
+    lock_profile_report_ranges(&range, 1);
+}
+
+void lock_profile_report_ranges(const lock_range_t *ranges, const int count) {
+    fprintf(stderr, "lock profile:\n");
+
+    pthread_mutex_lock(&table_mutex);
+
+    lock_table_t *profiles = atomic_load_explicit(&table, memory_order_relaxed);
+
+    for (size_t slot = 0; NULL != profiles && slot < profiles->slots; ++slot) {
+        lock_profile_t *this = atomic_load_explicit(&profiles->profiles[slot],
+            memory_order_relaxed);
+
+        if (NULL == this ||
+            ! in_ranges((const char *)atomic_load_explicit(&this->key,
+                            memory_order_acquire), ranges, count)) {
+            continue;
+        }
+
+        unsigned long holds = 0;
+        for (int idx = 0; idx < LOCK_HISTOGRAM_BINS; ++idx) {
+            holds += this->hold_histogram[idx];
+        }
+
+        fprintf(stderr, "  %s: %lu acquisitions, %lu contended (%.2lf%%)\n",
+            pool_lock_names[this->lock], this->acquisitions, this->contended,
+            (0 == this->acquisitions)
+                ? 0.0
+                : 100.0 * this->contended / this->acquisitions);
+        print_histogram("wait", this->wait_histogram,
+            this->contended, this->wait_ns);
+        print_histogram("hold", this->hold_histogram, holds, this->hold_ns);
+
+        // The pool is going away, free the slot for the mutexes of the next
+        // one.
+        memset((char *)this + offsetof(lock_profile_t, lock), 0,
+            sizeof(lock_profile_t) - offsetof(lock_profile_t, lock));
+        atomic_store_explicit(&this->key, FREED, memory_order_release);
+    }
+
+    pthread_mutex_unlock(&table_mutex);
+
+    // Counted for the whole process, since which pool they belong to is not
+    // known.
+    unsigned long missed = atomic_exchange(&unprofiled, 0);
+
+    if (0 != missed) {
+        fprintf(stderr, "  %lu acquisitions of locks not profiled, more than "
+            "%d locks\n", missed, LOCK_PROFILE_MAX_SLOTS / 2);
+    }
+}
+
+#endif /* THREAD_POOL_LOCK_PROFILE */
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef THREAD_POOL_LOCK_H_
+#define THREAD_POOL_LOCK_H_
+
+#include <time.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define LOCK_PROFILE_MIN_SLOTS 64
+#define LOCK_PROFILE_MAX_SLOTS (1 << 16)
+#define LOCK_HISTOGRAM_BINS  32
+
+
+// Description:
+//      The role a mutex plays in its thread pool. Used to name the lock in
+//      traces and lock profiles.
+typedef enum __POOL_LOCK_TAG__ {
+    LOCK_MUTEX = 0,
+    LOCK_POOL,
+    LOCK_QUEUE,
+
+} pool_lock_t;
+
+extern const char *pool_lock_names[];
+
+
+#if defined(THREAD_POOL_TRACE) || defined(THREAD_POOL_LOCK_PROFILE)
+
+// Description:
+//      Lock the mutex. With THREAD_POOL_TRACE, a wait for a contended mutex is
+//      recorded as a trace span. With THREAD_POOL_LOCK_PROFILE, the
+//      acquisition, whether it was contended and how long it waited are
+//      counted for the mutex.
+void pool_mutex_lock(pthread_mutex_t *mutex, const pool_lock_t lock);
+
+
+// Description:
+//      Unlock the mutex. With THREAD_POOL_LOCK_PROFILE, records how long the
+//      mutex was held.
+void pool_mutex_unlock(pthread_mutex_t *mutex);
+
+
+// Description:
+//      pthread_cond_wait() on a mutex locked with pool_mutex_lock(). The time
+//      spent waiting on the condition variable does not count as hold time.
+void pool_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+
+
+// Description:
+//      pthread_cond_timedwait() on a mutex locked with pool_mutex_lock().
+//
+// Return value:
+//      Return zero when signaled, or the error of pthread_cond_timedwait(),
+//      ETIMEDOUT if abstime has passed.
+int pool_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                        const struct timespec *abstime);
+
+#else
+
+static inline void pool_mutex_lock(pthread_mutex_t *mutex,
+                                   const pool_lock_t lock) {
+    pthread_mutex_lock(mutex);
+}
+
+static inline void pool_mutex_unlock(pthread_mutex_t *mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+static inline void pool_cond_wait(pthread_cond_t *cond,
+                                  pthread_mutex_t *mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+static inline int pool_cond_timedwait(pthread_cond_t *cond,
+                                      pthread_mutex_t *mutex,
+                                      const struct timespec *abstime) {
+    return pthread_cond_timedwait(cond, mutex, abstime);
+}
+
+#endif
+
+
+// Description:
+//      Memory holding mutexes of a thread pool, e.g. the pool itself or an
+//      array of its parts.
+typedef struct __LOCK_RANGE_TAG__ {
+    const void *begin;
+    size_t bytes;
+
+} lock_range_t;
+
+#ifdef THREAD_POOL_LOCK_PROFILE
+
+// Description:
+//      Print the profile of every mutex that lies within [pool, pool + bytes)
+//      to stderr and free its slot: acquisitions, contended acquisitions, and
+//      log2 histograms of wait and hold times. Called by thread_pool_destroy()
+//      after the worker threads have been joined, so the slots of a pool are
+//      reused by the next one.
+//
+// Note:
+//      The profile table grows with the number of mutexes, up to half of
+//      LOCK_PROFILE_MAX_SLOTS. Acquisitions of mutexes beyond that are
+//      counted, and reported as not profiled.
+void lock_profile_report(const void *pool, const size_t bytes);
+
+
+// Description:
+//      Same as lock_profile_report(), as one report for the mutexes in any of
+//      count ranges.
+//
+// Example:
+//      lock_range_t ranges[] = {
+//          { this, sizeof(thread_pool_t) },
+//          { this->groups, this->group_size * sizeof(work_group_t) },
+//      };
+//      lock_profile_report_ranges(ranges, 2);
+void lock_profile_report_ranges(const lock_range_t *ranges, const int count);
+
+#else
+
+static inline void lock_profile_report(const void *pool, const size_t bytes) {
+}
+
+static inline void lock_profile_report_ranges(const lock_range_t *ranges,
+                                              const int count) {
+}
+
+#endif /* THREAD_POOL_LOCK_PROFILE */
+
+
+#endif /* THREAD_POOL_LOCK_H_ */
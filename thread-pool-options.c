@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "thread-pool-options.h"
+
+int pool_attr_init(pthread_attr_t *attr, const thread_pool_options_t *options) {
+    if (NULL == attr) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 != pthread_attr_init(attr)) {
+        perror("pthread_attr_init");
+        return -1;
+    }
+
+    if (NULL == options) {
+        return 0;
+    }
+
+    if (0 != options->stack_size) {
+        size_t stack_size = (options->stack_size < PTHREAD_STACK_MIN)
+            ? PTHREAD_STACK_MIN
+            : options->stack_size;
+
+        if (0 != pthread_attr_setstacksize(attr, stack_size)) {
+            perror("pthread_attr_setstacksize");
+            pthread_attr_destroy(attr);
+            return -1;
+        }
+    }
+
+    if (0 != options->guard_size &&
+        0 != pthread_attr_setguardsize(attr, options->guard_size)) {
+        perror("pthread_attr_setguardsize");
+        pthread_attr_destroy(attr);
+        return -1;
+    }
+
+    return 0;
+}
+
+void pool_stack_prepare(const thread_pool_options_t *options) {
+    if (NULL == options || (! options->prefault && ! options->lock_memory)) {
+        return;
+    }
+
+    pthread_attr_t attr;
+    void *stack = NULL;
+    size_t stack_size = 0;
+
+    if (0 != pthread_getattr_np(pthread_self(), &attr)) {
+        return;
+    }
+
+    pthread_attr_getstack(&attr, &stack, &stack_size);
+    pthread_attr_destroy(&attr);
+
+    if (options->lock_memory && -1 == mlock(stack, stack_size)) {
+        perror("mlock");
+    }
+
+    if (options->prefault) {
+        // Only the part below the current frame is unused, leave a page of
+        // margin for the frames of this function and its callees.
+        long page = sysconf(_SC_PAGESIZE);
+        volatile char *low = stack;
+        volatile char *high = (volatile char *)
+            (((uintptr_t)__builtin_frame_address(0) - 2 * page) & ~(page - 1));
+
+        for (volatile char *addr = low; addr < high; addr += page) {
+            *addr = 0;
+        }
+    }
+}
+
+void pool_memory_prepare(const thread_pool_options_t *options,
+                         void *ptr, const size_t bytes) {
+    if (NULL == options || NULL == ptr) {
+        return;
+    }
+
+    if (options->lock_memory && -1 == mlock(ptr, bytes)) {
+        perror("mlock");
+    }
+
+    if (options->prefault) {
+        long page = sysconf(_SC_PAGESIZE);
+        volatile char *begin = ptr, *end = begin + bytes;
+
+        for (volatile char *addr = begin; addr < end; addr += page) {
+            *addr = *addr;
+        }
+
+        if (0 != bytes) {
+            end[-1] = end[-1];
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef THREAD_POOL_OPTIONS_H_
+#define THREAD_POOL_OPTIONS_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "thread-pool-qlock.h"
+
+
+// Description:
+//      Memory footprint of the worker threads, passed to thread_pool_init_ex().
+//      A zeroed struct, or a NULL pointer, keeps the defaults of the system.
+//
+// Attributes:
+//      stack_size:
+//          Stack size of each worker thread in bytes, or zero for the default
+//          (usually 8 MiB). Raised to PTHREAD_STACK_MIN if smaller.
+//      guard_size:
+//          Size of the guard area below each stack in bytes, or zero for the
+//          default of one page.
+//      prefault:
+//          Touch every page of the worker stacks and of the task queue up
+//          front, so that the first tasks do not take page faults.
+//      lock_memory:
+//          mlock() the worker stacks and the task queue, which also faults
+//          them in. Subject to RLIMIT_MEMLOCK, a failure is reported and
+//          otherwise ignored.
+//      segmented_queue:
+//          Queue tasks in a list of segments that grows with bursts instead
+//          of a fixed ring, so thread_pool_run() blocks only at the soft cap.
+//          Drained segments are recycled. Honored by variants whose header
+//          defines SEGMENTED_QUEUE, ignored by the others.
+//      queue_memory_cap:
+//          Soft cap on the memory of the segmented queue in bytes, or zero for
+//          no cap. Once reached, submitters fall back to the overload policy
+//          of the pool, blocking by default.
+//      fifo_wakeup:
+//          Hand a new task to the worker thread that has been idle the longest
+//          instead of the most recently idle one, spreading the work over all
+//          worker threads. Honored by variants whose header defines
+//          WAKE_ORDER. On a single CPU, the most recently idle worker thread
+//          tends to preempt the producer that woke it, which costs the
+//          throughput benchmark about a third at 4096 worker threads.
+//      pool_lock:
+//          The lock the worker threads compete for before they reach the task
+//          queue, see thread-pool-qlock.h. QLOCK_DEFAULT keeps the one chosen
+//          at compile time. Honored by the two-stage-mutex and work-group
+//          variants.
+typedef struct __THREAD_POOL_OPTIONS_TAG__ {
+    size_t stack_size;
+    size_t guard_size;
+    bool prefault;
+    bool lock_memory;
+    bool segmented_queue;
+    size_t queue_memory_cap;
+    bool fifo_wakeup;
+    qlock_kind_t pool_lock;
+
+} thread_pool_options_t;
+
+
+// Description:
+//      What thread_pool_shutdown() does with the tasks still queued.
+//
+// Values:
+//      SHUTDOWN_DRAIN:
+//          Run them before the worker threads exit, as thread_pool_destroy()
+//          does.
+//      SHUTDOWN_CANCEL:
+//          Discard them. Tasks already running finish either way.
+typedef enum __SHUTDOWN_MODE_TAG__ {
+    SHUTDOWN_DRAIN = 0,
+    SHUTDOWN_CANCEL,
+
+} shutdown_mode_t;
+
+
+// Description:
+//      Initialize attr for creating a worker thread with options, which may be
+//      NULL. Destroy it with pthread_attr_destroy().
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int pool_attr_init(pthread_attr_t *attr, const thread_pool_options_t *options);
+
+
+// Description:
+//      Prefault and/or lock the stack of the calling thread as requested by
+//      options. Called by each worker thread before it takes its first task.
+void pool_stack_prepare(const thread_pool_options_t *options);
+
+
+// Description:
+//      Prefault and/or lock [ptr, ptr + bytes) as requested by options. Called
+//      on memory that no other thread uses yet, e.g. the task queue before the
+//      worker threads are created.
+void pool_memory_prepare(const thread_pool_options_t *options,
+                         void *ptr, const size_t bytes);
+
+
+#endif /* THREAD_POOL_OPTIONS_H_ */
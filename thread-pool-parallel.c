@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "thread-pool-parallel.h"
+
+// Partials are kept a cache line apart, so participants do not false share.
+#define PARTIAL_ALIGN 64
+
+
+// Description:
+//      A loop shared by the calling thread and its helper tasks. Freed by the
+//      last one to let go of it, since helpers may start only after the loop
+//      has completed.
+//
+// Attributes:
+//      next:
+//          First index not claimed yet.
+//      done / total:
+//          Indices run so far, and in all. Guarded by mutex, the caller waits
+//          on finished until they are equal.
+//      slots:
+//          Partials handed out, one per participant that claimed a chunk.
+//      references:
+//          The caller and the helper tasks that have not returned yet.
+typedef struct __PARALLEL_TAG__ {
+    _Atomic long next;
+    long end;
+    long grain;
+    int participants;
+
+    void (*run)(long lo, long hi, void *ctx);
+    void (*map)(long lo, long hi, void *partial, void *ctx);
+    void (*combine)(void *result, const void *partial, void *ctx);
+    void *result;
+    const void *identity;
+    size_t size;
+    size_t stride;
+    void *ctx;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t finished;
+    long done;
+    long total;
+    _Atomic int slots;
+    _Atomic int references;
+
+    // Starts on a cache line of its own, after the shared fields.
+    char partials[] __attribute__((aligned(PARTIAL_ALIGN)));
+
+} parallel_t;
+
+static bool claim(parallel_t *this, long *lo, long *hi) {
+    long first = atomic_load_explicit(&this->next, memory_order_relaxed);
+    long last;
+
+    do {
+        if (first >= this->end) {
+            return false;
+        }
+
+        long chunk = (this->end - first) / (2 * this->participants);
+        chunk = (chunk < this->grain) ? this->grain : chunk;
+        last = (this->end - first <= chunk) ? this->end : first + chunk;
+    } while (! atomic_compare_exchange_weak_explicit(&this->next, &first, last,
+                 memory_order_relaxed, memory_order_relaxed));
+
+    *lo = first;
+    *hi = last;
+
+    return true;
+}
+
+static void participate(parallel_t *this) {
+    void *partial = NULL;
+    long lo, hi, count = 0;
+
+    while (claim(this, &lo, &hi)) {
+        if (NULL == this->map) {
+            this->run(lo, hi, this->ctx);
+        } else {
+            if (NULL == partial) {
+                int slot = atomic_fetch_add(&this->slots, 1);
+                partial = this->partials + slot * this->stride;
+                memcpy(partial, this->identity, this->size);
+            }
+
+            this->map(lo, hi, partial, this->ctx);
+        }
+
+        count += hi - lo;
+    }
+
+    if (0 == count) {
+        return;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (NULL != partial) {
+        this->combine(this->result, partial, this->ctx);
+    }
+
+    this->done += count;
+
+    if (this->done == this->total) {
+        pthread_cond_signal(&this->finished);
+    }
+
+    pthread_mutex_unlock(&this->mutex);
+}
+
+static void release(parallel_t *this) {
+    if (1 == atomic_fetch_sub(&this->references, 1)) {
+        pthread_cond_destroy(&this->finished);
+        pthread_mutex_destroy(&this->mutex);
+        free(this);
+    }
+}
+
+static void help(void *args) {
+    participate(args);
+    release(args);
+}
+
+static int parallel(thread_pool_t *pool, const long begin, const long end,
+                    const long grain, void (*run)(long, long, void *),
+                    void (*map)(long, long, void *, void *),
+                    void (*combine)(void *, const void *, void *),
+                    void *result, const void *identity, const size_t size,
+                    void *ctx) {
+    if (begin >= end) {
+        return 0;
+    }
+
+    long step = (0 < grain) ? grain : 1;
+    long chunks = (end - begin + step - 1) / step;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int participants = (0 < cores && cores < chunks) ? cores : chunks;
+    participants = (0 < participants) ? participants : 1;
+
+    size_t stride = (NULL == map)
+        ? 0
+        : (size + PARTIAL_ALIGN - 1) & ~(size_t)(PARTIAL_ALIGN - 1);
+    parallel_t *this = aligned_alloc(PARTIAL_ALIGN,
+        (sizeof(parallel_t) + participants * stride + PARTIAL_ALIGN - 1) &
+        ~(size_t)(PARTIAL_ALIGN - 1));
+
+    if (NULL == this) {
+        perror("aligned_alloc");
+        return -1;
+    }
+
+    atomic_init(&this->next, begin);
+    this->end = end;
+    this->grain = step;
+    this->participants = participants;
+    this->run = run;
+    this->map = map;
+    this->combine = combine;
+    this->result = result;
+    this->identity = identity;
+    this->size = size;
+    this->stride = stride;
+    this->ctx = ctx;
+    this->done = 0;
+    this->total = end - begin;
+    atomic_init(&this->slots, 0);
+    atomic_init(&this->references, participants);
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->finished, NULL);
+
+    // The calling thread is a participant too, it does not wait idly for the
+    // helpers.
+    for (int idx = 1; idx < participants; ++idx) {
+        if (-1 == thread_pool_run(pool, &help, this)) {
+            release(this);
+        }
+    }
+
+    participate(this);
+
+    pthread_mutex_lock(&this->mutex);
+
+    while (this->done != this->total) {
+        pthread_cond_wait(&this->finished, &this->mutex);
+    }
+
+    pthread_mutex_unlock(&this->mutex);
+    release(this);
+
+    return 0;
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_parallel_for(thread_pool_t *pool, const long begin,
+                             const long end, const long grain,
+                             void (*run)(long lo, long hi, void *ctx),
+                             void *ctx) {
+    if (NULL == pool || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    return parallel(pool, begin, end, grain, run, NULL, NULL, NULL, NULL, 0,
+        ctx);
+}
+
+int thread_pool_parallel_reduce(thread_pool_t *pool, const long begin,
+                                const long end, const long grain,
+                                void (*map)(long lo, long hi, void *partial,
+                                            void *ctx),
+                                void (*combine)(void *result,
+                                                const void *partial,
+                                                void *ctx),
+                                void *result, const void *identity,
+                                const size_t size, void *ctx) {
+    if (NULL == pool || NULL == map || NULL == combine || NULL == result ||
+        NULL == identity) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    return parallel(pool, begin, end, grain, NULL, map, combine, result,
+        identity, size, ctx);
+}
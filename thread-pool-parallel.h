@@ -0,0 +1,69 @@
+#ifndef THREAD_POOL_PARALLEL_H_
+#define THREAD_POOL_PARALLEL_H_
+
+#include <stddef.h>
+
+#include IMPL
+
+
+// Description:
+//      Call run(lo, hi, ctx) over disjoint chunks [lo, hi) that together cover
+//      [begin, end), in parallel. The calling thread works on chunks as well
+//      and returns once every chunk has been run.
+//
+//      One helper task per core is enqueued, fewer if there are not enough
+//      chunks. Participants claim chunks of remaining / (2 * participants)
+//      indices, but at least grain, off a shared counter, so the chunks are
+//      large while there is a lot left and shrink towards the end to balance
+//      the load. Enqueued tasks are O(cores), not O(end - begin).
+//
+// Example:
+//      void scale(long lo, long hi, void *ctx) {
+//          for (long idx = lo; idx < hi; ++idx) vector[idx] *= 2;
+//      }
+//      thread_pool_parallel_for(&thrpool, 0, length, 1024, &scale, NULL);
+//
+// Note:
+//      May be called from a task. Should no worker thread be free, the
+//      calling thread runs every chunk itself.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_parallel_for(thread_pool_t *pool, const long begin,
+                             const long end, const long grain,
+                             void (*run)(long lo, long hi, void *ctx),
+                             void *ctx);
+
+
+// Description:
+//      Like thread_pool_parallel_for(), but every participant accumulates into
+//      a partial of size bytes of its own, initialized from identity, with
+//      map(lo, hi, partial, ctx). The partials are folded into result with
+//      combine(result, partial, ctx), one at a time, so combine needs no
+//      synchronization.
+//
+// Example:
+//      void sum(long lo, long hi, void *partial, void *ctx) {
+//          for (long idx = lo; idx < hi; ++idx) *(long *)partial += vector[idx];
+//      }
+//      void add(void *result, const void *partial, void *ctx) {
+//          *(long *)result += *(const long *)partial;
+//      }
+//      long total = 0, zero = 0;
+//      thread_pool_parallel_reduce(&thrpool, 0, length, 1024, &sum, &add,
+//          &total, &zero, sizeof(long), NULL);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_parallel_reduce(thread_pool_t *pool, const long begin,
+                                const long end, const long grain,
+                                void (*map)(long lo, long hi, void *partial,
+                                            void *ctx),
+                                void (*combine)(void *result,
+                                                const void *partial,
+                                                void *ctx),
+                                void *result, const void *identity,
+                                const size_t size, void *ctx);
+
+
+#endif /* THREAD_POOL_PARALLEL_H_ */
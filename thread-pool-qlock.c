@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "thread-pool-qlock.h"
+
+#define QLOCK_GRANTED  0
+#define QLOCK_WAITING  1
+#define QLOCK_SLEEPING 2
+
+static void futex_wait(_Atomic unsigned int *word, const unsigned int value) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic unsigned int *word, const int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Waiters of a ticket lock sleeping on the same word are told apart by the
+// round of their ticket, so a release wakes only the next one in most cases.
+static unsigned int ticket_bit(const unsigned int ticket) {
+    return 1u << ((ticket / QLOCK_TICKET_SLOTS) % 32);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void ticket_acquire(qlock_t *this) {
+    unsigned int ticket = atomic_fetch_add_explicit(&this->next_ticket, 1,
+        memory_order_relaxed);
+    qlock_slot_t *slot = &this->slots[ticket % QLOCK_TICKET_SLOTS];
+
+    for (int spin = 0; spin < this->spin; ++spin) {
+        if (ticket == atomic_load_explicit(&slot->granted,
+                                           memory_order_acquire)) {
+            this->owner = ticket;
+            return;
+        }
+
+        cpu_relax();
+    }
+
+    atomic_fetch_add(&slot->sleepers, 1);
+
+    while (1) {
+        unsigned int granted = atomic_load(&slot->granted);
+
+        if (ticket == granted) {
+            break;
+        }
+
+        syscall(SYS_futex, &slot->granted, FUTEX_WAIT_BITSET_PRIVATE, granted,
+            NULL, NULL, ticket_bit(ticket));
+    }
+
+    atomic_fetch_sub(&slot->sleepers, 1);
+    this->owner = ticket;
+}
+
+static void ticket_release(qlock_t *this) {
+    unsigned int next = this->owner + 1;
+    qlock_slot_t *slot = &this->slots[next % QLOCK_TICKET_SLOTS];
+
+    atomic_store(&slot->granted, next);
+
+    // Tickets a multiple of 32 rounds apart share a bit, all of them check
+    // whose turn it is.
+    if (0 != atomic_load(&slot->sleepers)) {
+        syscall(SYS_futex, &slot->granted, FUTEX_WAKE_BITSET_PRIVATE, INT_MAX,
+            NULL, NULL, ticket_bit(next));
+    }
+}
+
+static void mcs_acquire(qlock_t *this, qlock_node_t *node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->state, QLOCK_WAITING, memory_order_relaxed);
+
+    qlock_node_t *prev = atomic_exchange_explicit(&this->tail, node,
+        memory_order_acq_rel);
+
+    if (NULL == prev) {
+        return;
+    }
+
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+
+    for (int spin = 0; spin < this->spin; ++spin) {
+        if (QLOCK_GRANTED == atomic_load_explicit(&node->state,
+                                                  memory_order_acquire)) {
+            return;
+        }
+
+        cpu_relax();
+    }
+
+    unsigned int state = QLOCK_WAITING;
+
+    if (atomic_compare_exchange_strong(&node->state, &state,
+                                       QLOCK_SLEEPING)) {
+        do {
+            futex_wait(&node->state, QLOCK_SLEEPING);
+        } while (QLOCK_GRANTED != atomic_load_explicit(&node->state,
+                                                       memory_order_acquire));
+    }
+}
+
+static void mcs_release(qlock_t *this, qlock_node_t *node) {
+    qlock_node_t *next = atomic_load_explicit(&node->next,
+        memory_order_acquire);
+
+    if (NULL == next) {
+        qlock_node_t *expected = node;
+
+        if (atomic_compare_exchange_strong_explicit(&this->tail, &expected,
+                NULL, memory_order_release, memory_order_relaxed)) {
+            return;
+        }
+
+        // A waiter has swapped itself in as the tail, but not linked itself
+        // to this node yet.
+        while (NULL == (next = atomic_load_explicit(&node->next,
+                                                    memory_order_acquire))) {
+            cpu_relax();
+        }
+    }
+
+    if (QLOCK_SLEEPING == atomic_exchange_explicit(&next->state,
+                                                   QLOCK_GRANTED,
+                                                   memory_order_release)) {
+        futex_wake(&next->state, 1);
+    }
+}
+
+
+/* ************************************************************************** */
+
+
+int qlock_init(qlock_t *this, qlock_kind_t kind) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    this->kind = (QLOCK_DEFAULT == kind) ? QLOCK_DEFAULT_KIND : kind;
+    this->spin = (1 < sysconf(_SC_NPROCESSORS_ONLN)) ? QLOCK_SPIN : 0;
+    atomic_init(&this->next_ticket, 0);
+    this->owner = 0;
+
+    // The first ticket mapping to each word is its index, so none but the
+    // first word starts out granted.
+    for (int idx = 0; idx < QLOCK_TICKET_SLOTS; ++idx) {
+        atomic_init(&this->slots[idx].granted, idx - QLOCK_TICKET_SLOTS);
+        atomic_init(&this->slots[idx].sleepers, 0);
+    }
+
+    atomic_init(&this->slots[0].granted, 0);
+    atomic_init(&this->tail, NULL);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, (QLOCK_ADAPTIVE == this->kind)
+        ? PTHREAD_MUTEX_ADAPTIVE_NP
+        : PTHREAD_MUTEX_TIMED_NP);
+
+    if (0 != pthread_mutex_init(&this->mutex, &attr)) {
+        perror("pthread_mutex_init");
+        pthread_mutexattr_destroy(&attr);
+        return -1;
+    }
+
+    pthread_mutexattr_destroy(&attr);
+
+    return 0;
+}
+
+void qlock_acquire(qlock_t *this, qlock_node_t *node, const pool_lock_t role) {
+    switch (this->kind) {
+        case QLOCK_TICKET:
+            ticket_acquire(this);
+            break;
+
+        case QLOCK_MCS:
+            mcs_acquire(this, node);
+            break;
+
+        default:
+            pool_mutex_lock(&this->mutex, role);
+            break;
+    }
+}
+
+void qlock_release(qlock_t *this, qlock_node_t *node) {
+    switch (this->kind) {
+        case QLOCK_TICKET:
+            ticket_release(this);
+            break;
+
+        case QLOCK_MCS:
+            mcs_release(this, node);
+            break;
+
+        default:
+            pool_mutex_unlock(&this->mutex);
+            break;
+    }
+}
+
+void qlock_destroy(qlock_t *this) {
+    pthread_mutex_destroy(&this->mutex);
+}
@@ -0,0 +1,144 @@
+#ifndef THREAD_POOL_QLOCK_H_
+#define THREAD_POOL_QLOCK_H_
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "thread-pool-lock.h"
+
+// Build with e.g. 'make QLOCK=MCS' to change the lock used when the options
+// leave it at QLOCK_DEFAULT.
+#ifndef QLOCK_DEFAULT_KIND
+#define QLOCK_DEFAULT_KIND QLOCK_MUTEX
+#endif
+
+// Iterations a waiter spins on its word before it sleeps on it, unless there is
+// a single CPU and the holder cannot run meanwhile.
+#define QLOCK_SPIN 128
+
+// Words the waiters of a ticket lock are spread over, by their ticket.
+#define QLOCK_TICKET_SLOTS 64
+
+
+// Description:
+//      The lock behind a pool-entry mutex, such as mutex_for_pool, which
+//      hundreds of worker threads take at a high rate.
+//
+// Values:
+//      QLOCK_DEFAULT:
+//          QLOCK_DEFAULT_KIND, as set at compile time.
+//      QLOCK_MUTEX:
+//          A plain pthread mutex, PTHREAD_MUTEX_TIMED_NP.
+//      QLOCK_ADAPTIVE:
+//          A pthread mutex that spins a little before it sleeps,
+//          PTHREAD_MUTEX_ADAPTIVE_NP.
+//      QLOCK_TICKET:
+//          A FIFO ticket lock. Waiters spin on one of QLOCK_TICKET_SLOTS
+//          words, picked by their ticket, then sleep on it, so a release
+//          wakes the next waiter rather than all of them.
+//      QLOCK_MCS:
+//          A FIFO queue lock. Each waiter spins on a word in its own cache
+//          line, then sleeps on it, and the holder hands the lock to its
+//          successor directly.
+typedef enum __QLOCK_KIND_TAG__ {
+    QLOCK_DEFAULT = 0,
+    QLOCK_MUTEX,
+    QLOCK_ADAPTIVE,
+    QLOCK_TICKET,
+    QLOCK_MCS,
+
+} qlock_kind_t;
+
+
+// Description:
+//      A waiter of an MCS lock. Each thread passes its own node, e.g. on its
+//      stack, to qlock_acquire() and the matching qlock_release(). Other
+//      kinds of lock ignore it.
+//
+// Attributes:
+//      next:
+//          The waiter queued behind this one.
+//      state:
+//          QLOCK_WAITING while spinning, QLOCK_SLEEPING once asleep on the
+//          word, QLOCK_GRANTED once the predecessor has handed the lock over.
+typedef struct __QLOCK_NODE_TAG__ {
+    _Atomic(struct __QLOCK_NODE_TAG__ *) next;
+    _Atomic unsigned int state;
+
+} __attribute__((aligned(64))) qlock_node_t;
+
+
+// Description:
+//      A word the waiters of a ticket lock spin and sleep on.
+//
+// Attributes:
+//      granted:
+//          The last ticket mapping to this word that was granted the lock.
+//      sleepers:
+//          Waiters asleep on granted.
+typedef struct __QLOCK_SLOT_TAG__ {
+    _Atomic unsigned int granted;
+    _Atomic unsigned int sleepers;
+
+} __attribute__((aligned(64))) qlock_slot_t;
+
+
+// Description:
+//      A lock of the kind chosen at init. The words written by waiters and by
+//      the holder lie in separate cache lines.
+//
+// Attributes:
+//      spin:
+//          Iterations a waiter of QLOCK_TICKET or QLOCK_MCS spins.
+//      mutex:
+//          QLOCK_MUTEX and QLOCK_ADAPTIVE.
+//      next_ticket / owner / slots:
+//          QLOCK_TICKET. owner is the ticket of the holder, written by the
+//          holder only.
+//      tail:
+//          QLOCK_MCS, the last waiter in the queue, or the holder.
+typedef struct __QLOCK_TAG__ {
+    qlock_kind_t kind;
+    int spin;
+    pthread_mutex_t mutex;
+
+    _Atomic unsigned int next_ticket __attribute__((aligned(64)));
+    unsigned int owner __attribute__((aligned(64)));
+    qlock_slot_t slots[QLOCK_TICKET_SLOTS];
+
+    _Atomic(qlock_node_t *) tail __attribute__((aligned(64)));
+
+} qlock_t;
+
+
+// Description:
+//      Initialize the lock as kind, or QLOCK_DEFAULT_KIND if kind is
+//      QLOCK_DEFAULT.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int qlock_init(qlock_t *this, qlock_kind_t kind);
+
+
+// Description:
+//      Acquire the lock, queuing node behind earlier waiters where the kind
+//      of lock is FIFO. role names the lock in traces and lock profiles of
+//      the pthread mutex kinds.
+//
+// Example:
+//      qlock_node_t node;
+//      qlock_acquire(&this->mutex_for_pool, &node, LOCK_POOL);
+//      ...
+//      qlock_release(&this->mutex_for_pool, &node);
+void qlock_acquire(qlock_t *this, qlock_node_t *node, const pool_lock_t role);
+
+
+// Description:
+//      Release the lock, handing it to the next waiter in line if any.
+void qlock_release(qlock_t *this, qlock_node_t *node);
+
+
+void qlock_destroy(qlock_t *this);
+
+
+#endif /* THREAD_POOL_QLOCK_H_ */
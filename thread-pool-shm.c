@@ -0,0 +1,474 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "thread-pool-shm.h"
+#include "thread-pool-trace.h"
+
+// A client waiting for space looks at live this often, in case the pool
+// process went away.
+#define SHM_POLL_NS 100000000L
+
+// Set in running by thread_pool_shm_server_destroy(), once the dispatcher has
+// stopped handing out records.
+#define SHM_STOPPING (1u << 31)
+
+// Not FUTEX_*_PRIVATE, the words are shared between processes.
+static void futex_wait(_Atomic unsigned int *word, const unsigned int value,
+                       const struct timespec *timeout) {
+    syscall(SYS_futex, word, FUTEX_WAIT, value, timeout, NULL, 0);
+}
+
+static void futex_wake(_Atomic unsigned int *word, const int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+static int ring_push(shm_ring_t *this, const unsigned int id,
+                     const void *payload, const size_t length) {
+    unsigned long pos = atomic_load_explicit(&this->enqueue_pos,
+        memory_order_relaxed);
+    shm_record_t *record;
+
+    while (1) {
+        record = &this->records[pos & (this->capacity - 1)];
+        long diff = (long)(atomic_load_explicit(&record->sequence,
+                                                memory_order_acquire) - pos);
+
+        if (0 == diff) {
+            if (atomic_compare_exchange_weak_explicit(&this->enqueue_pos,
+                    &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (0 > diff) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&this->enqueue_pos,
+                memory_order_relaxed);
+        }
+    }
+
+    record->handler = id;
+    record->length = length;
+    memcpy(record->payload, payload, length);
+    atomic_store_explicit(&record->sequence, pos + 1, memory_order_release);
+
+    return 0;
+}
+
+// Only the dispatcher thread drains the ring. The record stays taken until
+// ring_release(), so the handler can read the payload in place.
+static shm_record_t *ring_pop(shm_ring_t *this) {
+    unsigned long pos = atomic_load_explicit(&this->dequeue_pos,
+        memory_order_relaxed);
+    shm_record_t *record = &this->records[pos & (this->capacity - 1)];
+
+    if (pos + 1 != atomic_load_explicit(&record->sequence,
+                                        memory_order_acquire)) {
+        return NULL;
+    }
+
+    atomic_store_explicit(&this->dequeue_pos, pos + 1, memory_order_relaxed);
+
+    return record;
+}
+
+// Hand the record back to the clients, for the position capacity further.
+static void ring_release(shm_ring_t *this, shm_record_t *record) {
+    unsigned long sequence = atomic_load_explicit(&record->sequence,
+        memory_order_relaxed);
+
+    atomic_store_explicit(&record->sequence, sequence - 1 + this->capacity,
+        memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (0 < atomic_load_explicit(&this->space_waiters, memory_order_relaxed)) {
+        atomic_fetch_add(&this->space_word, 1);
+        futex_wake(&this->space_word, INT_MAX);
+    }
+}
+
+static void serve(void *args) {
+    shm_task_t *task = args;
+    thread_pool_shm_server_t *this = task->server;
+    shm_record_t *record = task->record;
+    _Atomic unsigned int *running = &this->running;
+
+    if (SHM_HANDLERS_MAX <= record->handler ||
+        NULL == this->handlers[record->handler] ||
+        SHM_PAYLOAD_MAX < record->length) {
+        atomic_fetch_add_explicit(&this->rejected, 1, memory_order_relaxed);
+    } else {
+        this->handlers[record->handler](this->contexts[record->handler],
+            record->payload, record->length);
+    }
+
+    ring_release(this->ring, record);
+
+    // The decrement is the last access to the server: once running drops to
+    // SHM_STOPPING, thread_pool_shm_server_destroy() may return. The wake only
+    // names the address, and futex waiters put up with spurious wakeups.
+    if ((SHM_STOPPING | 1) == atomic_fetch_sub(running, 1)) {
+        futex_wake(running, 1);
+    }
+}
+
+// Whether the segment name was left behind by a pool process that is gone.
+// One still being set up, or served by a live pool process, is not.
+static bool is_stale(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (-1 == fd) {
+        return false;
+    }
+
+    struct stat st;
+    shm_ring_t *ring = MAP_FAILED;
+
+    if (0 == fstat(fd, &st) && sizeof(shm_ring_t) <= (size_t)st.st_size) {
+        ring = mmap(NULL, sizeof(shm_ring_t), PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    close(fd);
+
+    if (MAP_FAILED == ring) {
+        return false;
+    }
+
+    bool stale = SHM_RING_MAGIC == ring->magic && -1 == kill(ring->owner, 0) &&
+                 ESRCH == errno;
+    munmap(ring, sizeof(shm_ring_t));
+
+    return stale;
+}
+
+static void *dispatch_routine(void *args) {
+    thread_pool_shm_server_t *this = args;
+    shm_ring_t *ring = this->ring;
+
+    trace_thread_name("shm-dispatcher");
+
+    while (1) {
+        shm_record_t *record = ring_pop(ring);
+
+        if (NULL == record) {
+            if (atomic_load(&this->stopping)) {
+                break;
+            }
+
+            // A client that fills the ring after the last look sees the flag
+            // and bumps task_word, so the wait returns at once.
+            unsigned int word = atomic_load(&ring->task_word);
+            atomic_store(&ring->dispatcher_sleeping, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+
+            if (NULL == (record = ring_pop(ring)) &&
+                ! atomic_load(&this->stopping)) {
+                futex_wait(&ring->task_word, word, NULL);
+            }
+
+            atomic_store(&ring->dispatcher_sleeping, 0);
+
+            if (NULL == record) {
+                continue;
+            }
+        }
+
+        shm_task_t *task = &this->tasks[record - ring->records];
+        atomic_fetch_add(&this->running, 1);
+
+        if (-1 == thread_pool_run(this->pool, &serve, task)) {
+            serve(task);
+        }
+    }
+
+    return NULL;
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_shm_server_init(thread_pool_shm_server_t *this,
+                                thread_pool_t *pool, const char *name,
+                                const unsigned int capacity) {
+    if (NULL == this || NULL == pool || NULL == name) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (SHM_NAME_MAX <= strlen(name)) {
+        fprintf(stderr, "Invalid name of shared memory.\n");
+        return -1;
+    }
+
+    if (0 == capacity || (1u << 31) < capacity) {
+        fprintf(stderr, "Invalid capacity of shared memory ring.\n");
+        return -1;
+    }
+
+    memset(this, 0, sizeof(thread_pool_shm_server_t));
+    this->pool = pool;
+    strcpy(this->name, name);
+
+    unsigned int size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    this->bytes = sizeof(shm_ring_t) + size * sizeof(shm_record_t);
+    this->tasks = malloc(size * sizeof(shm_task_t));
+    if (NULL == this->tasks) {
+        perror("malloc");
+        return -1;
+    }
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+
+    // A segment left behind by a crashed pool process is replaced, the one of
+    // a live pool process is not.
+    if (-1 == fd && EEXIST == errno) {
+        if (is_stale(name)) {
+            shm_unlink(name);
+            fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        } else {
+            errno = EEXIST;
+        }
+    }
+
+    if (-1 == fd) {
+        int error = errno;
+        perror("shm_open");
+        free(this->tasks);
+        errno = error;
+        return -1;
+    }
+
+    if (-1 == ftruncate(fd, this->bytes)) {
+        perror("ftruncate");
+        close(fd);
+        goto Error;
+    }
+
+    this->ring = mmap(NULL, this->bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == this->ring) {
+        perror("mmap");
+        this->ring = NULL;
+        goto Error;
+    }
+
+    // The segment is zero-filled. Publish magic last, so a client never
+    // attaches to a partial layout.
+    shm_ring_t *ring = this->ring;
+    ring->capacity = size;
+    ring->owner = getpid();
+
+    for (unsigned int idx = 0; idx < size; ++idx) {
+        atomic_init(&ring->records[idx].sequence, idx);
+        this->tasks[idx].server = this;
+        this->tasks[idx].record = &ring->records[idx];
+    }
+
+    atomic_store(&ring->live, true);
+    atomic_thread_fence(memory_order_release);
+    ring->magic = SHM_RING_MAGIC;
+
+    if (0 != pthread_create(&this->dispatcher, NULL, &dispatch_routine,
+                            this)) {
+        perror("pthread_create");
+        goto Error;
+    }
+
+    return 0;
+
+Error:
+    if (NULL != this->ring) {
+        munmap(this->ring, this->bytes);
+    }
+
+    shm_unlink(name);
+    free(this->tasks);
+
+    return -1;
+}
+
+int thread_pool_shm_register(thread_pool_shm_server_t *this,
+                             const unsigned int id, shm_handler_t run,
+                             void *ctx) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (SHM_HANDLERS_MAX <= id) {
+        fprintf(stderr, "Invalid handler id.\n");
+        return -1;
+    }
+
+    this->contexts[id] = ctx;
+    this->handlers[id] = run;
+
+    return 0;
+}
+
+int thread_pool_shm_server_destroy(thread_pool_shm_server_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    shm_ring_t *ring = this->ring;
+
+    // New clients are turned away. The dispatcher drains the ring and exits.
+    atomic_store(&ring->live, false);
+    atomic_store(&this->stopping, true);
+    atomic_fetch_add(&ring->task_word, 1);
+    futex_wake(&ring->task_word, 1);
+
+    if (0 != pthread_join(this->dispatcher, NULL)) {
+        perror("pthread_join");
+        return -1;
+    }
+
+    atomic_fetch_or(&this->running, SHM_STOPPING);
+
+    unsigned int running;
+    while (SHM_STOPPING != (running = atomic_load(&this->running))) {
+        futex_wait(&this->running, running, NULL);
+    }
+
+    // Wake clients waiting for space, they find the ring no longer live.
+    atomic_fetch_add(&ring->space_word, 1);
+    futex_wake(&ring->space_word, INT_MAX);
+
+    munmap(ring, this->bytes);
+    shm_unlink(this->name);
+    free(this->tasks);
+
+    return 0;
+}
+
+int thread_pool_shm_client_open(thread_pool_shm_client_t *this,
+                                const char *name) {
+    if (NULL == this || NULL == name) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (-1 == fd) {
+        perror("shm_open");
+        return -1;
+    }
+
+    struct stat st;
+    if (-1 == fstat(fd, &st)) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+
+    this->bytes = st.st_size;
+    this->ring = mmap(NULL, this->bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == this->ring) {
+        perror("mmap");
+        return -1;
+    }
+
+    if (sizeof(shm_ring_t) > this->bytes ||
+        SHM_RING_MAGIC != this->ring->magic ||
+        sizeof(shm_ring_t) + this->ring->capacity * sizeof(shm_record_t) !=
+            this->bytes) {
+        fprintf(stderr, "Invalid shared memory ring.\n");
+        munmap(this->ring, this->bytes);
+        return -1;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+
+    return 0;
+}
+
+int thread_pool_shm_submit(thread_pool_shm_client_t *this,
+                           const unsigned int id, const void *payload,
+                           const size_t length) {
+    if (NULL == this || (NULL == payload && 0 != length)) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (SHM_PAYLOAD_MAX < length) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    shm_ring_t *ring = this->ring;
+
+    while (-1 == ring_push(ring, id, payload, length)) {
+        if (! atomic_load(&ring->live)) {
+            errno = ECONNREFUSED;
+            return -1;
+        }
+
+        // The pool process frees a record after the last look and bumps
+        // space_word, so the wait returns at once.
+        unsigned int word = atomic_load(&ring->space_word);
+        atomic_fetch_add(&ring->space_waiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (-1 == ring_push(ring, id, payload, length)) {
+            struct timespec timeout = { 0, SHM_POLL_NS };
+            futex_wait(&ring->space_word, word, &timeout);
+            atomic_fetch_sub(&ring->space_waiters, 1);
+            continue;
+        }
+
+        atomic_fetch_sub(&ring->space_waiters, 1);
+        break;
+    }
+
+    if (! atomic_load(&ring->live)) {
+        // The dispatcher may or may not have drained the record before it
+        // stopped, so the task may or may not run.
+        errno = ECONNREFUSED;
+        return -1;
+    }
+
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&ring->dispatcher_sleeping,
+                             memory_order_relaxed)) {
+        atomic_fetch_add(&ring->task_word, 1);
+        futex_wake(&ring->task_word, 1);
+    }
+
+    return 0;
+}
+
+int thread_pool_shm_client_close(thread_pool_shm_client_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (-1 == munmap(this->ring, this->bytes)) {
+        perror("munmap");
+        return -1;
+    }
+
+    return 0;
+}
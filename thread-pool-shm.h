@@ -0,0 +1,217 @@
+#ifndef THREAD_POOL_SHM_H_
+#define THREAD_POOL_SHM_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include IMPL
+
+#define SHM_RING_MAGIC   0x474e495250505448UL
+#define SHM_NAME_MAX     64
+#define SHM_HANDLERS_MAX 256
+#define SHM_RECORD_SIZE  128
+#define SHM_PAYLOAD_MAX  (SHM_RECORD_SIZE - 16)
+
+
+// Description:
+//      A task submitted by a client process, in the shared segment.
+//
+// Attributes:
+//      sequence:
+//          Tells whether the record is free for, or holds a task of, the
+//          position of the ring it is reached at.
+//      handler:
+//          Index into the handler table of the pool process.
+//      length / payload:
+//          Copied in by the client, handed to the handler in place.
+typedef struct __SHM_RECORD_TAG__ {
+    _Atomic unsigned long sequence;
+    unsigned int handler;
+    unsigned int length;
+    char payload[SHM_PAYLOAD_MAX];
+
+} __attribute__((aligned(64))) shm_record_t;
+
+
+// Description:
+//      The shared segment: a bounded lock-free queue of records, filled by any
+//      number of client processes and drained by the pool process. Sleepers
+//      wait on process-shared futex words.
+//
+// Attributes:
+//      magic / capacity:
+//          Checked by clients, capacity is a power of two.
+//      owner:
+//          The pool process serving the segment.
+//      live:
+//          Cleared when the pool process stops taking tasks.
+//      dispatcher_sleeping / task_word:
+//          The dispatcher thread of the pool process sleeps on task_word while
+//          the ring is empty. A client bumps it if the dispatcher sleeps.
+//      space_waiters / space_word:
+//          Clients sleep on space_word while the ring is full. The pool
+//          process bumps it as it frees records.
+//      enqueue_pos / dequeue_pos:
+//          Next position to fill and to drain.
+typedef struct __SHM_RING_TAG__ {
+    unsigned long magic;
+    unsigned int capacity;
+    pid_t owner;
+    _Atomic bool live;
+
+    _Atomic unsigned int dispatcher_sleeping;
+    _Atomic unsigned int task_word;
+    _Atomic unsigned int space_waiters;
+    _Atomic unsigned int space_word;
+
+    _Atomic unsigned long enqueue_pos __attribute__((aligned(64)));
+    _Atomic unsigned long dequeue_pos __attribute__((aligned(64)));
+
+    shm_record_t records[];
+
+} shm_ring_t;
+
+
+// Description:
+//      Runs a task of a client process: payload holds the length bytes the
+//      client submitted, and is only valid during the call.
+typedef void (*shm_handler_t)(void *ctx, const void *payload,
+                              const size_t length);
+
+
+// Description:
+//      A record handed to the thread pool, one per record of the ring.
+typedef struct __SHM_TASK_TAG__ {
+    struct __THREAD_POOL_SHM_SERVER_TAG__ *server;
+    shm_record_t *record;
+
+} shm_task_t;
+
+
+// Description:
+//      The pool process side. One pool per machine serves the client
+//      processes instead of a pool in each of them.
+//
+// Attributes:
+//      pool:
+//          Runs the tasks.
+//      ring / bytes / name:
+//          The shared segment.
+//      tasks:
+//          The tasks handed to the pool, indexed like the records.
+//      handlers / contexts:
+//          The handler table, indexed by the handler id of a record.
+//      dispatcher:
+//          Hands records to the pool, sleeps while the ring is empty.
+//      stopping:
+//          Set by thread_pool_shm_server_destroy().
+//      running:
+//          Records handed to the pool and not finished yet. Its top bit is set
+//          by thread_pool_shm_server_destroy() once the dispatcher has
+//          stopped, so the last record to finish knows to wake it.
+//      rejected:
+//          Records naming a handler that is not registered, dropped.
+typedef struct __THREAD_POOL_SHM_SERVER_TAG__ {
+    thread_pool_t *pool;
+    shm_ring_t *ring;
+    size_t bytes;
+    char name[SHM_NAME_MAX];
+    shm_task_t *tasks;
+
+    shm_handler_t handlers[SHM_HANDLERS_MAX];
+    void *contexts[SHM_HANDLERS_MAX];
+
+    pthread_t dispatcher;
+    _Atomic bool stopping;
+    _Atomic unsigned int running;
+    _Atomic unsigned long rejected;
+
+} thread_pool_shm_server_t;
+
+
+// Description:
+//      A client process's view of the shared segment.
+typedef struct __THREAD_POOL_SHM_CLIENT_TAG__ {
+    shm_ring_t *ring;
+    size_t bytes;
+
+} thread_pool_shm_client_t;
+
+
+// Description:
+//      Create the shared segment name with room for capacity records, rounded
+//      up to a power of two, and start serving it with pool. A segment of the
+//      same name left behind by a crashed pool process is replaced, while one
+//      served by a live pool process makes this fail with errno EEXIST.
+//
+// Example:
+//      thread_pool_shm_server_t server;
+//      thread_pool_shm_server_init(&server, &thrpool, "/thread-pool", 4096);
+//      thread_pool_shm_register(&server, 0, &resize_image, NULL);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_shm_server_init(thread_pool_shm_server_t *this,
+                                thread_pool_t *pool, const char *name,
+                                const unsigned int capacity);
+
+
+// Description:
+//      Let records naming handler id run run(ctx, payload, length). Register
+//      the handlers before the clients start submitting.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_shm_register(thread_pool_shm_server_t *this,
+                             const unsigned int id, shm_handler_t run,
+                             void *ctx);
+
+
+// Description:
+//      Stop taking tasks, run the ones already in the ring, wait for them to
+//      finish, and remove the shared segment. Clients then fail to submit.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_shm_server_destroy(thread_pool_shm_server_t *this);
+
+
+// Description:
+//      Attach a client process to the shared segment name.
+//
+// Example:
+//      thread_pool_shm_client_t client;
+//      thread_pool_shm_client_open(&client, "/thread-pool");
+//      thread_pool_shm_submit(&client, 0, &request, sizeof(request));
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_shm_client_open(thread_pool_shm_client_t *this,
+                                const char *name);
+
+
+// Description:
+//      Copy length bytes of payload into a record for handler id of the pool
+//      process. Blocks while the ring is full.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred. errno is EMSGSIZE
+//      if length exceeds SHM_PAYLOAD_MAX, and ECONNREFUSED if the pool
+//      process no longer takes tasks.
+int thread_pool_shm_submit(thread_pool_shm_client_t *this,
+                           const unsigned int id, const void *payload,
+                           const size_t length);
+
+
+// Description:
+//      Detach the client process from the shared segment.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_shm_client_close(thread_pool_shm_client_t *this);
+
+
+#endif /* THREAD_POOL_SHM_H_ */
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "thread-pool-stats.h"
+
+// Regions created by the process so far, they name their segments after it.
+static _Atomic int regions_created;
+
+// Whether the segment name was left behind by a process that is gone. One
+// still being set up, or owned by a live process, is not.
+static bool is_stale(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (-1 == fd) {
+        return false;
+    }
+
+    struct stat st;
+    stats_header_t *header = MAP_FAILED;
+
+    if (0 == fstat(fd, &st) && sizeof(stats_header_t) <= (size_t)st.st_size) {
+        header = mmap(NULL, sizeof(stats_header_t), PROT_READ, MAP_SHARED, fd,
+            0);
+    }
+
+    close(fd);
+
+    if (MAP_FAILED == header) {
+        return false;
+    }
+
+    bool stale = STATS_PAGE_MAGIC == header->magic &&
+                 -1 == kill(header->pid, 0) && ESRCH == errno;
+    munmap(header, sizeof(stats_header_t));
+
+    return stale;
+}
+
+// Map the region from the shared-memory segment name. Return MAP_FAILED if
+// the segment cannot be used, e.g. because another thread pool owns it.
+static void *map_shared(const char *name, const size_t bytes) {
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    if (-1 == fd && EEXIST == errno && is_stale(name)) {
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+
+    if (-1 == fd) {
+        perror("shm_open");
+        return MAP_FAILED;
+    }
+
+    void *addr = MAP_FAILED;
+    if (-1 == ftruncate(fd, bytes)) {
+        perror("ftruncate");
+    } else {
+        addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == addr) {
+            perror("mmap");
+        }
+    }
+
+    close(fd);
+
+    if (MAP_FAILED == addr) {
+        shm_unlink(name);
+    }
+
+    return addr;
+}
+
+stats_region_t *stats_region_create(const int size) {
+    size_t bytes = sizeof(stats_region_t) + size * sizeof(worker_stats_t);
+    const char *prefix = getenv(STATS_PAGE_ENV);
+    char buffer[STATS_PAGE_NAME_MAX];
+    const char *name = NULL;
+    stats_region_t *this = MAP_FAILED;
+
+    // The first region of the process takes the name as is, the next ones
+    // add their number to it.
+    if (NULL != prefix) {
+        int nth = atomic_fetch_add(&regions_created, 1) + 1;
+        int length = (1 == nth) ?
+            snprintf(buffer, STATS_PAGE_NAME_MAX, "%s", prefix) :
+            snprintf(buffer, STATS_PAGE_NAME_MAX, "%s-%d", prefix, nth);
+
+        if (STATS_PAGE_NAME_MAX > length) {
+            name = buffer;
+            this = map_shared(name, bytes);
+        }
+    }
+
+    if (MAP_FAILED == this) {
+        name = NULL;
+        this = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (MAP_FAILED == this) {
+            perror("mmap");
+            return NULL;
+        }
+    }
+
+    // Both kinds of mapping are zero-filled. Publish the header last, so a
+    // reader never sees a live region with a partial layout.
+    stats_header_t *header = &this->header;
+    this->size = size;
+
+    atomic_store_explicit(&header->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    header->magic = STATS_PAGE_MAGIC;
+    header->live = true;
+    header->pid = getpid();
+    header->bytes = bytes;
+    if (NULL != name) {
+        strcpy(header->name, name);
+    }
+
+    atomic_store_explicit(&header->sequence, 2, memory_order_release);
+
+    return this;
+}
+
+worker_stats_t *stats_region_register(stats_region_t *this,
+                                      worker_stats_t *fallback) {
+    int idx = atomic_load_explicit(&this->registered, memory_order_relaxed);
+
+    // Never count past the last entry, registered stays the number in use.
+    do {
+        if (idx >= this->size) {
+            return fallback;
+        }
+    } while (! atomic_compare_exchange_weak_explicit(&this->registered, &idx,
+        idx + 1, memory_order_relaxed, memory_order_relaxed));
+
+    return &this->workers[idx];
+}
+
+void stats_region_snapshot(stats_region_t *this,
+                           thread_pool_stats_t *snapshot) {
+    memset(snapshot, 0, sizeof(thread_pool_stats_t));
+
+    producer_stats_t *producer = &this->producer;
+    snapshot->tasks_submitted = atomic_load_explicit(
+        &producer->tasks_submitted, memory_order_relaxed);
+    snapshot->max_queue_depth = atomic_load_explicit(
+        &producer->max_queue_depth, memory_order_relaxed);
+    snapshot->wakeups = atomic_load_explicit(
+        &producer->wakeups, memory_order_relaxed);
+    snapshot->spurious_wakeups = atomic_load_explicit(
+        &producer->spurious_wakeups, memory_order_relaxed);
+    snapshot->producer_blocks = atomic_load_explicit(
+        &producer->producer_blocks, memory_order_relaxed);
+    snapshot->producer_block_time = atomic_load_explicit(
+        &producer->producer_block_ns, memory_order_relaxed) / 1e9;
+    snapshot->tasks_rejected = atomic_load_explicit(
+        &producer->tasks_rejected, memory_order_relaxed);
+    snapshot->tasks_caller_run = atomic_load_explicit(
+        &producer->tasks_caller_run, memory_order_relaxed);
+    snapshot->tasks_dropped = atomic_load_explicit(
+        &producer->tasks_dropped, memory_order_relaxed);
+    snapshot->tasks_timed_out = atomic_load_explicit(
+        &producer->tasks_timed_out, memory_order_relaxed);
+    snapshot->tasks_completed = atomic_load_explicit(
+        &producer->tasks_taken, memory_order_relaxed);
+
+    snapshot->scale_ups = atomic_load_explicit(
+        &this->scaler.scale_ups, memory_order_relaxed);
+    snapshot->scale_downs = atomic_load_explicit(
+        &this->scaler.scale_downs, memory_order_relaxed);
+    snapshot->spawns = atomic_load_explicit(
+        &this->scaler.spawns, memory_order_relaxed);
+    snapshot->retires = atomic_load_explicit(
+        &this->scaler.retires, memory_order_relaxed);
+
+    unsigned long worker_wakeups = 0, wakeup_idle_ns = 0;
+
+    for (int idx = 0; idx < this->size; ++idx) {
+        worker_stats_t *worker = &this->workers[idx];
+        unsigned long wakeups = atomic_load_explicit(
+            &worker->wakeups, memory_order_relaxed);
+
+        snapshot->tasks_completed += atomic_load_explicit(
+            &worker->tasks_completed, memory_order_relaxed);
+        snapshot->spurious_wakeups += atomic_load_explicit(
+            &worker->spurious_wakeups, memory_order_relaxed);
+        snapshot->woken_workers += (0 != wakeups);
+        worker_wakeups += wakeups;
+        wakeup_idle_ns += atomic_load_explicit(
+            &worker->wakeup_idle_ns, memory_order_relaxed);
+
+        switch (atomic_load_explicit(&worker->state, memory_order_relaxed)) {
+            case WORKER_IDLE:    snapshot->idle_workers += 1;    break;
+            case WORKER_PARKED:  snapshot->parked_workers += 1;  break;
+            case WORKER_RUNNING: snapshot->running_workers += 1; break;
+            default:                                             break;
+        }
+    }
+
+    snapshot->wakeups += worker_wakeups;
+
+    if (0 != worker_wakeups) {
+        snapshot->wakeup_idle_time = wakeup_idle_ns / 1e9 / worker_wakeups;
+    }
+}
+
+void stats_region_destroy(stats_region_t *this) {
+    if (NULL == this) {
+        return;
+    }
+
+    stats_header_t *header = &this->header;
+    unsigned int sequence = atomic_load_explicit(&header->sequence,
+        memory_order_relaxed);
+
+    atomic_store_explicit(&header->sequence, sequence + 1,
+        memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    header->live = false;
+
+    atomic_store_explicit(&header->sequence, sequence + 2,
+        memory_order_release);
+
+    if ('\0' != header->name[0]) {
+        shm_unlink(header->name);
+    }
+
+    munmap(this, header->bytes);
+}
@@ -0,0 +1,319 @@
+#ifndef THREAD_POOL_STATS_H_
+#define THREAD_POOL_STATS_H_
+
+#include <time.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define CACHE_LINE_SIZE 64
+
+#define STATS_PAGE_MAGIC    0x5354415450505448UL
+#define STATS_PAGE_NAME_MAX 64
+#define STATS_PAGE_ENV      "THREAD_POOL_SHM"
+
+
+// Description:
+//      What a worker thread is currently doing.
+//
+// Values:
+//      WORKER_IDLE:
+//          Waiting for a task, either on a lock or on a condition variable.
+//      WORKER_PARKED:
+//          Taken out of service by the pool, e.g. in a parked work group.
+//      WORKER_RUNNING:
+//          Executing a task.
+//      WORKER_EXITED:
+//          Terminated, not counted in any snapshot.
+typedef enum __WORKER_STATE_TAG__ {
+    WORKER_IDLE = 0,
+    WORKER_PARKED,
+    WORKER_RUNNING,
+    WORKER_EXITED,
+
+} worker_state_t;
+
+
+// Description:
+//      Counters owned by a single worker thread. Only the owner writes them,
+//      so updates are plain relaxed stores and each worker gets its own cache
+//      line.
+//
+// Attributes:
+//      state:
+//          One of worker_state_t.
+//      tasks_completed:
+//          Number of tasks executed by the worker.
+//      wakeups:
+//          Number of times the worker returned from waiting for a task.
+//      spurious_wakeups:
+//          Number of wakeups after which there was still no task to take.
+//      wakeup_idle_ns:
+//          Total time the worker had been waiting when it was woken up, in
+//          nanoseconds. Kept by pools that choose which worker to wake.
+typedef struct __WORKER_STATS_TAG__ {
+    _Atomic int state;
+    _Atomic unsigned long tasks_completed;
+    _Atomic unsigned long wakeups;
+    _Atomic unsigned long spurious_wakeups;
+    _Atomic unsigned long wakeup_idle_ns;
+
+} __attribute__((aligned(CACHE_LINE_SIZE))) worker_stats_t;
+
+
+// Description:
+//      Counters updated on the submission side. They are written while the
+//      producer holds the lock protecting the task queue, so there is a single
+//      writer at any time.
+//
+// Attributes:
+//      tasks_submitted:
+//          Number of tasks inserted into the task queue.
+//      max_queue_depth:
+//          Largest number of pending tasks observed after an insert.
+//      wakeups:
+//          Number of times a producer returned from waiting for space.
+//      spurious_wakeups:
+//          Number of those after which the task queue was still full.
+//      producer_blocks:
+//          Number of times a producer found the task queue full.
+//      producer_block_ns:
+//          Total time producers spent waiting for space, in nanoseconds.
+//      tasks_rejected / tasks_caller_run / tasks_dropped:
+//          Tasks turned away from a full task queue, run by the producer
+//          itself instead, and pending tasks discarded to make room.
+//      tasks_timed_out:
+//          Tasks given up on after waiting for room until their deadline.
+//      tasks_taken:
+//          Tasks taken off the task queue by thread_pool_take(), to run
+//          outside the worker threads. Counted as completed once taken.
+typedef struct __PRODUCER_STATS_TAG__ {
+    _Atomic unsigned long tasks_submitted;
+    _Atomic unsigned long max_queue_depth;
+    _Atomic unsigned long wakeups;
+    _Atomic unsigned long spurious_wakeups;
+    _Atomic unsigned long producer_blocks;
+    _Atomic unsigned long producer_block_ns;
+    _Atomic unsigned long tasks_rejected;
+    _Atomic unsigned long tasks_caller_run;
+    _Atomic unsigned long tasks_dropped;
+    _Atomic unsigned long tasks_timed_out;
+    _Atomic unsigned long tasks_taken;
+
+} __attribute__((aligned(CACHE_LINE_SIZE))) producer_stats_t;
+
+
+// Description:
+//      Counters updated by the autoscaler, under the lock the pool uses to
+//      decide whether to scale.
+//
+// Attributes:
+//      scale_ups / scale_downs:
+//          Worker threads brought into and taken out of service.
+//      spawns / retires:
+//          Worker threads created on demand, and those that exited after
+//          being idle for too long.
+typedef struct __SCALER_STATS_TAG__ {
+    _Atomic unsigned long scale_ups;
+    _Atomic unsigned long scale_downs;
+    _Atomic unsigned long spawns;
+    _Atomic unsigned long retires;
+
+} __attribute__((aligned(CACHE_LINE_SIZE))) scaler_stats_t;
+
+
+// Description:
+//      Describes the layout of a stats region, so that another process can
+//      read it from shared memory. The header is only written when the region
+//      is created or destroyed, under a seqlock: the writer makes sequence odd
+//      before the update and even after it, and a reader retries until it
+//      sees the same even value before and after copying the header.
+//
+//      The seqlock covers the header only. The counters that follow it are
+//      updated on the hot paths without touching sequence, each on its own,
+//      so a reader gets every counter untorn, but two counters read one after
+//      the other may be from different moments.
+//
+// Attributes:
+//      magic:
+//          STATS_PAGE_MAGIC, identifies the segment.
+//      sequence:
+//          Seqlock sequence number.
+//      live:
+//          False once the thread pool has been destroyed.
+//      pid:
+//          Process that owns the thread pool.
+//      bytes:
+//          Size of the whole region, including workers[].
+//      name:
+//          Name of the shared-memory segment, or empty if the region is
+//          private to the process.
+typedef struct __STATS_HEADER_TAG__ {
+    unsigned long magic;
+    _Atomic unsigned int sequence;
+    bool live;
+    int pid;
+    unsigned long bytes;
+    char name[STATS_PAGE_NAME_MAX];
+
+} __attribute__((aligned(CACHE_LINE_SIZE))) stats_header_t;
+
+
+// Description:
+//      All counters of a thread pool in one page-aligned mapping.
+//
+//      If the environment variable THREAD_POOL_SHM names a POSIX
+//      shared-memory segment (e.g. THREAD_POOL_SHM=/thread-pool), the region
+//      is mapped from that segment instead of anonymous memory, so that
+//      thread-pool-top can watch it from another process. The counters are
+//      written the same way in both cases, publishing costs nothing extra.
+//
+//      The first pool of the process publishes under the name as is, the
+//      next ones under the name followed by -2, -3 and so on. A segment
+//      owned by another live pool is never taken over, the pool keeps its
+//      counters private instead.
+//
+// Attributes:
+//      header:
+//          Layout description, see stats_header_t.
+//      size:
+//          Number of entries in workers[].
+//      registered:
+//          Number of worker threads that have claimed an entry.
+typedef struct __STATS_REGION_TAG__ {
+    stats_header_t header;
+    producer_stats_t producer;
+    scaler_stats_t scaler;
+    int size;
+    _Atomic int registered;
+    worker_stats_t workers[];
+
+} stats_region_t;
+
+
+// Description:
+//      A point-in-time summary of a thread pool, as returned by
+//      thread_pool_stats().
+//
+// Attributes:
+//      tasks_submitted / tasks_completed:
+//          Tasks inserted into the pool and tasks that finished executing,
+//          including those taken by thread_pool_take().
+//      queue_depth / max_queue_depth:
+//          Pending tasks now, and the most ever observed.
+//      idle_workers / parked_workers / running_workers:
+//          Worker threads in each worker_state_t.
+//      wakeups / spurious_wakeups:
+//          Returns from condition variable (or futex) waits, by workers and
+//          producers, and those after which the awaited condition was false.
+//      woken_workers / wakeup_idle_time:
+//          Worker threads that have been woken up at least once, and how long
+//          (in seconds) a woken worker thread had been waiting on average.
+//          Waking the most recently idle worker thread keeps both low, the
+//          others stay asleep.
+//      producer_blocks / producer_block_time:
+//          How often and for how long (in seconds) producers waited for
+//          space_available.
+//      tasks_rejected / tasks_caller_run / tasks_dropped:
+//          Outcomes of submitting to a full task queue under an overload
+//          policy other than blocking.
+//      tasks_timed_out:
+//          Submissions with a deadline that found no room in time.
+//      scale_ups / scale_downs:
+//          Autoscaler actions.
+//      spawns / retires:
+//          Worker threads created on demand and retired when idle.
+typedef struct __THREAD_POOL_STATS_TAG__ {
+    unsigned long tasks_submitted;
+    unsigned long tasks_completed;
+    unsigned long queue_depth;
+    unsigned long max_queue_depth;
+    int idle_workers;
+    int parked_workers;
+    int running_workers;
+    unsigned long wakeups;
+    unsigned long spurious_wakeups;
+    int woken_workers;
+    double wakeup_idle_time;
+    unsigned long producer_blocks;
+    double producer_block_time;
+    unsigned long tasks_rejected;
+    unsigned long tasks_caller_run;
+    unsigned long tasks_dropped;
+    unsigned long tasks_timed_out;
+    unsigned long scale_ups;
+    unsigned long scale_downs;
+    unsigned long spawns;
+    unsigned long retires;
+
+} thread_pool_stats_t;
+
+
+// Description:
+//      Add to a counter that has a single writer. Cheaper than an atomic
+//      read-modify-write, but not safe if two threads may update the counter
+//      concurrently.
+static inline void stats_add(_Atomic unsigned long *counter,
+                             const unsigned long value) {
+    atomic_store_explicit(counter,
+        atomic_load_explicit(counter, memory_order_relaxed) + value,
+        memory_order_relaxed);
+}
+
+static inline void stats_max(_Atomic unsigned long *counter,
+                             const unsigned long value) {
+    if (value > atomic_load_explicit(counter, memory_order_relaxed)) {
+        atomic_store_explicit(counter, value, memory_order_relaxed);
+    }
+}
+
+static inline unsigned long stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline void stats_set_state(worker_stats_t *this,
+                                   const worker_state_t state) {
+    atomic_store_explicit(&this->state, state, memory_order_relaxed);
+}
+
+
+// Description:
+//      Allocate zeroed counters for a pool of size worker threads. If
+//      THREAD_POOL_SHM is set, the counters are published in a shared-memory
+//      segment named after it, see stats_region_t. A segment of that name
+//      left behind by a process that is gone is replaced. If the segment
+//      cannot be created, the counters stay private.
+//
+// Return value:
+//      Return the counters on success, or NULL if an error occurred.
+stats_region_t *stats_region_create(const int size);
+
+
+// Description:
+//      Claim the next unused worker entry. Called once by each worker thread
+//      when it starts. Entries are never shared: once all of them are
+//      claimed, the thread keeps its counters in fallback, an entry private to
+//      it, and they are left out of the snapshots.
+//
+// Return value:
+//      Return the claimed entry, or fallback if none is left.
+worker_stats_t *stats_region_register(stats_region_t *this,
+                                      worker_stats_t *fallback);
+
+
+// Description:
+//      Sum all counters into snapshot. The queue depth is left untouched, it
+//      is filled in by the thread pool.
+void stats_region_snapshot(stats_region_t *this,
+                           thread_pool_stats_t *snapshot);
+
+
+// Description:
+//      Mark the region as no longer live, unlink the shared-memory segment it
+//      created if any, and unmap it. Readers that still map the segment keep
+//      seeing the final counters.
+void stats_region_destroy(stats_region_t *this);
+
+
+#endif /* THREAD_POOL_STATS_H_ */
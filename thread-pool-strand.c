@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "thread-pool-strand.h"
+
+static strand_bucket_t *bucket_of(thread_pool_strands_t *this,
+                                  const uint64_t key) {
+    // Fibonacci hashing: the product's high bits depend on every bit of the
+    // key, the low bits only on the key's low bits, so take the top ones.
+    return &this->buckets[(key * 0x9e3779b97f4a7c15UL) >>
+                          (64 - STRAND_BUCKETS_LOG2)];
+}
+
+static void drain(void *args) {
+    strand_t *strand = args;
+    thread_pool_strands_t *this = strand->owner;
+    strand_bucket_t *bucket = bucket_of(this, strand->key);
+
+    pthread_mutex_lock(&bucket->mutex);
+
+    while (NULL != strand->head) {
+        strand_task_t *task = strand->head;
+        strand->head = task->next;
+
+        if (NULL == strand->head) {
+            strand->tail = NULL;
+        }
+
+        pthread_mutex_unlock(&bucket->mutex);
+        task->run(task->args);
+        pthread_mutex_lock(&bucket->mutex);
+
+        task->next = bucket->free_tasks;
+        bucket->free_tasks = task;
+    }
+
+    // Drained, the next task of the key schedules a new strand.
+    strand_t **link = &bucket->strands;
+    while (*link != strand) {
+        link = &(*link)->next;
+    }
+
+    *link = strand->next;
+    strand->next = bucket->free_strands;
+    bucket->free_strands = strand;
+
+    pthread_mutex_unlock(&bucket->mutex);
+
+    pthread_mutex_lock(&this->idle_mutex);
+
+    if (0 == --this->active) {
+        pthread_cond_broadcast(&this->idle);
+    }
+
+    pthread_mutex_unlock(&this->idle_mutex);
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_strands_init(thread_pool_strands_t *this, thread_pool_t *pool) {
+    if (NULL == this || NULL == pool) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    this->pool = pool;
+    this->active = 0;
+
+    if (0 != pthread_mutex_init(&this->idle_mutex, NULL)) {
+        perror("pthread_mutex_init");
+        return -1;
+    }
+
+    if (0 != pthread_cond_init(&this->idle, NULL)) {
+        perror("pthread_cond_init");
+        pthread_mutex_destroy(&this->idle_mutex);
+        return -1;
+    }
+
+    for (int idx = 0; idx < STRAND_BUCKETS; ++idx) {
+        strand_bucket_t *bucket = &this->buckets[idx];
+
+        bucket->strands = NULL;
+        bucket->free_strands = NULL;
+        bucket->free_tasks = NULL;
+        pthread_mutex_init(&bucket->mutex, NULL);
+    }
+
+    return 0;
+}
+
+int thread_pool_run_keyed(thread_pool_strands_t *this, const uint64_t key,
+                          void (*run)(void *), void *args) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    strand_bucket_t *bucket = bucket_of(this, key);
+    strand_t *strand, *scheduled = NULL;
+    strand_task_t *task;
+
+    pthread_mutex_lock(&bucket->mutex);
+
+    if (NULL != (task = bucket->free_tasks)) {
+        bucket->free_tasks = task->next;
+    } else if (NULL == (task = malloc(sizeof(strand_task_t)))) {
+        perror("malloc");
+        pthread_mutex_unlock(&bucket->mutex);
+        return -1;
+    }
+
+    task->next = NULL;
+    task->run = run;
+    task->args = args;
+
+    for (strand = bucket->strands; NULL != strand; strand = strand->next) {
+        if (strand->key == key) {
+            break;
+        }
+    }
+
+    if (NULL == strand) {
+        if (NULL != (strand = bucket->free_strands)) {
+            bucket->free_strands = strand->next;
+        } else if (NULL == (strand = malloc(sizeof(strand_t)))) {
+            perror("malloc");
+            task->next = bucket->free_tasks;
+            bucket->free_tasks = task;
+            pthread_mutex_unlock(&bucket->mutex);
+            return -1;
+        }
+
+        strand->key = key;
+        strand->owner = this;
+        strand->head = NULL;
+        strand->tail = NULL;
+        strand->next = bucket->strands;
+        bucket->strands = strand;
+        scheduled = strand;
+    }
+
+    if (NULL == strand->tail) {
+        strand->head = task;
+    } else {
+        strand->tail->next = task;
+    }
+
+    strand->tail = task;
+
+    pthread_mutex_unlock(&bucket->mutex);
+
+    if (NULL == scheduled) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&this->idle_mutex);
+    this->active += 1;
+    pthread_mutex_unlock(&this->idle_mutex);
+
+    // Tasks of the key submitted meanwhile have been appended to the strand,
+    // so it has to run one way or the other.
+    if (-1 == thread_pool_run(this->pool, &drain, scheduled)) {
+        drain(scheduled);
+    }
+
+    return 0;
+}
+
+int thread_pool_strands_destroy(thread_pool_strands_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&this->idle_mutex);
+
+    while (0 != this->active) {
+        pthread_cond_wait(&this->idle, &this->idle_mutex);
+    }
+
+    pthread_mutex_unlock(&this->idle_mutex);
+
+    for (int idx = 0; idx < STRAND_BUCKETS; ++idx) {
+        strand_bucket_t *bucket = &this->buckets[idx];
+
+        while (NULL != bucket->free_strands) {
+            strand_t *strand = bucket->free_strands;
+            bucket->free_strands = strand->next;
+            free(strand);
+        }
+
+        while (NULL != bucket->free_tasks) {
+            strand_task_t *task = bucket->free_tasks;
+            bucket->free_tasks = task->next;
+            free(task);
+        }
+
+        pthread_mutex_destroy(&bucket->mutex);
+    }
+
+    pthread_cond_destroy(&this->idle);
+    pthread_mutex_destroy(&this->idle_mutex);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#ifndef THREAD_POOL_STRAND_H_
+#define THREAD_POOL_STRAND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include IMPL
+
+#define STRAND_BUCKETS_LOG2 10
+#define STRAND_BUCKETS (1 << STRAND_BUCKETS_LOG2)
+
+
+// Description:
+//      A task waiting in a strand.
+typedef struct __STRAND_TASK_TAG__ {
+    struct __STRAND_TASK_TAG__ *next;
+    void (*run)(void *);
+    void *args;
+
+} strand_task_t;
+
+
+// Description:
+//      The tasks submitted under one key, run one after another by a single
+//      pool task at a time. A strand is in its bucket exactly as long as it
+//      has a pool task draining it, or about to.
+//
+// Attributes:
+//      key / owner:
+//          Set by thread_pool_run_keyed().
+//      next:
+//          Next strand of the same bucket.
+//      head / tail:
+//          Pending tasks in submission order.
+typedef struct __STRAND_TAG__ {
+    uint64_t key;
+    struct __THREAD_POOL_STRANDS_TAG__ *owner;
+    struct __STRAND_TAG__ *next;
+    strand_task_t *head;
+    strand_task_t *tail;
+
+} strand_t;
+
+
+// Description:
+//      A bucket of the strand table. Its mutex guards the strands of the
+//      bucket and their tasks, and is held only to append or take a task,
+//      never while one runs.
+//
+// Attributes:
+//      strands:
+//          Scheduled strands that hash to the bucket.
+//      free_strands / free_tasks:
+//          Released entries kept for reuse, so steady state does not allocate.
+typedef struct __STRAND_BUCKET_TAG__ {
+    pthread_mutex_t mutex;
+    strand_t *strands;
+    strand_t *free_strands;
+    strand_task_t *free_tasks;
+
+} strand_bucket_t;
+
+
+// Description:
+//      Keyed serial execution on top of a thread pool. Tasks submitted with
+//      the same key run in submission order and never concurrently, tasks of
+//      different keys run in parallel. Each key with pending tasks occupies
+//      at most one pool task, which runs them one by one, so no worker thread
+//      ever waits for a key.
+//
+// Attributes:
+//      pool:
+//          Runs the strands.
+//      active:
+//          Number of strands scheduled, thread_pool_strands_destroy() waits
+//          until it drops to zero.
+//      idle_mutex / idle:
+//          Signaled when active drops to zero.
+typedef struct __THREAD_POOL_STRANDS_TAG__ {
+    thread_pool_t *pool;
+    int active;
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t idle;
+    strand_bucket_t buckets[STRAND_BUCKETS];
+
+} thread_pool_strands_t;
+
+
+// Description:
+//      Set up keyed serial execution of tasks in pool.
+//
+// Example:
+//      thread_pool_strands_t strands;
+//      thread_pool_strands_init(&strands, &thrpool);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_strands_init(thread_pool_strands_t *this, thread_pool_t *pool);
+
+
+// Description:
+//      Run a task after every task submitted earlier with the same key, and
+//      not concurrently with any of them. A strand drains until it is empty,
+//      so a key that never runs dry keeps one worker thread to itself.
+//
+// Example:
+//      thread_pool_run_keyed(&strands, session->id, &handle, request);
+//
+// Note:
+//      If the pool refuses the strand, e.g. under OVERLOAD_REJECT, the calling
+//      thread runs it instead, keeping the order.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_run_keyed(thread_pool_strands_t *this, const uint64_t key,
+                          void (*run)(void *), void *args);
+
+
+// Description:
+//      Wait until every keyed task has run, and release the strand table.
+//      Must be called before thread_pool_destroy(), and no keyed task may be
+//      submitted once it has started.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_strands_destroy(thread_pool_strands_t *this);
+
+
+#endif /* THREAD_POOL_STRAND_H_ */
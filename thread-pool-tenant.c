@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "thread-pool-tenant.h"
+
+static bool is_eligible(tenant_t *tenant) {
+    return NULL != tenant->head && tenant->running < tenant->max_concurrency;
+}
+
+// Deficit round-robin over the tenants, with every task costing one. Called
+// with mutex held, return NULL if no tenant may start a task.
+static tenant_t *pick(thread_pool_tenants_t *this) {
+    int eligible = 0;
+
+    for (int idx = 0; idx < this->num_of_tenants; ++idx) {
+        eligible += is_eligible(&this->tenants[idx]);
+    }
+
+    if (0 == eligible) {
+        return NULL;
+    }
+
+    // An eligible tenant gains weight per turn, so this ends within a round
+    // or two.
+    while (1) {
+        tenant_t *tenant = &this->tenants[this->current];
+
+        if (is_eligible(tenant) && 0 < tenant->deficit) {
+            tenant->deficit -= 1;
+            return tenant;
+        }
+
+        if (NULL == tenant->head) {
+            tenant->deficit = 0;
+        }
+
+        this->current = (this->current + 1) % this->num_of_tenants;
+        tenant = &this->tenants[this->current];
+
+        // A tenant held back by max_concurrency keeps at most one round.
+        tenant->deficit += tenant->weight;
+        if (tenant->deficit > tenant->weight) {
+            tenant->deficit = tenant->weight;
+        }
+    }
+}
+
+static void serve(void *args) {
+    thread_pool_tenants_t *this = args;
+    tenant_t *tenant;
+
+    pthread_mutex_lock(&this->mutex);
+
+    while (NULL != (tenant = pick(this))) {
+        tenant_task_t *task = tenant->head;
+        tenant->head = task->next;
+
+        if (NULL == tenant->head) {
+            tenant->tail = NULL;
+        }
+
+        tenant->running += 1;
+
+        pthread_mutex_unlock(&this->mutex);
+        task->run(task->args);
+        pthread_mutex_lock(&this->mutex);
+
+        tenant->running -= 1;
+        task->next = this->free_tasks;
+        this->free_tasks = task;
+        this->pending -= 1;
+    }
+
+    // Nothing eligible: whatever becomes so schedules a new pool task, or is
+    // picked up by one still running.
+    if (0 == --this->in_flight && 0 == this->pending) {
+        pthread_cond_broadcast(&this->idle);
+    }
+
+    pthread_mutex_unlock(&this->mutex);
+}
+
+
+/* ************************************************************************** */
+
+
+int thread_pool_tenants_init(thread_pool_tenants_t *this, thread_pool_t *pool,
+                             const int window) {
+    if (NULL == this || NULL == pool) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 >= window) {
+        fprintf(stderr, "Invalid window of tenants.\n");
+        return -1;
+    }
+
+    this->pool = pool;
+    this->window = window;
+    this->in_flight = 0;
+    this->pending = 0;
+    this->num_of_tenants = 0;
+    this->current = 0;
+    this->free_tasks = NULL;
+
+    if (0 != pthread_mutex_init(&this->mutex, NULL)) {
+        perror("pthread_mutex_init");
+        return -1;
+    }
+
+    if (0 != pthread_cond_init(&this->idle, NULL)) {
+        perror("pthread_cond_init");
+        pthread_mutex_destroy(&this->mutex);
+        return -1;
+    }
+
+    return 0;
+}
+
+int thread_pool_tenant_add(thread_pool_tenants_t *this, const int weight,
+                           const int max_concurrency) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    if (0 >= weight || 0 >= max_concurrency) {
+        fprintf(stderr, "Invalid weight or concurrency of tenant.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (TENANTS_MAX == this->num_of_tenants) {
+        pthread_mutex_unlock(&this->mutex);
+        fprintf(stderr, "Too many tenants.\n");
+        return -1;
+    }
+
+    int id = this->num_of_tenants++;
+    tenant_t *tenant = &this->tenants[id];
+
+    tenant->weight = weight;
+    tenant->max_concurrency = max_concurrency;
+    tenant->running = 0;
+    tenant->deficit = 0 == id ? weight : 0;
+    tenant->head = NULL;
+    tenant->tail = NULL;
+
+    pthread_mutex_unlock(&this->mutex);
+
+    return id;
+}
+
+int thread_pool_run_tenant(thread_pool_tenants_t *this, const int tenant,
+                           void (*run)(void *), void *args) {
+    if (NULL == this || NULL == run) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (0 > tenant || this->num_of_tenants <= tenant) {
+        pthread_mutex_unlock(&this->mutex);
+        fprintf(stderr, "Invalid tenant.\n");
+        return -1;
+    }
+
+    tenant_task_t *task;
+
+    if (NULL != (task = this->free_tasks)) {
+        this->free_tasks = task->next;
+    } else if (NULL == (task = malloc(sizeof(tenant_task_t)))) {
+        perror("malloc");
+        pthread_mutex_unlock(&this->mutex);
+        return -1;
+    }
+
+    task->next = NULL;
+    task->run = run;
+    task->args = args;
+
+    tenant_t *owner = &this->tenants[tenant];
+
+    if (NULL == owner->tail) {
+        owner->head = task;
+    } else {
+        owner->tail->next = task;
+    }
+
+    owner->tail = task;
+    this->pending += 1;
+
+    // With window pool tasks serving already, one of them picks it up.
+    bool scheduled = is_eligible(owner) && this->in_flight < this->window;
+    if (scheduled) {
+        this->in_flight += 1;
+    }
+
+    pthread_mutex_unlock(&this->mutex);
+
+    if (scheduled && -1 == thread_pool_run(this->pool, &serve, this)) {
+        serve(this);
+    }
+
+    return 0;
+}
+
+int thread_pool_tenants_destroy(thread_pool_tenants_t *this) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+
+    while (0 != this->pending || 0 != this->in_flight) {
+        pthread_cond_wait(&this->idle, &this->mutex);
+    }
+
+    pthread_mutex_unlock(&this->mutex);
+
+    while (NULL != this->free_tasks) {
+        tenant_task_t *task = this->free_tasks;
+        this->free_tasks = task->next;
+        free(task);
+    }
+
+    pthread_cond_destroy(&this->idle);
+    pthread_mutex_destroy(&this->mutex);
+
+    return 0;
+}
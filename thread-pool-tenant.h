@@ -0,0 +1,145 @@
+#ifndef THREAD_POOL_TENANT_H_
+#define THREAD_POOL_TENANT_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include IMPL
+
+#define TENANTS_MAX 64
+
+
+// Description:
+//      A task waiting in the queue of a tenant.
+typedef struct __TENANT_TASK_TAG__ {
+    struct __TENANT_TASK_TAG__ *next;
+    void (*run)(void *);
+    void *args;
+
+} tenant_task_t;
+
+
+// Description:
+//      A logical sub-pool: a queue of its own, scheduled onto the shared
+//      worker threads by deficit round-robin.
+//
+// Attributes:
+//      weight:
+//          Tasks the tenant may start per round, relative to the others.
+//      max_concurrency:
+//          Tasks of the tenant that may run at once.
+//      running:
+//          Tasks of the tenant running right now.
+//      deficit:
+//          Tasks the tenant may still start in the current round. Topped up
+//          by weight when its turn comes, and dropped when its queue runs dry
+//          so an idle tenant does not save up for a burst.
+//      head / tail:
+//          Pending tasks in submission order.
+typedef struct __TENANT_TAG__ {
+    int weight;
+    int max_concurrency;
+    int running;
+    int deficit;
+    tenant_task_t *head;
+    tenant_task_t *tail;
+
+} tenant_t;
+
+
+// Description:
+//      Tenants sharing the worker threads of one pool, instead of a pool per
+//      subsystem. At most window pool tasks serve the tenants at once, each
+//      running tenant tasks one after another in deficit round-robin order,
+//      so a tenant flooding its queue gets no more than its share while the
+//      others have work, and a tenant without work holds no worker thread.
+//
+// Attributes:
+//      pool:
+//          Runs the tenant tasks.
+//      mutex:
+//          Guards everything below. Held only to pick or append a task, never
+//          while one runs.
+//      window / in_flight:
+//          Pool tasks serving the tenants, at most and right now.
+//      pending:
+//          Tenant tasks submitted and not finished yet.
+//      idle:
+//          Signaled when the last pool task serving the tenants finishes with
+//          nothing pending.
+//      current:
+//          The tenant whose turn it is.
+//      free_tasks:
+//          Released entries kept for reuse, so steady state does not allocate.
+typedef struct __THREAD_POOL_TENANTS_TAG__ {
+    thread_pool_t *pool;
+    pthread_mutex_t mutex;
+    pthread_cond_t idle;
+
+    int window;
+    int in_flight;
+    long pending;
+
+    int num_of_tenants;
+    int current;
+    tenant_t tenants[TENANTS_MAX];
+    tenant_task_t *free_tasks;
+
+} thread_pool_tenants_t;
+
+
+// Description:
+//      Set up tenants on top of pool, served by at most window of its worker
+//      threads at once. A window of the pool size keeps the queue of the pool
+//      short, so the order tasks start in is that of the tenants.
+//
+// Example:
+//      thread_pool_tenants_t tenants;
+//      thread_pool_tenants_init(&tenants, &thrpool, 1024);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_tenants_init(thread_pool_tenants_t *this, thread_pool_t *pool,
+                             const int window);
+
+
+// Description:
+//      Add a tenant. A tenant of weight 2 starts twice as many tasks as one of
+//      weight 1 while both have work, and never runs more than
+//      max_concurrency tasks at once.
+//
+// Example:
+//      int logging = thread_pool_tenant_add(&tenants, 1, 4);
+//      int requests = thread_pool_tenant_add(&tenants, 8, 1024);
+//
+// Return value:
+//      Return the id of the tenant, or -1 if an error occurred.
+int thread_pool_tenant_add(thread_pool_tenants_t *this, const int weight,
+                           const int max_concurrency);
+
+
+// Description:
+//      Queue a task for tenant, to run on one of the shared worker threads
+//      when the tenant's turn comes.
+//
+// Note:
+//      If the pool refuses to serve, e.g. under OVERLOAD_REJECT, the calling
+//      thread serves the tenants instead.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_run_tenant(thread_pool_tenants_t *this, const int tenant,
+                           void (*run)(void *), void *args);
+
+
+// Description:
+//      Wait until every tenant task has run, and release the tenants. Must be
+//      called before thread_pool_destroy(), and no tenant task may be
+//      submitted once it has started.
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_tenants_destroy(thread_pool_tenants_t *this);
+
+
+#endif /* THREAD_POOL_TENANT_H_ */
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "thread-pool-stats.h"
+
+#define SAMPLES_PER_INTERVAL 100
+#define DEFAULT_ROWS          20
+
+typedef struct __WORKER_ROW_TAG__ {
+    int id;
+    int state;
+    double utilisation;
+    double tasks_per_second;
+    double wakeups_per_second;
+
+} worker_row_t;
+
+typedef struct __TOTALS_TAG__ {
+    unsigned long tasks_submitted;
+    unsigned long tasks_completed;
+    unsigned long wakeups;
+    unsigned long spurious_wakeups;
+    unsigned long producer_block_ns;
+
+} totals_t;
+
+static const char *state_names[] = { "idle", "parked", "running", "exited" };
+
+static int by_utilisation(const void *lhs, const void *rhs) {
+    const worker_row_t *a = lhs, *b = rhs;
+
+    if (a->utilisation != b->utilisation) {
+        return (a->utilisation < b->utilisation) ? 1 : -1;
+    }
+
+    return a->id - b->id;
+}
+
+static unsigned long load(const _Atomic unsigned long *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+
+/* ************************************************************************** */
+
+
+// Map the named segment read-only. Return NULL if it does not exist (yet) or
+// does not hold a stats region.
+static stats_region_t *map_region(const char *name, size_t *bytes) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (-1 == fd) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (-1 == fstat(fd, &st) || (size_t)st.st_size < sizeof(stats_region_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    stats_region_t *region = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+        fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == region) {
+        perror("mmap");
+        return NULL;
+    }
+
+    *bytes = st.st_size;
+    return region;
+}
+
+// Copy the header and worker count under the seqlock, see stats_header_t.
+static int read_layout(const stats_region_t *region,
+                       stats_header_t *header,
+                       int *size) {
+    for (int retry = 0; retry < 1000; ++retry) {
+        unsigned int before = atomic_load_explicit(&region->header.sequence,
+            memory_order_acquire);
+
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+
+        header->magic = region->header.magic;
+        header->live = region->header.live;
+        header->pid = region->header.pid;
+        header->bytes = region->header.bytes;
+        *size = region->size;
+
+        atomic_thread_fence(memory_order_acquire);
+        unsigned int after = atomic_load_explicit(&region->header.sequence,
+            memory_order_relaxed);
+
+        if (before == after && 0 != before) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static void read_totals(const stats_region_t *region, totals_t *totals) {
+    totals->tasks_submitted = load(&region->producer.tasks_submitted);
+    totals->producer_block_ns = load(&region->producer.producer_block_ns);
+    totals->wakeups = load(&region->producer.wakeups);
+    totals->spurious_wakeups = load(&region->producer.spurious_wakeups);
+    totals->tasks_completed = load(&region->producer.tasks_taken);
+
+    for (int idx = 0; idx < region->size; ++idx) {
+        totals->tasks_completed += load(&region->workers[idx].tasks_completed);
+        totals->wakeups += load(&region->workers[idx].wakeups);
+        totals->spurious_wakeups += load(&region->workers[idx].spurious_wakeups);
+    }
+}
+
+
+/* ************************************************************************** */
+
+
+int main(int argc, char const *argv[]) {
+    if (argc > 4 || (argc < 2 && NULL == getenv(STATS_PAGE_ENV))) {
+        fprintf(stderr, "Usage: %s [<shm-name> [<interval> [<count>]]]\n",
+            argv[0]);
+        fprintf(stderr, "       shm-name defaults to $%s\n", STATS_PAGE_ENV);
+        return -1;
+    }
+
+    const char *name = (argc >= 2) ? argv[1] : getenv(STATS_PAGE_ENV);
+    double interval = (argc >= 3) ? atof(argv[2]) : 1.0;
+    int count = (argc == 4) ? atoi(argv[3]) : -1;
+
+    if (0.0 >= interval) {
+        fprintf(stderr, "Invalid interval.\n");
+        return -1;
+    }
+
+    size_t bytes = 0;
+    stats_region_t *region = NULL;
+
+    while (NULL == (region = map_region(name, &bytes))) {
+        fprintf(stderr, "Waiting for %s ...\n", name);
+        usleep(interval * 1000000);
+    }
+
+    stats_header_t header;
+    int size = 0;
+
+    if (-1 == read_layout(region, &header, &size) ||
+        STATS_PAGE_MAGIC != header.magic ||
+        header.bytes > bytes ||
+        sizeof(stats_region_t) + size * sizeof(worker_stats_t) > bytes) {
+        fprintf(stderr, "%s is not a thread pool stats page.\n", name);
+        munmap(region, bytes);
+        return -1;
+    }
+
+    worker_row_t *rows = malloc(size * sizeof(worker_row_t));
+    unsigned long *prev_completed = calloc(size, sizeof(unsigned long));
+    unsigned long *prev_wakeups = calloc(size, sizeof(unsigned long));
+    int *running_samples = malloc(size * sizeof(int));
+
+    if (NULL == rows || NULL == prev_completed ||
+        NULL == prev_wakeups || NULL == running_samples) {
+        perror("malloc");
+        return -1;
+    }
+
+    totals_t prev, curr;
+    read_totals(region, &prev);
+
+    for (int idx = 0; idx < size; ++idx) {
+        prev_completed[idx] = load(&region->workers[idx].tasks_completed);
+        prev_wakeups[idx] = load(&region->workers[idx].wakeups);
+    }
+
+    while (0 != count--) {
+
+        // Utilisation is estimated by sampling the state of every worker,
+        // so the pool does not have to time its tasks.
+        memset(running_samples, 0, size * sizeof(int));
+        unsigned long start = stats_now_ns();
+
+        for (int sample = 0; sample < SAMPLES_PER_INTERVAL; ++sample) {
+            usleep(interval * 1000000 / SAMPLES_PER_INTERVAL);
+
+            for (int idx = 0; idx < size; ++idx) {
+                running_samples[idx] += (WORKER_RUNNING == atomic_load_explicit(
+                    &region->workers[idx].state, memory_order_relaxed));
+            }
+        }
+
+        double elapsed = (stats_now_ns() - start) / 1e9;
+        int size_ = 0;
+        read_layout(region, &header, &size_);
+        read_totals(region, &curr);
+
+        int states[WORKER_EXITED + 1] = { 0 };
+        int woken = 0;
+
+        for (int idx = 0; idx < size; ++idx) {
+            worker_stats_t *worker = &region->workers[idx];
+            unsigned long completed = load(&worker->tasks_completed);
+            unsigned long wakeups = load(&worker->wakeups);
+            int state = atomic_load_explicit(&worker->state,
+                memory_order_relaxed);
+
+            rows[idx].id = idx;
+            rows[idx].state = state;
+            rows[idx].utilisation =
+                100.0 * running_samples[idx] / SAMPLES_PER_INTERVAL;
+            rows[idx].tasks_per_second =
+                (completed - prev_completed[idx]) / elapsed;
+            rows[idx].wakeups_per_second =
+                (wakeups - prev_wakeups[idx]) / elapsed;
+
+            woken += (wakeups != prev_wakeups[idx]);
+            prev_completed[idx] = completed;
+            prev_wakeups[idx] = wakeups;
+            states[state & 3] += 1;
+        }
+
+        qsort(rows, size, sizeof(worker_row_t), &by_utilisation);
+
+        long depth = curr.tasks_submitted - curr.tasks_completed -
+            states[WORKER_RUNNING];
+
+        printf("\033[H\033[J");
+        printf("thread-pool-top - %s, pid %d (%s)\n", name, header.pid,
+            header.live ? "live" : "destroyed");
+        printf("workers: %d total, %d running, %d idle, %d parked, "
+            "%d exited\n", size, states[WORKER_RUNNING], states[WORKER_IDLE],
+            states[WORKER_PARKED], states[WORKER_EXITED]);
+        printf("tasks: %lu submitted, %lu completed, queue depth ~%ld "
+            "(max %lu)\n", curr.tasks_submitted, curr.tasks_completed,
+            (depth > 0) ? depth : 0, load(&region->producer.max_queue_depth));
+        printf("throughput: %.1lf tasks/s, submit rate: %.1lf tasks/s\n",
+            (curr.tasks_completed - prev.tasks_completed) / elapsed,
+            (curr.tasks_submitted - prev.tasks_submitted) / elapsed);
+        printf("wakeups: %.1lf/s (%.1lf/s spurious) of %d workers, producer "
+            "blocked %.1lf%% of the time\n",
+            (curr.wakeups - prev.wakeups) / elapsed,
+            (curr.spurious_wakeups - prev.spurious_wakeups) / elapsed, woken,
+            100.0 * (curr.producer_block_ns - prev.producer_block_ns) /
+                (elapsed * 1e9));
+        printf("overload: %lu rejected, %lu run by caller, %lu dropped, "
+            "%lu timed out\n",
+            load(&region->producer.tasks_rejected),
+            load(&region->producer.tasks_caller_run),
+            load(&region->producer.tasks_dropped),
+            load(&region->producer.tasks_timed_out));
+        printf("scale up/down: %lu/%lu, workers spawned/retired: %lu/%lu\n\n",
+            load(&region->scaler.scale_ups),
+            load(&region->scaler.scale_downs),
+            load(&region->scaler.spawns),
+            load(&region->scaler.retires));
+
+        printf("%8s %8s %12s %12s  %s\n",
+            "WORKER", "UTIL%", "TASKS/S", "WAKES/S", "STATE");
+
+        for (int idx = 0; idx < size && idx < DEFAULT_ROWS; ++idx) {
+            printf("%8d %8.1lf %12.1lf %12.1lf  %s\n", rows[idx].id,
+                rows[idx].utilisation, rows[idx].tasks_per_second,
+                rows[idx].wakeups_per_second, state_names[rows[idx].state & 3]);
+        }
+
+        fflush(stdout);
+        prev = curr;
+
+        if (! header.live) {
+            break;
+        }
+    }
+
+    free(rows);
+    free(prev_completed);
+    free(prev_wakeups);
+    free(running_samples);
+    munmap(region, bytes);
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+#ifdef THREAD_POOL_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "thread-pool-lock.h"
+#include "thread-pool-trace.h"
+
+typedef struct __TRACE_RECORD_TAG__ {
+    unsigned long start;
+    unsigned long duration;
+    unsigned int event;
+    int arg;
+
+} trace_record_t;
+
+// Description:
+//      Ring buffer of a single thread. Only the owner writes records and
+//      head, trace_dump() reads them while the owner may still be running.
+//
+// Attributes:
+//      head:
+//          Total number of records ever written. Record head is being written
+//          to records[head % TRACE_BUFFER_RECORDS] until head is advanced, so
+//          a copy of record idx is intact as long as head stays below
+//          idx + TRACE_BUFFER_RECORDS afterwards.
+//      dumped:
+//          Value of head at the last trace_dump().
+//      exited:
+//          Set when the owner thread terminates.
+typedef struct __TRACE_BUFFER_TAG__ {
+    struct __TRACE_BUFFER_TAG__ *next;
+    const char *name;
+    int tid;
+    _Atomic bool exited;
+    _Atomic unsigned long head;
+    unsigned long dumped;
+    trace_record_t records[TRACE_BUFFER_RECORDS];
+
+} trace_buffer_t;
+
+static const char *event_names[] = {
+    "dequeue", "run", "park", "lock wait", "submit block",
+    "scale up", "scale down",
+};
+
+static __thread trace_buffer_t *buffer;
+
+static trace_buffer_t *buffers;
+static pthread_key_t buffer_key;
+static pthread_once_t buffer_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The trace file of the process, opened by the first trace_dump() and
+// completed at exit. Guarded by buffers_mutex.
+static FILE *trace_file;
+static bool trace_file_failed;
+static bool trace_file_empty = true;
+
+// Copy of the ring being dumped, so that the owner can keep writing to it
+// while the records are formatted. Guarded by buffers_mutex.
+static trace_record_t snapshot[TRACE_BUFFER_RECORDS];
+
+static unsigned long now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void buffer_exit(void *args) {
+    trace_buffer_t *this = args;
+    atomic_store_explicit(&this->exited, true, memory_order_release);
+}
+
+static void trace_close(void);
+
+static void buffer_key_init(void) {
+    pthread_key_create(&buffer_key, &buffer_exit);
+    atexit(&trace_close);
+}
+
+// Buffers are mapped lazily, so a thread that never records anything costs
+// nothing, and the pages of an idle thread are never touched.
+static trace_buffer_t *buffer_get(void) {
+    if (NULL != buffer) {
+        return buffer;
+    }
+
+    trace_buffer_t *this = mmap(NULL, sizeof(trace_buffer_t),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (MAP_FAILED == this) {
+        return NULL;
+    }
+
+    this->name = "boss";
+    this->tid = syscall(SYS_gettid);
+
+    pthread_once(&buffer_once, &buffer_key_init);
+    pthread_setspecific(buffer_key, this);
+
+    pthread_mutex_lock(&buffers_mutex);
+    this->next = buffers;
+    buffers = this;
+    pthread_mutex_unlock(&buffers_mutex);
+
+    buffer = this;
+    return buffer;
+}
+
+static void record(const trace_event_t event,
+                   const unsigned long start,
+                   const unsigned long duration,
+                   const int arg) {
+    trace_buffer_t *this = buffer_get();
+    if (NULL == this) {
+        return;
+    }
+
+    unsigned long head = atomic_load_explicit(&this->head,
+        memory_order_relaxed);
+    trace_record_t *slot = &this->records[head % TRACE_BUFFER_RECORDS];
+
+    // The slot is not overwritten before the reader can see that head has
+    // reached it, see trace_buffer_t.
+    atomic_thread_fence(memory_order_release);
+
+    slot->start = start;
+    slot->duration = duration;
+    slot->event = event;
+    slot->arg = arg;
+
+    atomic_store_explicit(&this->head, head + 1, memory_order_release);
+}
+
+
+/* ************************************************************************** */
+
+
+void trace_thread_name(const char *name) {
+    trace_buffer_t *this = buffer_get();
+    if (NULL != this) {
+        this->name = name;
+    }
+}
+
+unsigned long trace_begin(void) {
+    return now();
+}
+
+void trace_end(const trace_event_t event, const unsigned long start,
+               const int arg) {
+    record(event, start, now() - start, arg);
+}
+
+void trace_instant(const trace_event_t event) {
+    record(event, now(), 0, 0);
+}
+
+// Copy the records of this from tail up to head into snapshot. Return the
+// first record that has not been overwritten by the owner in the meantime.
+static unsigned long copy_records(const trace_buffer_t *this,
+                                  const unsigned long tail,
+                                  const unsigned long head) {
+    for (unsigned long idx = tail; idx < head; ++idx) {
+        snapshot[idx % TRACE_BUFFER_RECORDS] =
+            this->records[idx % TRACE_BUFFER_RECORDS];
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    unsigned long written = atomic_load_explicit(&this->head,
+        memory_order_relaxed);
+
+    // The owner may be writing record written, and has written those before
+    // it, so the records it shares its slot with and those before them are
+    // gone.
+    if (written + 1 > tail + TRACE_BUFFER_RECORDS) {
+        return written + 1 - TRACE_BUFFER_RECORDS;
+    }
+
+    return tail;
+}
+
+static void dump_record(FILE *out, const trace_buffer_t *this,
+                        const trace_record_t *rec, bool *first) {
+    int pid = getpid();
+    double ts = rec->start / 1000.0;
+
+    fprintf(out, "%s\n{\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3lf",
+        *first ? "" : ",", event_names[rec->event], pid, this->tid, ts);
+    *first = false;
+
+    switch (rec->event) {
+        case TRACE_DEQUEUE:
+        case TRACE_SCALE_UP:
+        case TRACE_SCALE_DOWN:
+            fprintf(out, ",\"ph\":\"i\",\"s\":\"t\"}");
+            break;
+
+        case TRACE_LOCK_WAIT:
+            fprintf(out, ",\"ph\":\"X\",\"dur\":%.3lf,"
+                "\"args\":{\"lock\":\"%s\"}}",
+                rec->duration / 1000.0, pool_lock_names[rec->arg]);
+            break;
+
+        case TRACE_PARK:
+            fprintf(out, ",\"ph\":\"X\",\"dur\":%.3lf}",
+                rec->duration / 1000.0);
+            fprintf(out, ",\n{\"name\":\"wake\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%.3lf,\"ph\":\"i\",\"s\":\"t\"}",
+                pid, this->tid, (rec->start + rec->duration) / 1000.0);
+            break;
+
+        default:
+            fprintf(out, ",\"ph\":\"X\",\"dur\":%.3lf}",
+                rec->duration / 1000.0);
+            break;
+    }
+}
+
+void trace_dump(void) {
+    pthread_mutex_lock(&buffers_mutex);
+
+    if (NULL == trace_file && ! trace_file_failed) {
+        const char *path = getenv(TRACE_FILE_ENV);
+        trace_file = fopen((NULL != path) ? path : TRACE_FILE_DEFAULT, "w");
+
+        if (NULL == trace_file) {
+            perror("fopen");
+            trace_file_failed = true;
+        } else {
+            fprintf(trace_file,
+                "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        }
+    }
+
+    FILE *out = trace_file;
+    bool first = trace_file_empty;
+    trace_buffer_t **link = &buffers;
+
+    while (NULL != *link) {
+        trace_buffer_t *this = *link;
+        unsigned long head = atomic_load_explicit(&this->head,
+            memory_order_acquire);
+        unsigned long tail = (head > TRACE_BUFFER_RECORDS)
+            ? head - TRACE_BUFFER_RECORDS
+            : 0;
+
+        if (tail < this->dumped) {
+            tail = this->dumped;
+        }
+
+        if (NULL != out && head != tail) {
+            tail = copy_records(this, tail, head);
+        }
+
+        if (NULL != out && head > tail) {
+            fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                first ? "" : ",", getpid(), this->tid, this->name, this->tid);
+            first = false;
+
+            for (unsigned long idx = tail; idx < head; ++idx) {
+                dump_record(out, this,
+                    &snapshot[idx % TRACE_BUFFER_RECORDS], &first);
+            }
+        }
+
+        if (atomic_load_explicit(&this->exited, memory_order_acquire)) {
+            *link = this->next;
+            munmap(this, sizeof(trace_buffer_t));
+        } else {
+            this->dumped = head;
+            link = &this->next;
+        }
+    }
+
+    if (NULL != out) {
+        trace_file_empty = first;
+        fflush(out);
+    }
+
+    pthread_mutex_unlock(&buffers_mutex);
+}
+
+// Write what is left, e.g. of the boss thread after the last pool has been
+// destroyed, and complete the JSON.
+static void trace_close(void) {
+    trace_dump();
+
+    pthread_mutex_lock(&buffers_mutex);
+
+    if (NULL != trace_file) {
+        fprintf(trace_file, "\n]}\n");
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+
+    pthread_mutex_unlock(&buffers_mutex);
+}
+
+#endif /* THREAD_POOL_TRACE */
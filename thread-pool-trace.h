@@ -0,0 +1,99 @@
+#ifndef THREAD_POOL_TRACE_H_
+#define THREAD_POOL_TRACE_H_
+
+#define TRACE_BUFFER_RECORDS 16384
+#define TRACE_FILE_ENV       "THREAD_POOL_TRACE_FILE"
+#define TRACE_FILE_DEFAULT   "result/trace.json"
+
+
+// Description:
+//      Kinds of trace records. Spans have a start time and a duration,
+//      instants only a start time.
+//
+// Values:
+//      TRACE_DEQUEUE:
+//          Instant, a worker took a task from the task queue.
+//      TRACE_RUN:
+//          Span, a worker executed a task.
+//      TRACE_PARK:
+//          Span, a worker waited for a task or was trapped by the pool. Its
+//          end is exported as a separate "wake" instant.
+//      TRACE_LOCK_WAIT:
+//          Span, a thread waited for a contended mutex. The argument is one of
+//          pool_lock_t, see thread-pool-lock.h.
+//      TRACE_SUBMIT_BLOCK:
+//          Span, the boss thread waited for space_available.
+//      TRACE_SCALE_UP / TRACE_SCALE_DOWN:
+//          Instant, the pool decided to scale.
+typedef enum __TRACE_EVENT_TAG__ {
+    TRACE_DEQUEUE = 0,
+    TRACE_RUN,
+    TRACE_PARK,
+    TRACE_LOCK_WAIT,
+    TRACE_SUBMIT_BLOCK,
+    TRACE_SCALE_UP,
+    TRACE_SCALE_DOWN,
+
+} trace_event_t;
+
+#ifdef THREAD_POOL_TRACE
+
+// Description:
+//      Name the calling thread in the exported trace. Threads that never call
+//      it are exported as "boss".
+void trace_thread_name(const char *name);
+
+
+// Description:
+//      Return the start time of a span, to be passed to trace_end().
+unsigned long trace_begin(void);
+
+
+// Description:
+//      Append a record to the ring buffer of the calling thread. The buffer
+//      has a single writer and wraps around, keeping the most recent
+//      TRACE_BUFFER_RECORDS records.
+void trace_end(const trace_event_t event, const unsigned long start,
+               const int arg);
+
+void trace_instant(const trace_event_t event);
+
+
+// Description:
+//      Append the records of all threads of the process, not only those of
+//      one pool, to the Chrome trace JSON file named by THREAD_POOL_TRACE_FILE
+//      (default: result/trace.json). Records already written by an earlier
+//      call are skipped, and buffers of threads that have exited are
+//      released. Called by thread_pool_destroy() after the worker threads
+//      have been joined.
+//
+//      Threads still running, e.g. the boss thread, an express lane or the
+//      workers of another pool, are included too and keep recording: their
+//      rings are copied without stopping them, and records overwritten
+//      during the copy are left out rather than written torn. What they
+//      record later is added by the next call.
+//
+// Note:
+//      A process writes a single trace file, opened by the first call. The
+//      remaining records are added and the file is completed at exit, so
+//      every pool the process ran ends up in the same trace.
+void trace_dump(void);
+
+#else
+
+static inline void trace_thread_name(const char *name) { }
+
+static inline unsigned long trace_begin(void) { return 0; }
+
+static inline void trace_end(const trace_event_t event,
+                             const unsigned long start,
+                             const int arg) { }
+
+static inline void trace_instant(const trace_event_t event) { }
+
+static inline void trace_dump(void) { }
+
+#endif /* THREAD_POOL_TRACE */
+
+
+#endif /* THREAD_POOL_TRACE_H_ */
@@ -1,26 +1,43 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "thread-pool.h"
-
-#define exit_routine (void *)-1L    // 0xffffffffffffffff
+#include "../thread-pool-lock.h"
+#include "../thread-pool-trace.h"
+#include "../thread-pool-options.h"
 
 static void *start_routine(void *args) {
     task_t task = { 0 };
+    qlock_node_t node;
     thread_pool_t *this = args;
+    worker_stats_t unregistered = { 0 };
+    worker_stats_t *stats = stats_region_register(this->stats, &unregistered);
 
-    while (1) {
-        pthread_mutex_lock(&this->mutex_for_pool);
+    trace_thread_name("worker");
+    pool_stack_prepare(&this->options);
 
-        if (this->shutdown) {
-            pthread_mutex_unlock(&this->mutex_for_pool);
-            break;
+    while (1) {
+        qlock_acquire(&this->mutex_for_pool, &node, LOCK_POOL);
+        pool_mutex_lock(&this->mutex_for_queue, LOCK_QUEUE);
+
+        while (is_empty(&this->task_queue) && ! this->shutdown) {
+            unsigned long park_start = trace_begin();
+            pool_cond_wait(&this->task_available, &this->mutex_for_queue);
+            trace_end(TRACE_PARK, park_start, 0);
+            stats_add(&stats->wakeups, 1);
+
+            if (is_empty(&this->task_queue) && ! this->shutdown) {
+                stats_add(&stats->spurious_wakeups, 1);
+            }
         }
 
-        pthread_mutex_lock(&this->mutex_for_queue);
-
+        // Shut down and drained, the worker threads queued on mutex_for_pool
+        // find the same one after the other.
         if (is_empty(&this->task_queue)) {
-            pthread_cond_wait(&this->task_available, &this->mutex_for_queue);
+            pool_mutex_unlock(&this->mutex_for_queue);
+            qlock_release(&this->mutex_for_pool, &node);
+            break;
         }
 
         if (is_full(&this->task_queue)) {
@@ -29,27 +46,34 @@ static void *start_routine(void *args) {
 
         if (-1 == task_queue_pop(&this->task_queue, &task)) {
             fprintf(stderr, "Empty queue exception.\n");
-            pthread_mutex_unlock(&this->mutex_for_queue);
-            pthread_mutex_unlock(&this->mutex_for_pool);
+            pool_mutex_unlock(&this->mutex_for_queue);
+            qlock_release(&this->mutex_for_pool, &node);
+            stats_set_state(stats, WORKER_EXITED);
             pthread_exit(NULL);
         }
 
-        pthread_mutex_unlock(&this->mutex_for_queue);
+        pool_mutex_unlock(&this->mutex_for_queue);
+        trace_instant(TRACE_DEQUEUE);
+        qlock_release(&this->mutex_for_pool, &node);
 
-        if (task.run == exit_routine) {
-            this->shutdown = true;
-            pthread_mutex_unlock(&this->mutex_for_pool);
-            break;
-        }
-
-        pthread_mutex_unlock(&this->mutex_for_pool);
+        stats_set_state(stats, WORKER_RUNNING);
+        unsigned long run_start = trace_begin();
         task.run(task.arguments);
+        trace_end(TRACE_RUN, run_start, 0);
+        stats_add(&stats->tasks_completed, 1);
+        stats_set_state(stats, WORKER_IDLE);
     }
 
+    stats_set_state(stats, WORKER_EXITED);
     pthread_exit(NULL);
 }
 
 int thread_pool_init(thread_pool_t *this, const int size) {
+    return thread_pool_init_ex(this, size, NULL);
+}
+
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options) {
     if (NULL == this) {
         fprintf(stderr, "Null pointer exception.\n");
         return -1;
@@ -60,15 +84,23 @@ int thread_pool_init(thread_pool_t *this, const int size) {
         return -1;
     }
 
-    this->shutdown = false;
+    // Initialize all integer/boolean attributes to zero/false, so the error
+    // path below finds whatever has not been set up yet zeroed.
+    memset(this, 0, sizeof(thread_pool_t));
     task_queue_init(&this->task_queue);
 
+    if (NULL != options) {
+        this->options = *options;
+    }
+
+    pool_memory_prepare(&this->options, &this->task_queue,
+        sizeof(task_queue_t));
+
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_TIMED_NP);
-    // pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
 
-    if (-1 == pthread_mutex_init(&this->mutex_for_pool, &attr) ||
+    if (-1 == qlock_init(&this->mutex_for_pool, this->options.pool_lock) ||
         -1 == pthread_mutex_init(&this->mutex_for_queue, &attr)) {
         perror("pthread_mutex_init");
         goto Error;
@@ -89,23 +121,37 @@ int thread_pool_init(thread_pool_t *this, const int size) {
         goto Error;
     }
 
+    this->stats = stats_region_create(this->size);
+    if (NULL == this->stats) {
+        goto Error;
+    }
+
+    pthread_attr_t worker_attr;
+    if (-1 == pool_attr_init(&worker_attr, &this->options)) {
+        goto Error;
+    }
+
     for (int tid = 0; tid < this->size; ++tid) {
         if (-1 == pthread_create(&this->workers[tid],
-                                                NULL,
+                                                &worker_attr,
                                                 &start_routine,
                                                 this)) {
             perror("pthread_create");
+            pthread_attr_destroy(&worker_attr);
             goto Error;
         }
     }
 
+    pthread_attr_destroy(&worker_attr);
+
     return 0;
 
 Error:
     free(this->workers);
+    stats_region_destroy(this->stats);
     pthread_cond_destroy(&this->task_available);
     pthread_cond_destroy(&this->space_available);
-    pthread_mutex_destroy(&this->mutex_for_pool);
+    qlock_destroy(&this->mutex_for_pool);
     pthread_mutex_destroy(&this->mutex_for_queue);
 
     return -1;
@@ -118,11 +164,25 @@ int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args) {
     }
 
     task_t task = { .run = run, .arguments = args };
-    pthread_mutex_lock(&this->mutex_for_queue);
+    producer_stats_t *stats = &this->stats->producer;
+    pool_mutex_lock(&this->mutex_for_queue, LOCK_QUEUE);
     
     if (is_full(&this->task_queue)) {
-        pthread_cond_wait(&this->space_available, &this->mutex_for_queue);
-    } 
+        unsigned long start = stats_now_ns();
+        stats_add(&stats->producer_blocks, 1);
+
+        do {
+            pool_cond_wait(&this->space_available, &this->mutex_for_queue);
+            stats_add(&stats->wakeups, 1);
+
+            if (is_full(&this->task_queue)) {
+                stats_add(&stats->spurious_wakeups, 1);
+            }
+        } while (is_full(&this->task_queue));
+
+        stats_add(&stats->producer_block_ns, stats_now_ns() - start);
+        trace_end(TRACE_SUBMIT_BLOCK, start, 0);
+    }
 
     if (is_empty(&this->task_queue)) {
         pthread_cond_signal(&this->task_available);
@@ -130,21 +190,80 @@ int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args) {
 
     if (-1 == task_queue_push(&this->task_queue, &task)) {
         fprintf(stderr, "Full queue exception.\n");
-        pthread_mutex_unlock(&this->mutex_for_queue);
+        pool_mutex_unlock(&this->mutex_for_queue);
         return -1;
     }
 
-    pthread_mutex_unlock(&this->mutex_for_queue);
+    stats_add(&stats->tasks_submitted, 1);
+    stats_max(&stats->max_queue_depth, size(&this->task_queue));
+
+    pool_mutex_unlock(&this->mutex_for_queue);
     return 0;
 }
 
-int thread_pool_destroy(thread_pool_t *this) {
+int thread_pool_take(thread_pool_t *this, task_t *task) {
+    if (NULL == this || NULL == task) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    // Only the queue is involved, the worker threads queue on mutex_for_pool
+    // to wait for a task, which this never does.
+    pool_mutex_lock(&this->mutex_for_queue, LOCK_QUEUE);
+
+    if (is_full(&this->task_queue)) {
+        pthread_cond_signal(&this->space_available);
+    }
+
+    int ret = task_queue_pop(&this->task_queue, task);
+    pool_mutex_unlock(&this->mutex_for_queue);
+
+    if (0 == ret) {
+        atomic_fetch_add_explicit(&this->stats->producer.tasks_taken, 1,
+            memory_order_relaxed);
+    }
+
+    return ret;
+}
+
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot) {
+    if (NULL == this || NULL == snapshot) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
+
+    stats_region_snapshot(this->stats, snapshot);
+
+    pool_mutex_lock(&this->mutex_for_queue, LOCK_QUEUE);
+    snapshot->queue_depth = size(&this->task_queue);
+    pool_mutex_unlock(&this->mutex_for_queue);
+
+    return 0;
+}
+
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode) {
     if (NULL == this) {
         fprintf(stderr, "Null pointer exception.\n");
         return -1;
     }
 
-    thread_pool_run(this, exit_routine, NULL);
+    task_t task;
+    long discarded = 0;
+
+    pool_mutex_lock(&this->mutex_for_queue, LOCK_QUEUE);
+    this->shutdown = true;
+
+    if (SHUTDOWN_CANCEL == mode) {
+        while (0 == task_queue_pop(&this->task_queue, &task)) {
+            discarded += 1;
+        }
+
+        pthread_cond_broadcast(&this->space_available);
+    }
+
+    // At most the holder of mutex_for_pool waits on task_available.
+    pthread_cond_broadcast(&this->task_available);
+    pool_mutex_unlock(&this->mutex_for_queue);
 
     for (int tid = 0; tid < this->size; ++tid) {
         if (-1 == pthread_join(this->workers[tid], NULL)) {
@@ -153,11 +272,19 @@ int thread_pool_destroy(thread_pool_t *this) {
         }
     }
 
+    trace_dump();
+    lock_profile_report(this, sizeof(thread_pool_t));
+
     free(this->workers);
+    stats_region_destroy(this->stats);
     pthread_cond_destroy(&this->task_available);
     pthread_cond_destroy(&this->space_available);
-    pthread_mutex_destroy(&this->mutex_for_pool);
+    qlock_destroy(&this->mutex_for_pool);
     pthread_mutex_destroy(&this->mutex_for_queue);
 
-    return 0;
+    return discarded;
+}
+
+int thread_pool_destroy(thread_pool_t *this) {
+    return -1 == thread_pool_shutdown(this, SHUTDOWN_DRAIN) ? -1 : 0;
 }
@@ -1,8 +1,13 @@
 #ifndef THREAD_POOL_H_
 #define THREAD_POOL_H_
 
+#define TASK_TAKING 1
+
 #include <stdbool.h>
 #include <pthread.h>
+#include "../thread-pool-stats.h"
+#include "../thread-pool-options.h"
+#include "../thread-pool-qlock.h"
 #include "task-queue.h"
 
 
@@ -16,11 +21,14 @@
 //
 // Attributes:
 //      shutdown:
-//          If true, the worker threads is terminated.
+//          Set by thread_pool_shutdown(), under mutex_for_queue. Each worker
+//          thread exits once it finds the task queue empty.
 //      size:
 //          Number of the worker threads.
 //      workers:
 //          Dynamically allocate 1-dim pthread array.
+//      options:
+//          Memory footprint of the worker threads.
 //      space_available:
 //          Block the boss thread until task queue is not full.
 //      task_available:
@@ -29,23 +37,27 @@
 //          The boss thread compete with "a" worker thread for the task queue.
 //      mutex_for_pool:
 //          The worker threads compete with each other for the right to use the
-//          task queue.
+//          task queue. Its kind is set by options.pool_lock.
 //      task_queue:
 //          The boss thread inserts task to the queue and the worker threads
 //          gets task from the task queue.
+//      stats:
+//          Per-worker counters, summed up by thread_pool_stats().
 typedef struct __THREAD_POOl_TAG__ {
     bool shutdown;
 
     int size;
     pthread_t *workers;
+    thread_pool_options_t options;
 
     pthread_cond_t task_available;
     pthread_cond_t space_available;
 
-    pthread_mutex_t mutex_for_pool;
+    qlock_t mutex_for_pool;
     pthread_mutex_t mutex_for_queue;
 
     task_queue_t task_queue;
+    stats_region_t *stats;
 
 } thread_pool_t;
 
@@ -62,6 +74,20 @@ typedef struct __THREAD_POOl_TAG__ {
 int thread_pool_init(thread_pool_t *this, const int size);
 
 
+// Description:
+//      Initializes the thread pool, with the stack size, guard size and
+//      prefaulting of worker threads and task queue set by options.
+//
+// Example:
+//     thread_pool_options_t options = { .stack_size = 256 * 1024 };
+//     thread_pool_init_ex(&thrpool, 8, &options);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init_ex(thread_pool_t *this, const int size,
+                        const thread_pool_options_t *options);
+
+
 // Description:
 //      The boss thread inserts the task into the task queue. The task waiting
 //      for the worker thread to execute.
@@ -81,7 +107,45 @@ int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args);
 
 
 // Description:
-//      Join the worker threads and release resources.
+//      Take the oldest pending task off the task queue, for a thread outside
+//      the pool to run, e.g. a reserved worker thread of thread-pool-express.h
+//      with nothing else to do. The task counts as completed in the stats.
+//      Must not be called once thread_pool_destroy() has started.
+//
+// Return value:
+//      Return zero if a task was taken, or -1 if the task queue is empty or an
+//      error occurred.
+int thread_pool_take(thread_pool_t *this, task_t *task);
+
+
+// Description:
+//      Take a snapshot of the thread pool counters. Each worker thread keeps
+//      its own counters, they are only summed up here.
+//
+// Example:
+//      thread_pool_stats_t snapshot;
+//      thread_pool_stats(&thrpool, &snapshot);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot);
+
+
+// Description:
+//      Stop the worker threads and release resources. The worker threads are
+//      told by a single change of state and a broadcast, and exit once the task
+//      queue is empty: with SHUTDOWN_DRAIN after running the queued tasks, with
+//      SHUTDOWN_CANCEL right after the tasks they are running, the queued ones
+//      being discarded.
+//
+// Return value:
+//      Return the number of tasks discarded, or -1 if an error occurred.
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode);
+
+
+// Description:
+//      Run the queued tasks, join the worker threads and release resources,
+//      thread_pool_shutdown() with SHUTDOWN_DRAIN.
 //
 // Return value:
 //      Return zero on success, or -1 if an error occurred.
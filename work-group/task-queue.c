@@ -1,7 +1,7 @@
 #include "task-queue.h"
 
 inline int size(task_queue_t *this) {
-    return (this->front < this->rear)
+    return (this->front <= this->rear)
         ? this->rear - this->front
         : (RING_QUEUE_CAPACITY + 1) - (this->front - this->rear);
 }
@@ -1,141 +1,324 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include "thread-pool.h"
+#include "../thread-pool-lock.h"
+#include "../thread-pool-trace.h"
+#include "../thread-pool-options.h"
 
-#define exit_routine (void *)-1L    // 0xffffffffffffffff
-
-#define MIN_WAITING_WORKERS   8
-#define MAX_WAITING_WORKERS  500
+#define UNPARKING_DEPTH       (RING_QUEUE_CAPACITY * 7 / 10)
+#define PARKING_DEPTH          1
 #define EVALUATION_COUNTER     1000
+#define MAX_SCALING_STEP       WORKERS_PER_GROUP
 
-static void *start_routine(void *args) {
-    task_t task = { 0 };
-    thread_pool_t *this = args;
+static void futex_wait(_Atomic unsigned int *word, const unsigned int value) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
 
-    while (1) {
+static void futex_wake(_Atomic unsigned int *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
 
-        /* ****************************************************************** */
+// Park the last active worker thread. It notices the next time it looks for
+// a task. Called with mutex_for_scaling locked.
+static void park(thread_pool_t *this) {
+    int idx = --this->active_workers;
+    atomic_store(&this->workers[idx].parked, 1);
 
+    if (0 != idx % WORKERS_PER_GROUP) {
+        return;
+    }
 
-        atomic_fetch_add_explicit(&this->waiting_workers, 
-            1, memory_order_relaxed);
+    // The last worker thread of its work group, the group stops getting
+    // tasks. Wake up the worker thread waiting for a task, to drain the task
+    // queue, and the boss thread waiting for space, to move on to another
+    // work group.
+    work_group_t *group = &this->groups[idx / WORKERS_PER_GROUP];
+    atomic_store(&this->active_groups, idx / WORKERS_PER_GROUP);
+
+    pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
+    group->parking = true;
+    pthread_cond_broadcast(&group->task_available);
+    pthread_cond_broadcast(&group->space_available);
+    pool_mutex_unlock(&group->mutex_for_queue);
+}
 
-        pthread_mutex_lock(&this->mutex_for_pool);
+// Unpark the first parked worker thread. Called with mutex_for_scaling
+// locked.
+static void unpark(thread_pool_t *this) {
+    int idx = this->active_workers++;
 
-        if (this->shutdown_pool) {
-            pthread_mutex_unlock(&this->mutex_for_pool);
-            break;
-        }
+    if (0 == idx % WORKERS_PER_GROUP) {
+        work_group_t *group = &this->groups[idx / WORKERS_PER_GROUP];
 
+        pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
+        group->parking = false;
+        pool_mutex_unlock(&group->mutex_for_queue);
 
-        /* ****************************************************************** */
+        atomic_store(&this->active_groups, idx / WORKERS_PER_GROUP + 1);
+    }
 
+    atomic_store(&this->workers[idx].parked, 0);
+    futex_wake(&this->workers[idx].parked);
+}
 
-        if (this->scale_down) {
-            if (this->curr_barred_workers != WORKERS_PER_GROUP) {
-                this->curr_barred_workers += 1;
-                pthread_barrier_t *const barrier_ptr = 
-                    &this->barriers[this->curr_barrier_size];
-                pthread_mutex_unlock(&this->mutex_for_pool);
-                pthread_barrier_wait(barrier_ptr);
-
-                if (! this->shutdown_barred_group) {
-                    continue;
-                } else {
-                    break;
-                }
-
-            } else {
-                this->scale_down = false;
-                this->curr_barrier_size += 1;
-                this->curr_barred_workers = 0;                
-                pthread_cond_signal(&this->barring_completed);
-                atomic_fetch_sub_explicit(&this->waiting_workers,
-                    WORKERS_PER_GROUP, memory_order_relaxed);
-            }
+static void evaluate(thread_pool_t *this, const int queue_size) {
+    pool_mutex_lock(&this->mutex_for_scaling, LOCK_MUTEX);
 
+    if (this->shutdown) {
+        pool_mutex_unlock(&this->mutex_for_scaling);
+        return;
+    }
 
-        /* ****************************************************************** */
+    int parked = this->group_size * WORKERS_PER_GROUP - this->active_workers;
+    int step = 0;
 
+    // Follow the load a work group at a time, by the depth of the task queue
+    // the evaluating worker thread took its task from: the boss thread spreads
+    // the tasks evenly, so it stands for every active group. Unpark while a
+    // backlog builds up, park while the task queue runs dry.
+    if (UNPARKING_DEPTH < queue_size) {
+        step = (parked > MAX_SCALING_STEP) ? MAX_SCALING_STEP : parked;
 
-        } else if (this->scale_up) {
-            this->scale_up = false;
-            this->curr_barrier_size -= 1;
-            pthread_barrier_wait(&this->barriers[this->curr_barrier_size]);
-            pthread_cond_signal(&this->barring_completed);
+        for (int idx = 0; idx < step; ++idx) {
+            unpark(this);
         }
 
+        stats_add(&this->stats->scaler.scale_ups, 0 != step);
 
-        /* ****************************************************************** */
+        if (0 != step) {
+            trace_instant(TRACE_SCALE_UP);
+        }
+
+    } else if (PARKING_DEPTH >= queue_size) {
+        step = MAX_SCALING_STEP;
+
+        if (step > this->active_workers - 1) {
+            step = this->active_workers - 1;
+        }
+
+        for (int idx = 0; idx < step; ++idx) {
+            park(this);
+        }
+
+        stats_add(&this->stats->scaler.scale_downs, 0 != step);
+
+        if (0 != step) {
+            trace_instant(TRACE_SCALE_DOWN);
+        }
+    }
+
+    pool_mutex_unlock(&this->mutex_for_scaling);
+}
+
+// Whether a worker thread marked for parking may park right away. In a group
+// still active, the worker threads left take the tasks. Once the group parks,
+// the boss thread no longer inserts into it and nobody else would drain the
+// task queue, so the marked worker threads do it first.
+static bool may_park(work_group_t *group) {
+    pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
+    bool drained = ! group->parking || is_empty(&group->task_queue);
+    pool_mutex_unlock(&group->mutex_for_queue);
+
+    return drained;
+}
+
+static void *start_routine(void *args) {
+    task_t task = { 0 };
+    qlock_node_t node;
+    worker_t *worker = args;
+    work_group_t *group = worker->group;
+    thread_pool_t *this = group->pool;
+    worker_stats_t unregistered = { 0 };
+    worker_stats_t *stats = stats_region_register(this->stats, &unregistered);
+
+    trace_thread_name("worker");
+    pool_stack_prepare(&this->options);
 
+    while (1) {
+
+        /* ****************************************************************** */
 
-        if (! this->shutdown_barred_group &&
-            ++this->eval_cnt == EVALUATION_COUNTER) {
-            if (0.7 * RING_QUEUE_CAPACITY < size(&this->task_queue)) {
-                int waiting_workers_ = atomic_load_explicit(
-                    &this->waiting_workers, memory_order_relaxed);
 
-                this->scale_up = (waiting_workers_ < MIN_WAITING_WORKERS &&
-                    0 != this->curr_barrier_size);
+        if (atomic_load(&worker->parked) && may_park(group)) {
+            stats_set_state(stats, WORKER_PARKED);
+            unsigned long park_start = trace_begin();
 
-                this->scale_down = (waiting_workers_ > MAX_WAITING_WORKERS &&
-                    this->group_size - 1 != this->curr_barrier_size);
+            while (atomic_load(&worker->parked)) {
+                futex_wait(&worker->parked, 1);
             }
 
-            this->eval_cnt = 0;
+            trace_end(TRACE_PARK, park_start, 0);
+            stats_set_state(stats, WORKER_IDLE);
         }
 
+        qlock_acquire(&group->mutex_for_pool, &node, LOCK_POOL);
+
 
         /* ****************************************************************** */
 
 
-        pthread_mutex_lock(&this->mutex_for_queue);
+        pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
+
+        while (is_empty(&group->task_queue) && ! group->parking &&
+               ! group->shutdown) {
+            unsigned long park_start = trace_begin();
+            pool_cond_wait(&group->task_available, &group->mutex_for_queue);
+            trace_end(TRACE_PARK, park_start, 0);
+            stats_add(&stats->wakeups, 1);
 
-        if (is_empty(&this->task_queue)) {
-            pthread_cond_wait(&this->task_available, &this->mutex_for_queue);
+            if (is_empty(&group->task_queue) && ! group->parking &&
+                ! group->shutdown) {
+                stats_add(&stats->spurious_wakeups, 1);
+            }
         }
 
-        if (is_full(&this->task_queue)) {
-            pthread_cond_signal(&this->space_available);
+        if (is_empty(&group->task_queue) && group->shutdown) {
+            // Shut down and drained, the worker threads queued on
+            // mutex_for_pool find the same one after the other.
+            pool_mutex_unlock(&group->mutex_for_queue);
+            qlock_release(&group->mutex_for_pool, &node);
+            break;
         }
 
-         if (-1 == task_queue_pop(&this->task_queue, &task)) {
-            fprintf(stderr, "Empty queue exception.\n");
-            pthread_mutex_unlock(&this->mutex_for_queue);
-            pthread_mutex_unlock(&this->mutex_for_pool);
-            pthread_exit(NULL);
+        if (is_empty(&group->task_queue)) {
+            // The work group is parking and its task queue has been drained.
+            // Every worker thread of the group has been marked for parking
+            // already, and parks at the top of the loop.
+            pool_mutex_unlock(&group->mutex_for_queue);
+            qlock_release(&group->mutex_for_pool, &node);
+            continue;
         }
 
-        pthread_mutex_unlock(&this->mutex_for_queue);
+        int queue_size = size(&group->task_queue);
 
+        if (is_full(&group->task_queue)) {
+            pthread_cond_signal(&group->space_available);
+        }
 
-        /* ****************************************************************** */
+         if (-1 == task_queue_pop(&group->task_queue, &task)) {
+            fprintf(stderr, "Empty queue exception.\n");
+            pool_mutex_unlock(&group->mutex_for_queue);
+            qlock_release(&group->mutex_for_pool, &node);
+            stats_set_state(stats, WORKER_EXITED);
+            pthread_exit(NULL);
+        }
 
+        pool_mutex_unlock(&group->mutex_for_queue);
+        trace_instant(TRACE_DEQUEUE);
+        qlock_release(&group->mutex_for_pool, &node);
 
-        if (task.run == exit_routine) {
-            this->shutdown_pool = true;
-            pthread_mutex_unlock(&this->mutex_for_pool);
-            break;
+        if (0 == (atomic_fetch_add_explicit(&this->eval_cnt, 1,
+                      memory_order_relaxed) + 1) % EVALUATION_COUNTER) {
+            evaluate(this, queue_size);
         }
 
-        pthread_mutex_unlock(&this->mutex_for_pool);
 
-        atomic_fetch_sub_explicit(&this->waiting_workers,
-            1, memory_order_relaxed);
+        /* ****************************************************************** */
+
 
+        stats_set_state(stats, WORKER_RUNNING);
+        unsigned long run_start = trace_begin();
         task.run(task.arguments);
+        trace_end(TRACE_RUN, run_start, 0);
+        stats_add(&stats->tasks_completed, 1);
+        stats_set_state(stats, WORKER_IDLE);
 
 
         /* ****************************************************************** */
 
     }
 
+    stats_set_state(stats, WORKER_EXITED);
     pthread_exit(NULL);
 }
 
+// Wait until the task queue of group has space, or the group parks. Called
+// with mutex_for_queue of the group locked.
+static void wait_for_space(thread_pool_t *this, work_group_t *group) {
+    producer_stats_t *stats = &this->stats->producer;
+
+    if (! is_full(&group->task_queue) || group->parking) {
+        return;
+    }
+
+    unsigned long start = stats_now_ns();
+    atomic_fetch_add_explicit(&stats->producer_blocks, 1, memory_order_relaxed);
+
+    do {
+        pool_cond_wait(&group->space_available, &group->mutex_for_queue);
+        atomic_fetch_add_explicit(&stats->wakeups, 1, memory_order_relaxed);
+
+        if (is_full(&group->task_queue) && ! group->parking) {
+            atomic_fetch_add_explicit(&stats->spurious_wakeups, 1,
+                memory_order_relaxed);
+        }
+    } while (is_full(&group->task_queue) && ! group->parking);
+
+    atomic_fetch_add_explicit(&stats->producer_block_ns,
+        stats_now_ns() - start, memory_order_relaxed);
+    trace_end(TRACE_SUBMIT_BLOCK, start, 0);
+}
+
+// Insert the task into the task queue of group, which is not full. Called
+// with mutex_for_queue of the group locked.
+static int push(thread_pool_t *this, work_group_t *group, task_t *task) {
+    producer_stats_t *stats = &this->stats->producer;
+
+    if (is_empty(&group->task_queue)) {
+        pthread_cond_signal(&group->task_available);
+    }
+
+    if (-1 == task_queue_push(&group->task_queue, task)) {
+        fprintf(stderr, "Full queue exception.\n");
+        return -1;
+    }
+
+    // Producers inserting into different work groups hold different locks,
+    // so the producer counters are updated atomically.
+    atomic_fetch_add_explicit(&stats->tasks_submitted, 1,
+        memory_order_relaxed);
+
+    unsigned long depth = size(&group->task_queue);
+    unsigned long max = atomic_load_explicit(&stats->max_queue_depth,
+        memory_order_relaxed);
+
+    while (depth > max &&
+           ! atomic_compare_exchange_weak_explicit(&stats->max_queue_depth,
+               &max, depth, memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    return 0;
+}
+
+static void release(thread_pool_t *this) {
+    if (NULL != this->groups) {
+        for (int idx = 0; idx < this->group_size; ++idx) {
+            work_group_t *group = &this->groups[idx];
+
+            pthread_cond_destroy(&group->task_available);
+            pthread_cond_destroy(&group->space_available);
+            qlock_destroy(&group->mutex_for_pool);
+            pthread_mutex_destroy(&group->mutex_for_queue);
+        }
+    }
+
+    free(this->groups);
+    free(this->workers);
+    stats_region_destroy(this->stats);
+    pthread_mutex_destroy(&this->mutex_for_scaling);
+}
+
 int thread_pool_init(thread_pool_t *this, const int group_size) {
+    return thread_pool_init_ex(this, group_size, NULL);
+}
+
+int thread_pool_init_ex(thread_pool_t *this, const int group_size,
+                        const thread_pool_options_t *options) {
     if (NULL == this) {
         fprintf(stderr, "Null pointer exception.\n");
         return -1;
@@ -149,69 +332,91 @@ int thread_pool_init(thread_pool_t *this, const int group_size) {
 
     // Initialize all integer/boolean attributes to zero/false.
     memset(this, 0, sizeof(thread_pool_t));
-    task_queue_init(&this->task_queue);
 
-    if (-1 == pthread_cond_init(&this->task_available, NULL) ||
-        -1 == pthread_cond_init(&this->space_available, NULL) ||
-        -1 == pthread_cond_init(&this->barring_completed, NULL)) {
-        perror("pthread_cond_init");
-        goto Error;
+    if (NULL != options) {
+        this->options = *options;
+    } else {
+        memset(&this->options, 0, sizeof(thread_pool_options_t));
     }
 
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_TIMED_NP);
 
-    if (-1 == pthread_mutex_init(&this->mutex_for_pool, &attr) ||
-        -1 == pthread_mutex_init(&this->mutex_for_queue, &attr)) {
+    if (-1 == pthread_mutex_init(&this->mutex_for_scaling, &attr)) {
         perror("pthread_mutex_init");
-        goto Error;
+        return -1;
     }
 
-    pthread_mutexattr_destroy(&attr);
-
     this->group_size = group_size;
+    this->active_workers = group_size * WORKERS_PER_GROUP;
+    atomic_init(&this->active_groups, group_size);
 
-    this->barriers = (pthread_barrier_t *)malloc(
-        this->group_size * sizeof(pthread_barrier_t));
+    this->groups = (work_group_t *)calloc(this->group_size,
+        sizeof(work_group_t));
 
-    this->workers = (pthread_t *)malloc(
-        this->group_size * WORKERS_PER_GROUP * sizeof(pthread_t));
+    this->workers = (worker_t *)malloc(
+        this->group_size * WORKERS_PER_GROUP * sizeof(worker_t));
 
-    if (NULL == this->barriers || NULL == this->workers) {
+    if (NULL == this->groups || NULL == this->workers) {
         perror("malloc");
         goto Error;
     }
 
+    this->stats = stats_region_create(this->group_size * WORKERS_PER_GROUP);
+    if (NULL == this->stats) {
+        goto Error;
+    }
+
     for (int idx = 0; idx < this->group_size; ++idx) {
-        if (-1 == pthread_barrier_init(&this->barriers[idx],
-                                                    NULL,
-                                                    WORKERS_PER_GROUP + 1)) {
-            perror("pthread_barrier_init");
+        work_group_t *group = &this->groups[idx];
+
+        group->pool = this;
+        task_queue_init(&group->task_queue);
+        pool_memory_prepare(&this->options, &group->task_queue,
+            sizeof(task_queue_t));
+
+        if (-1 == pthread_cond_init(&group->task_available, NULL) ||
+            -1 == pthread_cond_init(&group->space_available, NULL)) {
+            perror("pthread_cond_init");
             goto Error;
         }
+
+        if (-1 == qlock_init(&group->mutex_for_pool, this->options.pool_lock) ||
+            -1 == pthread_mutex_init(&group->mutex_for_queue, &attr)) {
+            perror("pthread_mutex_init");
+            goto Error;
+        }
+    }
+
+    pthread_mutexattr_destroy(&attr);
+
+    pthread_attr_t worker_attr;
+    if (-1 == pool_attr_init(&worker_attr, &this->options)) {
+        goto Error;
     }
 
     for (int idx = 0; idx < this->group_size * WORKERS_PER_GROUP; ++idx) {
-        if (-1 == pthread_create(&this->workers[idx],
-                                            NULL,
+        worker_t *worker = &this->workers[idx];
+        worker->group = &this->groups[idx / WORKERS_PER_GROUP];
+        atomic_init(&worker->parked, 0);
+
+        if (-1 == pthread_create(&worker->thread,
+                                            &worker_attr,
                                             &start_routine,
-                                            this)) {
+                                            worker)) {
             perror("pthread_create");
+            pthread_attr_destroy(&worker_attr);
             goto Error;
         }
     }
 
+    pthread_attr_destroy(&worker_attr);
+
     return 0;
 
 Error:
-    free(this->barriers);
-    free(this->workers);
-    pthread_cond_destroy(&this->task_available);
-    pthread_cond_destroy(&this->space_available);
-    pthread_cond_destroy(&this->barring_completed);
-    pthread_mutex_destroy(&this->mutex_for_pool);
-    pthread_mutex_destroy(&this->mutex_for_queue);
+    release(this);
 
     return -1;
 }
@@ -223,74 +428,135 @@ int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args) {
     }
 
     task_t task = { .run = run, .arguments = args };
-    pthread_mutex_lock(&this->mutex_for_queue);
+    work_group_t *group = NULL;
+
+    while (1) {
+        int active = atomic_load(&this->active_groups);
+        unsigned int cursor = atomic_fetch_add_explicit(&this->next_task, 1,
+            memory_order_relaxed) / SUBMIT_BATCH;
+
+        // Hand the active groups a batch of tasks each in turn, so that a
+        // backlog is spread over all of them rather than piling up in one,
+        // while their worker threads are still woken up by a backlog rather
+        // than by every task. Skip the groups that are full or parking.
+        for (int tried = 0; tried < active; ++tried) {
+            group = &this->groups[(cursor + tried) % active];
+
+            pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
 
-    if (is_full(&this->task_queue)) {
-        pthread_cond_wait(&this->space_available, &this->mutex_for_queue);
-    } 
+            if (! group->parking && ! is_full(&group->task_queue)) {
+                goto Push;
+            }
+
+            pool_mutex_unlock(&group->mutex_for_queue);
+        }
+
+        group = &this->groups[cursor % active];
+        pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
+        wait_for_space(this, group);
+
+        if (! group->parking) {
+            break;
+        }
 
-    if (is_empty(&this->task_queue)) {
-        pthread_cond_signal(&this->task_available);
+        pool_mutex_unlock(&group->mutex_for_queue);
     }
 
-    if (-1 == task_queue_push(&this->task_queue, &task)) {
-        fprintf(stderr, "Full queue exception.\n");
-        pthread_mutex_unlock(&this->mutex_for_queue);
+Push:
+    if (-1 == push(this, group, &task)) {
+        pool_mutex_unlock(&group->mutex_for_queue);
         return -1;
     }
 
-    pthread_mutex_unlock(&this->mutex_for_queue);
+    pool_mutex_unlock(&group->mutex_for_queue);
     return 0;
 }
 
-int thread_pool_destroy(thread_pool_t *this) {
-    if (NULL == this) {
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot) {
+    if (NULL == this || NULL == snapshot) {
         fprintf(stderr, "Null pointer exception.\n");
         return -1;
     }
 
-    thread_pool_run(this, exit_routine, NULL);
+    stats_region_snapshot(this->stats, snapshot);
+    snapshot->queue_depth = 0;
 
+    for (int idx = 0; idx < this->group_size; ++idx) {
+        work_group_t *group = &this->groups[idx];
 
-    /* ********************************************************************** */
+        pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
+        snapshot->queue_depth += size(&group->task_queue);
+        pool_mutex_unlock(&group->mutex_for_queue);
+    }
 
+    return 0;
+}
 
-    pthread_mutex_lock(&this->mutex_for_pool);
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode) {
+    if (NULL == this) {
+        fprintf(stderr, "Null pointer exception.\n");
+        return -1;
+    }
 
-    this->shutdown_barred_group = true;
+    task_t task;
+    long discarded = 0;
 
-    if (this->scale_up || this->scale_down) {
-        pthread_cond_wait(&this->barring_completed, &this->mutex_for_pool);
+    // Unpark every worker thread, in O(1) each.
+    pool_mutex_lock(&this->mutex_for_scaling, LOCK_MUTEX);
+    this->shutdown = true;
+
+    while (this->active_workers != this->group_size * WORKERS_PER_GROUP) {
+        unpark(this);
     }
 
-    pthread_mutex_unlock(&this->mutex_for_pool);
+    pool_mutex_unlock(&this->mutex_for_scaling);
 
 
     /* ********************************************************************** */
 
 
-    for (int idx = 0; idx < this->curr_barrier_size; ++idx) {
-        pthread_barrier_wait(&this->barriers[idx]);
+    // At most the holder of mutex_for_pool of a group waits on
+    // task_available.
+    for (int idx = 0; idx < this->group_size; ++idx) {
+        work_group_t *group = &this->groups[idx];
+
+        pool_mutex_lock(&group->mutex_for_queue, LOCK_QUEUE);
+        group->shutdown = true;
+
+        if (SHUTDOWN_CANCEL == mode) {
+            while (0 == task_queue_pop(&group->task_queue, &task)) {
+                discarded += 1;
+            }
+
+            pthread_cond_broadcast(&group->space_available);
+        }
+
+        pthread_cond_broadcast(&group->task_available);
+        pool_mutex_unlock(&group->mutex_for_queue);
     }
 
+
+    /* ********************************************************************** */
+
+
     for (int idx = 0; idx < this->group_size * WORKERS_PER_GROUP; ++idx) {
-        if (-1 == pthread_join(this->workers[idx], NULL)) {
+        if (-1 == pthread_join(this->workers[idx].thread, NULL)) {
             perror("pthread_join");
             return -1;
         }
     }
 
-    for (int idx = 0; idx < this->group_size; ++idx) {
-        pthread_barrier_destroy(&this->barriers[idx]);
-    }
+    trace_dump();
+    lock_range_t ranges[] = {
+        { this, sizeof(thread_pool_t) },
+        { this->groups, this->group_size * sizeof(work_group_t) },
+    };
+    lock_profile_report_ranges(ranges, 2);
+    release(this);
 
-    free(this->barriers);
-    free(this->workers);
-    pthread_cond_destroy(&this->task_available);
-    pthread_cond_destroy(&this->space_available);
-    pthread_cond_destroy(&this->barring_completed);
-    pthread_mutex_destroy(&this->mutex_for_pool);
-    pthread_mutex_destroy(&this->mutex_for_queue);
+    return discarded;
+}
 
-    return 0;
+int thread_pool_destroy(thread_pool_t *this) {
+    return -1 == thread_pool_shutdown(this, SHUTDOWN_DRAIN) ? -1 : 0;
 }
@@ -7,85 +7,139 @@
 #include <stdbool.h>
 #include <stdatomic.h>
 #include <pthread.h>
+#include "../thread-pool-stats.h"
+#include "../thread-pool-options.h"
+#include "../thread-pool-qlock.h"
 #include "task-queue.h"
 
+// Tasks the boss thread inserts into a work group in a row, before it moves on
+// to the next one.
+#define SUBMIT_BATCH (RING_QUEUE_CAPACITY / 4)
+
 
 // Description:
-//      The worker threads first compete with each other and then compete with
+//      WORKERS_PER_GROUP worker threads sharing a task queue. Within the group,
+//      the worker threads first compete with each other and then compete with
 //      the boss thread.
 //
-//      Increase the probability that the boss thread uses the task queue,
-//      thereby reducing the number of times the context switch occurs because
-//      the task queue is empty.
+// Attributes:
+//      pool:
+//          The thread pool the group belongs to.
+//      parking:
+//          Set when the last worker thread of the group is parked. The boss
+//          thread no longer inserts tasks, and the worker threads of the group
+//          park once they have drained the task queue. Cleared when a worker
+//          thread of the group is unparked again.
+//      shutdown:
+//          Set by thread_pool_shutdown(). Each worker thread of the group
+//          exits once it finds the task queue empty.
+//      mutex_for_pool:
+//          The worker threads of the group compete with each other for the
+//          right to use the task queue. Its kind is set by options.pool_lock.
+//      mutex_for_queue:
+//          The boss thread compete with "a" worker thread for the task queue.
+//          Also guards parking and shutdown.
+//      task_available:
+//          Block a worker thread until task queue is not empty.
+//      space_available:
+//          Block the boss thread until task queue is not full.
+//      task_queue:
+//          The boss thread inserts task to the queue and the worker threads
+//          of the group gets task from the task queue.
+typedef struct __WORK_GROUP_TAG__ {
+    struct __THREAD_POOl_TAG__ *pool;
+    bool parking;
+    bool shutdown;
+
+    qlock_t mutex_for_pool;
+    pthread_mutex_t mutex_for_queue;
+
+    pthread_cond_t task_available;
+    pthread_cond_t space_available;
+
+    task_queue_t task_queue;
+
+} work_group_t;
+
+
+// Description:
+//      A worker thread, parked and unparked on its own futex word.
+//
+// Attributes:
+//      thread:
+//          The worker thread.
+//      group:
+//          The work group the worker thread takes its tasks from.
+//      parked:
+//          Set to one to park the worker thread, which then sleeps on the word
+//          until it is set to zero and woken up.
+typedef struct __WORKER_TAG__ {
+    pthread_t thread;
+    work_group_t *group;
+    _Atomic unsigned int parked;
+
+} worker_t;
+
+
+// Description:
+//      The worker threads are split into work groups, each with a task queue
+//      and mutexes of its own, so lock contention falls with the number of
+//      groups.
+//
+//      The boss thread hands the active work groups SUBMIT_BATCH tasks each in
+//      turn, so that the backlog, and the worker threads woken up for it, are
+//      spread over all of them.
 //
 //      The number of worker threads can be dynamically scaled up or scaled down
-//      depending on how busy the current system is.
+//      depending on how deep the task queues are, a work group at a time. The
+//      last worker thread of a work group to be parked parks the group.
 //
 // Attributes:
-//      shutdown_pool:
-//          If true, non-barred work groups is terminated.
-//      shutdown_barred_group:
-//          If true, barred work groups is terminated.
+//      shutdown:
+//          Set by thread_pool_destroy(), the pool is no longer scaled.
 //      group_size:
 //          Number of work groups.
+//      active_workers:
+//          Worker threads [0, active_workers) are active, the others are
+//          parked. Guarded by mutex_for_scaling.
+//      active_groups:
+//          Work groups [0, active_groups) are active, the boss thread
+//          distributes the tasks among them. The others are parked, or
+//          parking.
+//      next_task:
+//          Sequence number of the next task. It goes to work group
+//          next_task / SUBMIT_BATCH, modulo active_groups.
 //      workers:
-//          Dynamically allocate 1-dim pthread array.
-//      space_available:
-//          Block the boss thread until task queue is not full.
-//      task_available:
-//          Block a worker thread until task queue is not empty.
-//      barring_completed:
-//          Block the boss thread until the work group completes
-//          synchronization.
-//      mutex_for_queue:
-//          The boss thread compete with "a" worker thread for the task queue.
-//      mutex_for_pool:
-//          The worker threads compete with each other for the right to use the
-//          task queue.
-//      task_queue:
-//          The boss thread inserts task to the queue and the worker threads
-//          gets task from the task queue.
-//      scale_up:
-//          If true, wake up a sleeping work group.
-//      scale_down:
-//          If true, transfer a work group to the kernel waiting queue.
-//      barriers:
-//          Synchronize a work group at a barrier. The number of syncers is
-//          equal to the number of work groups.
+//          Dynamically allocate 1-dim worker array, WORKERS_PER_GROUP per work
+//          group in the order of the groups.
+//      groups:
+//          Dynamically allocate 1-dim work group array.
+//      options:
+//          Memory footprint of the worker threads.
+//      mutex_for_scaling:
+//          Serializes the evaluation and scaling of the pool.
 //      eval_cnt:
 //          Thread pool performance is evaluated every time N tasks are
 //          performed.
-//      waiting_workers:
-//          Record the number of worker threads waiting for mutex_for_pool.
-//      curr_barrier_size:
-//          Currently, the number of synchronized work groups.
-//      curr_barred_workers:
-//          Count until the number of barred the worker threads is equal to
-//          workers per group .
+//      stats:
+//          Per-worker counters, summed up by thread_pool_stats().
 typedef struct __THREAD_POOl_TAG__ {
-    bool scale_up;
-    bool scale_down;
-    bool shutdown_pool;
-    bool shutdown_barred_group;
-
-    int eval_cnt;
+    bool shutdown;
     int group_size;
-    int curr_barrier_size;
-    int curr_barred_workers;
+    int active_workers;
 
-    _Atomic int waiting_workers;
+    _Atomic int active_groups;
+    _Atomic unsigned int next_task;
+    _Atomic int eval_cnt;
 
-    pthread_t *workers;
-    pthread_barrier_t *barriers;
-    task_queue_t task_queue;
+    worker_t *workers;
+    work_group_t *groups;
+    thread_pool_options_t options;
 
-    pthread_cond_t task_available;
-    pthread_cond_t space_available;
-    pthread_cond_t barring_completed;
+    pthread_mutex_t mutex_for_scaling;
+
+    stats_region_t *stats;
 
-    pthread_mutex_t mutex_for_pool;
-    pthread_mutex_t mutex_for_queue;
-    
 } thread_pool_t;
 
 
@@ -102,8 +156,22 @@ int thread_pool_init(thread_pool_t *this, const int group_size);
 
 
 // Description:
-//      The boss thread inserts the task into the task queue. The task waiting
-//      for the worker thread to execute.
+//      Initializes the thread pool, with the stack size, guard size and
+//      prefaulting of worker threads and task queue set by options.
+//
+// Example:
+//     thread_pool_options_t options = { .stack_size = 256 * 1024 };
+//     thread_pool_init_ex(&thrpool, 8, &options);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_init_ex(thread_pool_t *this, const int group_size,
+                        const thread_pool_options_t *options);
+
+
+// Description:
+//      The boss thread inserts the task into the task queue of an active work
+//      group. The task waiting for a worker thread of the group to execute.
 //
 // Example:
 //      void foo(void *str) { ... }
@@ -113,14 +181,40 @@ int thread_pool_init(thread_pool_t *this, const int group_size);
 //      Return zero on success, or -1 if an error occurred.
 //
 // Note:
-//      If the boss thread attempts to insert a task to a full task queue, then
-//      function blocks until sufficient data has been got from the task queue
-//      to allow the insert to complete.
+//      If the task queue is full, the other active work groups are tried. If
+//      all of them are full, then function blocks until sufficient data has
+//      been got from a task queue to allow the insert to complete.
 int thread_pool_run(thread_pool_t *this, void (*run)(void *), void *args);
 
 
 // Description:
-//      Join the worker threads and release resources.
+//      Take a snapshot of the thread pool counters. Each worker thread keeps
+//      its own counters, they are only summed up here.
+//
+// Example:
+//      thread_pool_stats_t snapshot;
+//      thread_pool_stats(&thrpool, &snapshot);
+//
+// Return value:
+//      Return zero on success, or -1 if an error occurred.
+int thread_pool_stats(thread_pool_t *this, thread_pool_stats_t *snapshot);
+
+
+// Description:
+//      Stop the worker threads and release resources. The worker threads are
+//      told by a single change of state and a broadcast per work group, and
+//      exit once the task queue is empty: with SHUTDOWN_DRAIN after running the
+//      queued tasks, with SHUTDOWN_CANCEL right after the tasks they are
+//      running, the queued ones being discarded.
+//
+// Return value:
+//      Return the number of tasks discarded, or -1 if an error occurred.
+long thread_pool_shutdown(thread_pool_t *this, const shutdown_mode_t mode);
+
+
+// Description:
+//      Run the queued tasks, join the worker threads and release resources,
+//      thread_pool_shutdown() with SHUTDOWN_DRAIN.
 //
 // Return value:
 //      Return zero on success, or -1 if an error occurred.